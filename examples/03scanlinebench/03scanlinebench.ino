@@ -0,0 +1,261 @@
+// Scanline kernel microbenchmark for RP2350 HSTX
+//
+// Runs every scanline expansion kernel against a golden reference line and
+// prints the time per line and the number of line buffer bytes written.
+// The YCbCr conversion is the most expensive, so it also prints the time
+// available to render each source line at 720p50.
+// No display needs to be connected.  The same kernels can be checked and
+// timed off-board with "make bench" in tests/host.
+//
+// If the library is built with DVHSTX_STATS=1 and the board has a default
+// HSTX pinout it then runs the display in the line buffer modes and prints
+// the fixed cost of each scanline IRQ, i.e. the average IRQ less the time
+// taken by its kernel.
+
+#include <Adafruit_dvhstx.h>
+#include <drivers/dvhstx/dvhstx_scanline.hpp>
+
+using namespace pimoroni;
+
+// Output lines are 1280 pixels wide, as in the 1280x720 based modes
+constexpr int LINE_PIXELS = 1280;
+constexpr int TEXT_CHARS = 91;
+constexpr int ITERATIONS = 1000;
+// One output line of 1280x720 at 50Hz: 1440 pixel clocks at 52.8MHz.  A
+// kernel has repeat times this to render each source line.
+constexpr int LINE_NS = 1440 * 1000 / 52.8;
+
+static uint8_t src[LINE_PIXELS * 2];
+static uint32_t palette[256];
+static uint32_t font_cache[SCANLINE_FONT_CACHE_WORDS];
+static uint32_t dst[LINE_PIXELS];
+static uint32_t golden[LINE_PIXELS];
+
+static void report(const char *name, uint64_t elapsed_us, int bytes) {
+  bool ok = memcmp(dst, golden, bytes) == 0;
+  Serial.printf("%-16s %7lu ns/line %5d bytes/line %s\n", name,
+                (unsigned long)(elapsed_us * 1000 / ITERATIONS), bytes,
+                ok ? "OK" : "MISMATCH");
+}
+
+template <class F> static uint64_t time_kernel(F kernel) {
+  memset(dst, 0, sizeof(dst));
+  uint64_t start = time_us_64();
+  for (int i = 0; i < ITERATIONS; i++)
+    kernel();
+  return time_us_64() - start;
+}
+
+static void bench_rgb565(const char *name, int repeat) {
+  // Lines hold the source pixels, which the scanout list reads repeat times
+  const int src_pixels = LINE_PIXELS / repeat;
+  const uint16_t *src16 = (const uint16_t *)src;
+  uint16_t *golden16 = (uint16_t *)golden;
+  for (int i = 0; i < src_pixels; i++)
+    golden16[i] = src16[i];
+  uint64_t t =
+      time_kernel([&] { scanline_rgb565(dst, src16, src_pixels); });
+  report(name, t, src_pixels * 2);
+}
+
+static void bench_palette(const char *name, int repeat) {
+  const int src_pixels = LINE_PIXELS / repeat;
+  for (int i = 0; i < src_pixels; i++)
+    golden[i] = palette[src[i]];
+  uint64_t t = time_kernel(
+      [&] { scanline_palette(dst, src, palette, src_pixels); });
+  report(name, t, src_pixels * 4);
+}
+
+static void bench_palette_rgb565(const char *name, int repeat) {
+  static uint16_t palette16[256];
+  scanline_build_palette_rgb565(palette16, palette);
+  const int src_pixels = LINE_PIXELS / repeat;
+  uint16_t *golden16 = (uint16_t *)golden;
+  for (int i = 0; i < src_pixels; i++)
+    golden16[i] = palette16[src[i]];
+  uint64_t t = time_kernel(
+      [&] { scanline_palette_rgb565(dst, src, palette16, src_pixels); });
+  report(name, t, src_pixels * 2);
+}
+
+static uint8_t ycbcr_clamp(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+static void bench_ycbcr420(const char *name, int repeat) {
+  static ScanlineYCbCrTables tables;
+  scanline_build_ycbcr_tables(&tables);
+  // The Y line followed by its half width Cb and Cr lines
+  const int src_pixels = LINE_PIXELS / repeat;
+  const uint8_t *cb = src + src_pixels, *cr = cb + src_pixels / 2;
+  uint16_t *golden16 = (uint16_t *)golden;
+  for (int i = 0; i < src_pixels; i++) {
+    // BT.601 full range, each term rounded in 16.16 fixed point
+    int c = cb[i / 2] - 128, d = cr[i / 2] - 128;
+    int r = src[i] + ((91881 * d + 32768) >> 16);
+    int g = src[i] + ((-22554 * c + 32768) >> 16) + ((-46802 * d + 32768) >> 16);
+    int b = src[i] + ((116130 * c + 32768) >> 16);
+    golden16[i] = ((ycbcr_clamp(r) & 0xf8) << 8) |
+                  ((ycbcr_clamp(g) & 0xfc) << 3) | (ycbcr_clamp(b) >> 3);
+  }
+  uint64_t t = time_kernel(
+      [&] { scanline_ycbcr420(dst, src, cb, cr, &tables, src_pixels); });
+  report(name, t, src_pixels * 2);
+  Serial.printf("%-16s %7d ns/line budget\n", "", LINE_NS * repeat);
+}
+
+static void bench_tiles(const char *name, int size,
+                        void (*kernel)(uint32_t *, const uint16_t *,
+                                       const uint8_t *, const uint32_t *, int,
+                                       int)) {
+  // Random flips and banks, with tiles taken from src
+  static uint16_t map[LINE_PIXELS / 8];
+  const int tile_bytes = size * size / 2, tile_y = 5;
+  const int tile_count = sizeof(src) / tile_bytes;
+  for (int i = 0; i < LINE_PIXELS / size; i++)
+    map[i] = random(tile_count) |
+             (random(2) ? SCANLINE_TILE_HFLIP : 0) |
+             (random(2) ? SCANLINE_TILE_VFLIP : 0) |
+             (random(16) << SCANLINE_TILE_BANK_SHIFT);
+  for (int i = 0; i < LINE_PIXELS; i++) {
+    uint16_t entry = map[i / size];
+    int tx = i % size, ty = tile_y;
+    if (entry & SCANLINE_TILE_HFLIP)
+      tx = size - 1 - tx;
+    if (entry & SCANLINE_TILE_VFLIP)
+      ty = size - 1 - ty;
+    uint8_t bits = src[(entry & SCANLINE_TILE_INDEX_MASK) * tile_bytes +
+                       (ty * size + tx) / 2];
+    golden[i] = palette[(entry >> SCANLINE_TILE_BANK_SHIFT) * 16 +
+                        ((tx & 1) ? (bits & 0xf) : (bits >> 4))];
+  }
+  uint64_t t = time_kernel(
+      [&] { kernel(dst, map, src, palette, tile_y, LINE_PIXELS); });
+  report(name, t, LINE_PIXELS * 4);
+}
+
+static void bench_packed(const char *name, int bits_per_pixel,
+                         void (*kernel)(uint32_t *, const uint8_t *,
+                                        const uint32_t *, int)) {
+  static uint32_t lut[SCANLINE_PACKED_LUT_WORDS];
+  scanline_build_packed_lut(lut, palette, bits_per_pixel);
+  const int mask = (1 << bits_per_pixel) - 1;
+  for (int i = 0; i < LINE_PIXELS; i++) {
+    int shift = 8 - bits_per_pixel * (i % (8 / bits_per_pixel) + 1);
+    golden[i] = palette[(src[i * bits_per_pixel / 8] >> shift) & mask];
+  }
+  uint64_t t = time_kernel([&] { kernel(dst, src, lut, LINE_PIXELS); });
+  report(name, t, LINE_PIXELS * 4);
+}
+
+static void bench_text() {
+  const int char_y = 12;
+  for (int i = 0; i < TEXT_CHARS; i++)
+    golden[i] = scanline_render_char_line(src[i], char_y);
+  uint64_t t = time_kernel(
+      [&] { scanline_text_mono(dst, src, TEXT_CHARS, char_y); });
+  report("text_mono", t, TEXT_CHARS * 4);
+
+  uint8_t *golden8 = (uint8_t *)golden;
+  for (int i = 0; i < TEXT_CHARS; i++) {
+    uint32_t bits = scanline_render_char_line(src[2 * i], char_y);
+    uint8_t colour = src[2 * i + 1];
+    for (int j = 0; j < 13; j++)
+      golden8[i * SCANLINE_TEXT_CHAR_WIDTH + j] =
+          colour * ((bits >> (24 - 2 * j)) & 3);
+    golden8[i * SCANLINE_TEXT_CHAR_WIDTH + 13] = 0;
+  }
+  t = time_kernel([&] {
+    scanline_text_rgb111((uint8_t *)dst, src, font_cache, TEXT_CHARS, char_y);
+  });
+  report("text_rgb111", t, TEXT_CHARS * SCANLINE_TEXT_CHAR_WIDTH);
+}
+
+#ifdef DVHSTX_PINOUT_DEFAULT
+// Time a kernel in system clock cycles at the clock the display runs at
+template <class F> static uint32_t kernel_cycles(F kernel) {
+  uint64_t t = time_kernel(kernel);
+  return (uint32_t)(t * (clock_get_hz(clk_sys) / 1000000) / ITERATIONS);
+}
+
+static void report_irq(const char *name, const pimoroni::DVHSTXStats &stats,
+                       uint32_t kernel) {
+  const auto &irq = stats.irq[pimoroni::DVHSTXStats::LINE_ACTIVE_NEW];
+  uint32_t avg = irq.count ? (uint32_t)(irq.total_cycles / irq.count) : 0;
+  Serial.printf("%-16s %7lu cycles/irq %7lu kernel %7ld overhead\n", name,
+                (unsigned long)avg, (unsigned long)kernel,
+                (long)avg - (long)kernel);
+}
+
+static void bench_irq() {
+  if (!pimoroni::DVHSTX::stats_enabled()) {
+    Serial.println("IRQ overhead: build with DVHSTX_STATS=1");
+    return;
+  }
+
+  {
+    DVHSTX8 display(DVHSTX_PINOUT_DEFAULT, DVHSTX_RESOLUTION_320x180);
+    if (display.begin()) {
+      delay(1000);
+      pimoroni::DVHSTXStats stats = display.get_stats();
+      display.end();
+      uint32_t kernel = kernel_cycles(
+          [&] { scanline_palette(dst, src, palette, 320); });
+      report_irq("irq_palette_x4", stats, kernel);
+    }
+  }
+  {
+    DVHSTXText3 display(DVHSTX_PINOUT_DEFAULT);
+    if (display.begin()) {
+      delay(1000);
+      pimoroni::DVHSTXStats stats = display.get_stats();
+      display.end();
+      uint32_t kernel = kernel_cycles([&] {
+        scanline_text_rgb111((uint8_t *)dst, src, font_cache, TEXT_CHARS, 12);
+      });
+      report_irq("irq_text_rgb111", stats, kernel);
+    }
+  }
+}
+#endif
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial)
+    ;
+
+  for (size_t i = 0; i < sizeof(src); i++)
+    src[i] = random(256);
+  for (int i = 0; i < 256; i++)
+    palette[i] = random(1 << 24);
+  scanline_build_font_cache(font_cache);
+
+  bench_rgb565("rgb565_x1", 1);
+  bench_rgb565("rgb565_x2", 2);
+  bench_rgb565("rgb565_x4", 4);
+  bench_palette("palette_x1", 1);
+  bench_palette("palette_x2", 2);
+  bench_palette("palette_x4", 4);
+  bench_palette_rgb565("palette565_x1", 1);
+  bench_palette_rgb565("palette565_x2", 2);
+  bench_palette_rgb565("palette565_x4", 4);
+  bench_ycbcr420("ycbcr420_x1", 1);
+  bench_ycbcr420("ycbcr420_x2", 2);
+  bench_ycbcr420("ycbcr420_x4", 4);
+  bench_packed("palette1_x1", 1, scanline_palette1);
+  bench_packed("palette2_x1", 2, scanline_palette2);
+  bench_packed("palette4_x1", 4, scanline_palette4);
+  bench_tiles("tiles8_x1", 8, scanline_tiles8);
+  bench_tiles("tiles16_x1", 16, scanline_tiles16);
+
+  // Text mode source: printable characters with RGB111 attributes
+  for (int i = 0; i < TEXT_CHARS; i++) {
+    src[2 * i] = 0x20 + random(95);
+    src[2 * i + 1] = TextColor::TEXT_WHITE;
+  }
+  bench_text();
+#ifdef DVHSTX_PINOUT_DEFAULT
+  bench_irq();
+#endif
+}
+
+void loop() {}
@@ -0,0 +1,28 @@
+// 1-bit Adafruit_GFX-compatible framebuffer for RP2350 HSTX, at the native
+// 1280x720 resolution. Use DVHSTX2 or DVHSTX4 for 4 or 16 colours.
+
+#include <Adafruit_dvhstx.h>
+
+// If your board definition has PIN_CKP and related defines, DVHSTX_PINOUT_DEFAULT is available
+DVHSTX1 display(DVHSTX_PINOUT_DEFAULT, DVHSTX_RESOLUTION_1280x720);
+// If you get the message "error: 'DVHSTX_PINOUT_DEFAULTx' was not declared" then you need to give
+// the pins numbers explicitly, like the example below. The order is: {CKP, D0P, D1P, D2P}
+// DVHSTX1 display({12, 14, 16, 18}, DVHSTX_RESOLUTION_1280x720);
+
+void setup() {
+  Serial.begin(115200);
+  //while(!Serial);
+  if (!display.begin()) { // Blink LED if insufficient RAM
+    pinMode(LED_BUILTIN, OUTPUT);
+    for (;;) digitalWrite(LED_BUILTIN, (millis() / 500) & 1);
+  }
+  // Amber on black
+  display.setColor(1, 0xff, 0xb0, 0x00);
+  Serial.println("display initialized");
+}
+
+void loop() {
+  // Draw random lines in colour 1, erasing some in colour 0
+  display.drawLine(random(display.width()), random(display.height()), random(display.width()), random(display.height()), random(4) != 0);
+  sleep_ms(1);
+}
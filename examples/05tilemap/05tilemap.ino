@@ -0,0 +1,71 @@
+// Tile map display for RP2350 HSTX at the native 1280x720 resolution. The
+// whole screen is a 160x90 map of 8x8 tiles, under 30kB of RAM.
+
+#include <Adafruit_dvhstx.h>
+
+// If your board definition has PIN_CKP and related defines, DVHSTX_PINOUT_DEFAULT is available
+DVHSTXTiles8 display(DVHSTX_PINOUT_DEFAULT, DVHSTX_RESOLUTION_1280x720);
+// If you get the message "error: 'DVHSTX_PINOUT_DEFAULTx' was not declared" then you need to give
+// the pins numbers explicitly, like the example below. The order is: {CKP, D0P, D1P, D2P}
+// DVHSTXTiles8 display({12, 14, 16, 18}, DVHSTX_RESOLUTION_1280x720);
+
+// 4 bits per pixel, two pixels per byte, leftmost pixel in the high nibble
+static const uint8_t tiles[][DVHSTXTiles8::TILE_BYTES] = {
+  // 0: background, colour 0
+  { 0 },
+  // 1: a brick, colour 1 with colour 2 mortar
+  { 0x11, 0x11, 0x11, 0x12,
+    0x11, 0x11, 0x11, 0x12,
+    0x11, 0x11, 0x11, 0x12,
+    0x22, 0x22, 0x22, 0x22,
+    0x11, 0x12, 0x11, 0x11,
+    0x11, 0x12, 0x11, 0x11,
+    0x11, 0x12, 0x11, 0x11,
+    0x22, 0x22, 0x22, 0x22 },
+  // 2: a diagonal, colour 3, to show off flipping
+  { 0x30, 0x00, 0x00, 0x00,
+    0x03, 0x00, 0x00, 0x00,
+    0x00, 0x30, 0x00, 0x00,
+    0x00, 0x03, 0x00, 0x00,
+    0x00, 0x00, 0x30, 0x00,
+    0x00, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x30,
+    0x00, 0x00, 0x00, 0x03 },
+};
+
+void setup() {
+  Serial.begin(115200);
+  //while(!Serial);
+  if (!display.begin()) { // Blink LED if insufficient RAM
+    pinMode(LED_BUILTIN, OUTPUT);
+    for (;;) digitalWrite(LED_BUILTIN, (millis() / 500) & 1);
+  }
+  display.setTiles(&tiles[0][0]);
+
+  // Bank 0: red bricks, bank 1: grey bricks, both with a yellow diagonal
+  for (int bank = 0; bank < 2; bank++) {
+    display.setColor(bank * 16 + 0, 0x000020);
+    display.setColor(bank * 16 + 1, bank ? 0x808080 : 0xa03020);
+    display.setColor(bank * 16 + 2, 0xc0c0b0);
+    display.setColor(bank * 16 + 3, 0xffff00);
+  }
+
+  // A brick border round the screen
+  for (int col = 0; col < display.columns(); col++) {
+    display.setTile(col, 0, 1);
+    display.setTile(col, display.rows() - 1, 1);
+  }
+  for (int row = 0; row < display.rows(); row++) {
+    display.setTile(0, row, 1, 1);
+    display.setTile(display.columns() - 1, row, 1, 1);
+  }
+  Serial.println("display initialized");
+}
+
+void loop() {
+  // Scatter diagonals, randomly flipped, inside the border
+  int col = 1 + random(display.columns() - 2);
+  int row = 1 + random(display.rows() - 2);
+  display.setTile(col, row, random(3) ? 0 : 2, 0, random(2), random(2));
+  sleep_ms(1);
+}
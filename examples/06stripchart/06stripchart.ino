@@ -0,0 +1,48 @@
+// Scrolling strip chart for RP2350 HSTX. Each new sample is drawn as one
+// column and the display scrolls round the canvas to follow it, so nothing
+// already drawn is ever moved.
+
+#include <Adafruit_dvhstx.h>
+
+// If your board definition has PIN_CKP and related defines, DVHSTX_PINOUT_DEFAULT is available
+DVHSTX8 display(DVHSTX_PINOUT_DEFAULT, DVHSTX_RESOLUTION_320x180);
+// If you get the message "error: 'DVHSTX_PINOUT_DEFAULTx' was not declared" then you need to give
+// the pins numbers explicitly, like the example below. The order is: {CKP, D0P, D1P, D2P}
+// DVHSTX8 display({12, 14, 16, 18}, DVHSTX_RESOLUTION_320x180);
+
+enum { BACKGROUND, GRID, TRACE_A, TRACE_B };
+
+int column = 0;
+float phase = 0;
+
+void setup() {
+  Serial.begin(115200);
+  //while(!Serial);
+  if (!display.begin()) { // Blink LED if insufficient RAM
+    pinMode(LED_BUILTIN, OUTPUT);
+    for (;;) digitalWrite(LED_BUILTIN, (millis() / 500) & 1);
+  }
+  display.setColor(BACKGROUND, 0x000010);
+  display.setColor(GRID, 0x203040);
+  display.setColor(TRACE_A, 0x40ff40);
+  display.setColor(TRACE_B, 0xffc000);
+  display.fillScreen(BACKGROUND);
+  Serial.println("display initialized");
+}
+
+void loop() {
+  // Draw the newest sample into the column that has just scrolled off the
+  // left of the screen, then scroll so it appears at the right
+  const int h = display.height();
+  display.drawFastVLine(column, 0, h, (column % 32) ? BACKGROUND : GRID);
+  for (int y = 0; y < h; y += 30)
+    display.drawPixel(column, y, GRID);
+  display.drawPixel(column, h / 2 - sin(phase) * h / 3, TRACE_A);
+  display.drawPixel(column, h / 2 - sin(phase * 2.7) * cos(phase) * h / 3,
+                    TRACE_B);
+  phase += 0.05;
+
+  column = (column + 1) % display.width();
+  display.setScroll(column, 0);
+  sleep_ms(20);
+}
@@ -25,6 +25,12 @@ int16_t dvhstx_width(DVHSTXResolution r) {
     return 512;
   case DVHSTX_RESOLUTION_400x240:
     return 400;
+  case DVHSTX_RESOLUTION_1280x720:
+    return 1280;
+  case DVHSTX_RESOLUTION_256x224:
+    return 256;
+  case DVHSTX_RESOLUTION_426x240:
+    return 426;
   }
   return 0;
 }
@@ -54,9 +60,30 @@ int16_t dvhstx_height(DVHSTXResolution r) {
     return 384;
   case DVHSTX_RESOLUTION_400x240:
     return 240;
+  case DVHSTX_RESOLUTION_1280x720:
+    return 720;
+  case DVHSTX_RESOLUTION_256x224:
+    return 224;
+  case DVHSTX_RESOLUTION_426x240:
+    return 240;
   }
 }
 
+int16_t dvhstx_virtual_width(DVHSTXResolution r, int16_t width) {
+  // At least the screen, and even so it is a whole number of scroll steps
+  // in the 8 and 16-bit modes
+  return (std::max(width, dvhstx_width(r)) + 1) & ~1;
+}
+
+int16_t dvhstx_virtual_height(DVHSTXResolution r, int16_t height,
+                              int16_t text_rows) {
+  // The text band takes whole character rows off the top of the screen
+  const int16_t screen_height =
+      dvhstx_height(r) -
+      std::max<int16_t>(text_rows, 0) * pimoroni::SCANLINE_TEXT_CHAR_HEIGHT;
+  return std::max(height, screen_height);
+}
+
 void DVHSTX16::swap(bool copy_framebuffer) {
   if (!double_buffered) {
     return;
@@ -78,6 +105,32 @@ void DVHSTX8::swap(bool copy_framebuffer) {
   }
 }
 
+void DVHSTX8::setTextRamp(uint8_t ramp, uint32_t background,
+                          uint32_t foreground) {
+  uint32_t *palette = hstx.get_palette() +
+                      (ramp & (pimoroni::SCANLINE_TEXT_RAMPS - 1)) * 4;
+  for (int i = 0; i < 4; i++) {
+    uint32_t c = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+      int bg = (background >> shift) & 0xff, fg = (foreground >> shift) & 0xff;
+      c |= (uint32_t)((bg * (3 - i) + fg * i) / 3) << shift;
+    }
+    palette[i] = c;
+  }
+  hstx.commit_palette();
+}
+
+void DVHSTX8::writeText(int column, int row, const char *text, uint8_t ramp) {
+  uint8_t *cells = getTextBuffer();
+  if (!cells || row < 0 || row >= textRows() || column < 0)
+    return;
+  cells += (row * textColumns() + column) * 2;
+  for (int x = column; *text && x < textColumns(); x++) {
+    *cells++ = *text++;
+    *cells++ = ramp;
+  }
+}
+
 void DVHSTXText3::clear() {
   memset(getBuffer(), 0, WIDTH * HEIGHT * sizeof(uint16_t));
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "Adafruit_GFX.h"
 
 #include "drivers/dvhstx/dvhstx.hpp"
@@ -28,9 +30,22 @@ enum DVHSTXResolution {
 
   /* sometimes supported, but pixels aren't square on a 16:9 display */
   DVHSTX_RESOLUTION_400x240, /* 5:3, actual resolution 800x480@60Hz */
+
+  /* well supported, native 1280x720@50Hz. Only the packed palette canvases
+     (DVHSTX1, DVHSTX2, DVHSTX4) fit in RAM at this resolution */
+  DVHSTX_RESOLUTION_1280x720,
+
+  /* scaled to 1280x720@50Hz by a whole number of pixels across, centred
+     with black borders, and a fraction of a line down */
+  DVHSTX_RESOLUTION_256x224, /* 5x across, 3.2x down */
+  DVHSTX_RESOLUTION_426x240, /* 3x across, 3x down */
 };
 
 using pimoroni::DVHSTXPinout;
+/// A change made part way down the screen, see setRasterEffects()
+using DVHSTXRasterEffect = pimoroni::DVHSTX::RasterEffect;
+/// How begin() sets up the clocks, e.g. DVHSTXClockProfile::CLOCK_MAX_CPU
+using DVHSTXClockProfile = pimoroni::DVHSTX::ClockProfile;
 
 // If the board definition provides pre-defined pins for the HSTX connection,
 // use them to define a default pinout object.
@@ -46,6 +61,9 @@ using pimoroni::DVHSTXPinout;
 
 int16_t dvhstx_width(DVHSTXResolution r);
 int16_t dvhstx_height(DVHSTXResolution r);
+int16_t dvhstx_virtual_width(DVHSTXResolution r, int16_t width);
+int16_t dvhstx_virtual_height(DVHSTXResolution r, int16_t height,
+                              int16_t text_rows = 0);
 
 class DVHSTX16 : public GFXcanvas16 {
 public:
@@ -54,15 +72,35 @@ public:
      @brief    Instatiate a DVHSTX 16-bit canvas context for graphics
      @param    res   Display resolution
      @param    double_buffered Whether to allocate two buffers
+     @param    virtual_width Canvas width, if wider than the screen. Rounded
+     up to an even number of pixels. See setScroll().
+     @param    virtual_height Canvas height, if taller than the screen
   */
   /**************************************************************************/
   DVHSTX16(DVHSTXPinout pinout, DVHSTXResolution res,
-           bool double_buffered = false)
-      : GFXcanvas16(dvhstx_width(res), dvhstx_height(res), false),
+           bool double_buffered = false, int16_t virtual_width = 0,
+           int16_t virtual_height = 0)
+      : GFXcanvas16(dvhstx_virtual_width(res, virtual_width),
+                    dvhstx_virtual_height(res, virtual_height), false),
         pinout(pinout), res{res}, double_buffered{double_buffered} {}
   ~DVHSTX16() { end(); }
 
-  bool begin() {
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
+    hstx.set_virtual_size(WIDTH, HEIGHT);
     bool result =
         hstx.init(dvhstx_width(res), dvhstx_height(res),
                   pimoroni::DVHSTX::MODE_RGB565, double_buffered, pinout);
@@ -84,6 +122,61 @@ public:
   /**********************************************************************/
   void swap(bool copy_framebuffer = false);
 
+  /**********************************************************************/
+  /*!
+    @brief    Scroll the screen round the canvas, wrapping at its edges.
+    Nothing is redrawn: from the next frame the display just starts reading
+    each line from a different place.
+    @param x canvas column shown at the left of the screen
+    @param y canvas row shown at the top of the screen
+  */
+  /**********************************************************************/
+  void setScroll(int x, int y) { hstx.set_scroll(x, y); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Change sprite colours or the scroll position part way down the
+    screen, from the next frame. Make the effects with
+    pimoroni::DVHSTX::palette_effect(), scroll_effect() and row_effect().
+    @param effects the changes, in any order
+    @param count the number of changes, up to
+    pimoroni::DVHSTX::MAX_RASTER_EFFECTS
+    @return  false if the list is too long or the display isn't running
+  */
+  /**********************************************************************/
+  bool setRasterEffects(const DVHSTXRasterEffect *effects, int count) {
+    return hstx.set_raster_effects(effects, count);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Scale the canvas by exactly h x v on a 1280x720 display,
+    with a border round whatever it doesn't cover. Call before begin().
+    Ignored if the scaled canvas wouldn't fit.
+    @param h horizontal scale, or 0 to pick automatically
+    @param v vertical scale, or 0 to pick automatically
+  */
+  /**********************************************************************/
+  void setScale(uint8_t h, uint8_t v) { hstx.set_scale(h, v); }
+  /**********************************************************************/
+  /*!
+    @brief    Drive the display with a timing of your own, such as
+    dvi_timing_1280x720p_rb_60hz or one from dvi_cvt_rb_timing(), with the
+    canvas scaled to fit it. Call before begin(), which fails if the timing's
+    clock can't be reached.
+    @param timing the timing, which is copied, or nullptr to pick one for
+    the resolution
+  */
+  /**********************************************************************/
+  void setTiming(const struct dvi_timing *timing) { hstx.set_timing(timing); }
+  /**********************************************************************/
+  /*!
+    @brief    Set the colour of the border round a canvas that doesn't
+    fill the screen, black by default
+    @param rgb the colour as 0xRRGGBB
+  */
+  /**********************************************************************/
+  void setBorderColor(uint32_t rgb) { hstx.set_border_colour(rgb); }
+
   /**********************************************************************/
   /*!
     @brief    Convert 24-bit RGB value to a framebuffer value
@@ -97,6 +190,164 @@ public:
     return ((red & 0xF8) << 8) | ((green & 0xFC) << 3) | (blue >> 3);
   }
 
+  /**********************************************************************/
+  /*!
+    @brief    Get the scanline IRQ statistics. All zero unless the library
+    is built with DVHSTX_STATS defined to 1.
+    @return  A copy of the counters since begin() or reset_stats()
+  */
+  /**********************************************************************/
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /**********************************************************************/
+  /*!
+    @brief    Clear the scanline IRQ statistics
+  */
+  /**********************************************************************/
+  void reset_stats() { hstx.reset_stats(); }
+  /**********************************************************************/
+  /*!
+    @brief    Render scanlines on core 1 instead of in the DMA interrupt.
+    Call before begin(). Core 1 is then dedicated to the display, so the
+    sketch must not use setup1()/loop1(). Canvases sent straight from the
+    frame buffer have nothing to render: DVHSTX16 ignores it unless sprites
+    or the overlay are enabled, and DVHSTX32 and DVHSTXDirect8 don't have it.
+    @param enable true to render on core 1
+    @param lines_ahead how many lines core 1 may render ahead of the display
+  */
+  /**********************************************************************/
+  void setRenderCore1(bool enable, int lines_ahead = 4) {
+    hstx.set_render_core1(enable, lines_ahead);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Count the lines that could not be rendered in time and were
+    sent with the contents of an earlier line instead, keeping the display
+    in sync
+    @return  Lines substituted since begin()
+  */
+  /**********************************************************************/
+  uint32_t getSubstitutedLines() const { return hstx.get_substituted_lines(); }
+  /**********************************************************************/
+  /*!
+    @brief    Enable the sprite layer. Call before begin(). Sprites are
+    palette-indexed images composited over the frame buffer as each line is
+    sent, so they move without redrawing the canvas.
+    @param per_line_limit how many sprites may be drawn on one line; others
+    are left off and counted by getSpriteOverflows()
+    @param collisions true to check sprites for overlapping pixels
+  */
+  /**********************************************************************/
+  void enableSprites(int per_line_limit = 8, bool collisions = false) {
+    hstx.set_sprite_layer(true, per_line_limit, collisions);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Set a sprite's image. Lower numbered sprites are drawn on top.
+    The image is not copied and must stay valid while the sprite is shown.
+    @param n sprite number, 0 to 31
+    @param image width x height palette indexes, one byte per pixel
+    @param width image width in pixels
+    @param height image height in pixels
+    @param key the palette index drawn as transparent
+  */
+  /**********************************************************************/
+  void setSprite(int n, const uint8_t *image, int width, int height,
+                 uint8_t key = 0) {
+    hstx.set_sprite(n, image, width, height, key);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Move a sprite. Takes effect from the next frame.
+    @param n sprite number
+    @param x left edge, may be off screen
+    @param y top edge, may be off screen
+  */
+  /**********************************************************************/
+  void moveSprite(int n, int x, int y) { hstx.move_sprite(n, x, y); }
+  /**********************************************************************/
+  /*!
+    @brief    Show or hide a sprite. Sprites start hidden.
+    @param n sprite number
+    @param visible true to show the sprite
+  */
+  /**********************************************************************/
+  void showSprite(int n, bool visible) { hstx.show_sprite(n, visible); }
+  /**********************************************************************/
+  /*!
+    @brief    Get the sprites that overlapped a sprite in the last frame.
+    Always zero unless collisions were enabled, or if n is not a sprite.
+    @param n sprite number
+    @return  bit m is set if sprites n and m had overlapping pixels
+  */
+  /**********************************************************************/
+  uint32_t getSpriteCollisions(int n) const {
+    return hstx.get_sprite_collisions(n);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Count the sprites left off lines by the per-line limit
+    @return  Sprite lines dropped since begin()
+  */
+  /**********************************************************************/
+  uint32_t getSpriteOverflows() const { return hstx.get_sprite_overflows(); }
+  /**********************************************************************/
+  /*!
+    @brief    Set a colour of the palette used by sprites
+    @param idx palette index
+    @param rgb the colour as 0xRRGGBB
+  */
+  /**********************************************************************/
+  void setSpriteColor(uint8_t idx, uint32_t rgb) {
+    hstx.get_palette()[idx] = rgb;
+    hstx.commit_palette();
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Enable the overlay, an image blended over the canvas and
+    sprites as each line is sent, e.g. for alerts and HUDs that come and go
+    without redrawing the canvas. Call before begin().
+  */
+  /**********************************************************************/
+  void enableOverlay() { hstx.set_overlay_layer(true); }
+  /**********************************************************************/
+  /*!
+    @brief    Set the overlay image. Takes effect from the next frame.
+    @param pixels 4 bits per pixel, leftmost pixel in the high nibble, rows
+    of (width + 1) / 2 bytes
+    @param width image width in pixels
+    @param height image height in pixels
+  */
+  /**********************************************************************/
+  void setOverlay(const uint8_t *pixels, int width, int height) {
+    hstx.set_overlay(pixels, width, height);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Move the overlay. Takes effect from the next frame.
+    @param x left edge, may be off screen
+    @param y top edge, may be off screen
+  */
+  /**********************************************************************/
+  void moveOverlay(int x, int y) { hstx.move_overlay(x, y); }
+  /**********************************************************************/
+  /*!
+    @brief    Show or hide the overlay. It starts hidden.
+    @param visible true to show the overlay
+  */
+  /**********************************************************************/
+  void showOverlay(bool visible) { hstx.show_overlay(visible); }
+  /**********************************************************************/
+  /*!
+    @brief    Set one of the 16 overlay colours. They start transparent.
+    @param idx overlay pixel value, 0 to 15
+    @param rgb the colour as 0xRRGGBB
+    @param alpha 0 for transparent up to 255 for opaque
+  */
+  /**********************************************************************/
+  void setOverlayColor(uint8_t idx, uint32_t rgb, uint8_t alpha = 255) {
+    hstx.set_overlay_colour(idx, rgb, alpha);
+  }
+
 private:
   DVHSTXPinout pinout;
   DVHSTXResolution res;
@@ -104,43 +355,108 @@ private:
   bool double_buffered;
 };
 
-class DVHSTX8 : public GFXcanvas8 {
+/**************************************************************************/
+/*!
+   @brief  24-bit colour canvas, one 0x00RRGGBB word per pixel. The frame
+   buffer is scanned out directly, so only the lower resolutions such as
+   320x180 and 320x240 fit in RAM. Adafruit_GFX drawing functions take
+   RGB565 colours, which are widened to RGB888; drawPixel32() and
+   fillScreen32() take full RGB888 colours.
+*/
+/**************************************************************************/
+class DVHSTX32 : public Adafruit_GFX {
 public:
   /**************************************************************************/
   /*!
-     @brief    Instatiate a DVHSTX 8-bit canvas context for graphics
+     @brief    Instatiate a DVHSTX 32-bit canvas context for graphics
      @param    res   Display resolution
      @param    double_buffered Whether to allocate two buffers
   */
   /**************************************************************************/
-  DVHSTX8(DVHSTXPinout pinout, DVHSTXResolution res,
-          bool double_buffered = false)
-      : GFXcanvas8(dvhstx_width(res), dvhstx_height(res), false),
-        pinout(pinout), res{res}, double_buffered{double_buffered} {}
-  ~DVHSTX8() { end(); }
+  DVHSTX32(DVHSTXPinout pinout, DVHSTXResolution res,
+           bool double_buffered = false)
+      : Adafruit_GFX(dvhstx_width(res), dvhstx_height(res)), pinout(pinout),
+        res{res}, double_buffered{double_buffered} {}
+  ~DVHSTX32() { end(); }
 
-  bool begin() {
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
     bool result =
         hstx.init(dvhstx_width(res), dvhstx_height(res),
-                  pimoroni::DVHSTX::MODE_PALETTE, double_buffered, pinout);
+                  pimoroni::DVHSTX::MODE_RGB888, double_buffered, pinout);
     if (!result)
       return false;
-    for (int i = 0; i < 255; i++) {
-      uint8_t r = (i >> 6) * 255 / 3;
-      uint8_t g = ((i >> 2) & 7) * 255 / 7;
-      uint8_t b = (i & 3) * 255 / 3;
-      setColor(i, r, g, b);
-    }
-    buffer = hstx.get_back_buffer<uint8_t>();
-    fillScreen(0);
+    buffer = hstx.get_back_buffer<uint32_t>();
+    fillScreen32(0);
     return true;
   }
   void end() { hstx.reset(); }
 
-  void setColor(uint8_t idx, uint8_t red, uint8_t green, uint8_t blue) {
-    hstx.get_palette()[idx] = (red << 16) | (green << 8) | blue;
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    drawPixel32(x, y, color565To888(color));
+  }
+  void fillScreen(uint16_t color) override {
+    fillScreen32(color565To888(color));
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Draw a pixel in a full RGB888 colour
+    @param x x coordinate, taking the rotation into account
+    @param y y coordinate, taking the rotation into account
+    @param color 0x00RRGGBB colour
+  */
+  /**********************************************************************/
+  void drawPixel32(int16_t x, int16_t y, uint32_t color) {
+    if (buffer && rotate(x, y))
+      buffer[y * WIDTH + x] = color;
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Fill the whole canvas with a full RGB888 colour
+    @param color 0x00RRGGBB colour
+  */
+  /**********************************************************************/
+  void fillScreen32(uint32_t color) {
+    if (buffer)
+      std::fill(buffer, buffer + WIDTH * HEIGHT, color);
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get the colour of a pixel
+    @param x x coordinate, taking the rotation into account
+    @param y y coordinate, taking the rotation into account
+    @return  The 0x00RRGGBB colour, or 0 if the pixel is off the canvas
+  */
+  /**********************************************************************/
+  uint32_t getPixel(int16_t x, int16_t y) const {
+    if (!buffer || !rotate(x, y))
+      return 0;
+    return buffer[y * WIDTH + x];
   }
-  void setColor(uint8_t idx, uint32_t rgb) { hstx.get_palette()[idx] = rgb; }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get the frame buffer being drawn to
+    @return  The pixels, WIDTH words per row
+  */
+  /**********************************************************************/
+  uint32_t *getBuffer() const { return buffer; }
 
   /**********************************************************************/
   /*!
@@ -150,75 +466,1139 @@ public:
     Otherwise, the content is undefined.
   */
   /**********************************************************************/
-  void swap(bool copy_framebuffer = false);
+  void swap(bool copy_framebuffer = false) {
+    if (!double_buffered) {
+      return;
+    }
+    hstx.flip_blocking();
+    buffer = hstx.get_back_buffer<uint32_t>();
+    if (copy_framebuffer) {
+      memcpy(buffer, hstx.get_front_buffer<uint32_t>(),
+             sizeof(uint32_t) * WIDTH * HEIGHT);
+    }
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Convert 24-bit RGB value to a framebuffer value
+    @param r The input red value, 0 to 255
+    @param g The input red value, 0 to 255
+    @param b The input red value, 0 to 255
+    @return  The corresponding 32-bit pixel value
+  */
+  /**********************************************************************/
+  uint32_t color888(uint8_t red, uint8_t green, uint8_t blue) {
+    return (red << 16) | (green << 8) | blue;
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Widen an RGB565 colour, as taken by the Adafruit_GFX drawing
+    functions, to RGB888
+    @param color The RGB565 colour
+    @return  The corresponding 32-bit pixel value
+  */
+  /**********************************************************************/
+  static uint32_t color565To888(uint16_t color) {
+    uint32_t r = (color >> 11) & 0x1f, g = (color >> 5) & 0x3f, b = color & 0x1f;
+    return ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+  }
+
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
 
 private:
+  // Map rotated coordinates to the frame buffer, false if off the canvas
+  bool rotate(int16_t &x, int16_t &y) const {
+    if ((x < 0) || (y < 0) || (x >= _width) || (y >= _height))
+      return false;
+    int16_t t;
+    switch (rotation) {
+    case 1:
+      t = x;
+      x = WIDTH - 1 - y;
+      y = t;
+      break;
+    case 2:
+      x = WIDTH - 1 - x;
+      y = HEIGHT - 1 - y;
+      break;
+    case 3:
+      t = x;
+      x = y;
+      y = HEIGHT - 1 - t;
+      break;
+    }
+    return true;
+  }
+
   DVHSTXPinout pinout;
   DVHSTXResolution res;
   mutable pimoroni::DVHSTX hstx;
   bool double_buffered;
+  uint32_t *buffer = nullptr;
 };
 
-using TextColor = pimoroni::DVHSTX::TextColour;
-
-class DVHSTXText3 : public GFXcanvas16 {
+/**************************************************************************/
+/*!
+   @brief  Planar YCbCr 4:2:0 canvas, e.g. for decoded video, at 1.5 bytes
+   per pixel. Each pixel has its own Y sample, and each 2x2 block of
+   pixels shares a Cb and a Cr sample. Decoder output can be written
+   straight to the planes from getPlane(); the display converts them to
+   RGB565 a line at a time. Adafruit_GFX drawing converts each RGB565
+   colour, setting the chroma of the whole 2x2 block.
+*/
+/**************************************************************************/
+class DVHSTXYCbCr420 : public Adafruit_GFX {
 public:
-  struct Cell {
-    uint16_t value;
-    Cell(uint8_t c, uint8_t attr = TextColor::TEXT_WHITE)
-        : value(c | (attr << 8)) {}
-  };
+  /// The three planes, see getPlane()
+  using Plane = pimoroni::DVHSTX::Plane;
+
   /**************************************************************************/
   /*!
-     @brief    Instatiate a DVHSTX 8-bit canvas context for graphics
+     @brief    Instatiate a DVHSTX YCbCr 4:2:0 canvas context for graphics
      @param    res   Display resolution
      @param    double_buffered Whether to allocate two buffers
   */
   /**************************************************************************/
-  DVHSTXText3(DVHSTXPinout pinout)
-      : GFXcanvas16(91, 30, false),
-        pinout(pinout), res{res}, attr{TextColor::TEXT_WHITE} {}
-  ~DVHSTXText3() { end(); }
+  DVHSTXYCbCr420(DVHSTXPinout pinout, DVHSTXResolution res,
+                 bool double_buffered = false)
+      : Adafruit_GFX(dvhstx_width(res), dvhstx_height(res)), pinout(pinout),
+        res{res}, double_buffered{double_buffered} {}
+  ~DVHSTXYCbCr420() { end(); }
 
-  bool begin() {
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
     bool result =
-        hstx.init(91, 30, pimoroni::DVHSTX::MODE_TEXT_RGB111, false, pinout);
+        hstx.init(dvhstx_width(res), dvhstx_height(res),
+                  pimoroni::DVHSTX::MODE_YCBCR420, double_buffered, pinout);
     if (!result)
       return false;
-    buffer = hstx.get_back_buffer<uint16_t>();
+    started = true;
     return true;
   }
-  void end() { hstx.reset(); }
-
-  void clear();
+  void end() {
+    started = false;
+    hstx.reset();
+  }
 
-  void set_color(TextColor a) { attr = a; }
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (!started || (x < 0) || (y < 0) || (x >= _width) || (y >= _height))
+      return;
+    int16_t t;
+    switch (rotation) {
+    case 1:
+      t = x;
+      x = WIDTH - 1 - y;
+      y = t;
+      break;
+    case 2:
+      x = WIDTH - 1 - x;
+      y = HEIGHT - 1 - y;
+      break;
+    case 3:
+      t = x;
+      x = y;
+      y = HEIGHT - 1 - t;
+      break;
+    }
 
-  void hide_cursor() {
-    cursor_visible = false;
-    hstx.cursor_off();
+    int r = (color >> 8) & 0xf8, g = (color >> 3) & 0xfc, b = (color << 3) & 0xf8;
+    // Full range BT.601, in 16.16 fixed point
+    getPlane(Plane::PLANE_Y)[y * getStride(Plane::PLANE_Y) + x] =
+        (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+    const int c = (y >> 1) * getStride(Plane::PLANE_CB) + (x >> 1);
+    getPlane(Plane::PLANE_CB)[c] =
+        (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16;
+    getPlane(Plane::PLANE_CR)[c] =
+        (32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16;
   }
 
-  void show_cursor() {
-    cursor_visible = true;
-    sync_cursor_with_hstx();
+  /**********************************************************************/
+  /*!
+    @brief    Get a plane of the frame buffer being drawn to
+    @param plane PLANE_Y, PLANE_CB or PLANE_CR
+    @return  The samples, getStride(plane) bytes per row
+  */
+  /**********************************************************************/
+  uint8_t *getPlane(Plane plane) { return hstx.get_back_plane(plane); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get the distance between rows of a plane
+    @param plane PLANE_Y, PLANE_CB or PLANE_CR
+    @return  The stride in bytes
+  */
+  /**********************************************************************/
+  uint getStride(Plane plane) const { return hstx.get_plane_stride(plane); }
+
+  /**********************************************************************/
+  /*!
+    @brief    If double-buffered, wait for retrace and swap buffers. Otherwise,
+    do nothing (returns immediately)
+    @param copy_framebuffer if true, copy the new screen to the new back buffer.
+    Otherwise, the content is undefined.
+  */
+  /**********************************************************************/
+  void swap(bool copy_framebuffer = false) {
+    if (!double_buffered) {
+      return;
+    }
+    hstx.flip_blocking();
+    if (copy_framebuffer) {
+      // The planes are contiguous, ending with Cr
+      const Plane cr = Plane::PLANE_CR;
+      const uint8_t *front = hstx.get_front_plane(Plane::PLANE_Y);
+      size_t bytes = hstx.get_front_plane(cr) - front +
+                     getStride(cr) * ((HEIGHT + 1) / 2);
+      memcpy(getPlane(Plane::PLANE_Y), front, bytes);
+    }
   }
 
-  void set_cursor(int x, int y) {
-    if (x < 0)
-      x = 0;
-    if (x > _width)
-      x = _width;
-    if (y < 0)
-      y = 0;
-    if (y >= _height)
-      y = _height - 1;
-    cursor_x = x;
-    cursor_y = y;
-    sync_cursor_with_hstx();
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
+  /*! @copydoc DVHSTX16::setRenderCore1 */
+  void setRenderCore1(bool enable, int lines_ahead = 4) {
+    hstx.set_render_core1(enable, lines_ahead);
   }
+  /*! @copydoc DVHSTX16::setScale */
+  void setScale(uint8_t h, uint8_t v) { hstx.set_scale(h, v); }
+  /*! @copydoc DVHSTX16::setTiming */
+  void setTiming(const struct dvi_timing *timing) { hstx.set_timing(timing); }
+  /*! @copydoc DVHSTX16::setBorderColor */
+  void setBorderColor(uint32_t rgb) { hstx.set_border_colour(rgb); }
+  /*! @copydoc DVHSTX16::getSubstitutedLines */
+  uint32_t getSubstitutedLines() const { return hstx.get_substituted_lines(); }
 
-  size_t write(uint8_t c);
+private:
+  DVHSTXPinout pinout;
+  DVHSTXResolution res;
+  mutable pimoroni::DVHSTX hstx;
+  bool double_buffered;
+  bool started = false;
+};
+
+class DVHSTX8 : public GFXcanvas8 {
+public:
+  /**************************************************************************/
+  /*!
+     @brief    Instatiate a DVHSTX 8-bit canvas context for graphics
+     @param    res   Display resolution
+     @param    double_buffered Whether to allocate two buffers
+     @param    virtual_width Canvas width, if wider than the screen. Rounded
+     up to an even number of pixels. See setScroll().
+     @param    virtual_height Canvas height, if taller than the screen
+     @param    text_rows Rows of text in a band above the canvas, which is
+     then that much shorter. See writeText().
+  */
+  /**************************************************************************/
+  DVHSTX8(DVHSTXPinout pinout, DVHSTXResolution res,
+          bool double_buffered = false, int16_t virtual_width = 0,
+          int16_t virtual_height = 0, int16_t text_rows = 0)
+      : GFXcanvas8(dvhstx_virtual_width(res, virtual_width),
+                   dvhstx_virtual_height(res, virtual_height, text_rows),
+                   false),
+        pinout(pinout), res{res}, double_buffered{double_buffered},
+        text_rows{text_rows} {}
+  ~DVHSTX8() { end(); }
+
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
+    const pimoroni::DVHSTX::Band bands[] = {
+        {(uint16_t)(text_rows * pimoroni::SCANLINE_TEXT_CHAR_HEIGHT),
+         pimoroni::DVHSTX::BAND_TEXT},
+        {0, pimoroni::DVHSTX::BAND_FRAME}};
+    if (text_rows > 0)
+      hstx.set_bands(bands, 2);
+    else
+      hstx.clear_bands();
+    hstx.set_virtual_size(WIDTH, HEIGHT);
+    bool result =
+        hstx.init(dvhstx_width(res), dvhstx_height(res),
+                  palette_mode, double_buffered, pinout);
+    if (!result)
+      return false;
+    for (int i = 0; i < 255; i++) {
+      uint8_t r = (i >> 6) * 255 / 3;
+      uint8_t g = ((i >> 2) & 7) * 255 / 7;
+      uint8_t b = (i & 3) * 255 / 3;
+      setColor(i, r, g, b);
+    }
+    buffer = hstx.get_back_buffer<uint8_t>();
+    fillScreen(0);
+    return true;
+  }
+  void end() { hstx.reset(); }
+
+  void setColor(uint8_t idx, uint8_t red, uint8_t green, uint8_t blue) {
+    setColor(idx, (uint32_t)((red << 16) | (green << 8) | blue));
+  }
+  void setColor(uint8_t idx, uint32_t rgb) {
+    hstx.get_palette()[idx] = rgb;
+    hstx.commit_palette();
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Send the palette colours as RGB565 instead of RGB888, halving
+    the line buffers and the memory traffic of the scanline interrupt.
+    Call before begin(). Colour changes then take effect from the next
+    frame.
+    @param enable true to send RGB565
+  */
+  /**********************************************************************/
+  void setPaletteRGB565(bool enable) {
+    palette_mode = enable ? pimoroni::DVHSTX::MODE_PALETTE_RGB565
+                          : pimoroni::DVHSTX::MODE_PALETTE;
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    If double-buffered, wait for retrace and swap buffers. Otherwise,
+    do nothing (returns immediately)
+    @param copy_framebuffer if true, copy the new screen to the new back buffer.
+    Otherwise, the content is undefined.
+  */
+  /**********************************************************************/
+  void swap(bool copy_framebuffer = false);
+
+  /**********************************************************************/
+  /*!
+    @brief    Scroll the screen round the canvas, wrapping at its edges.
+    Nothing is redrawn: from the next frame the display just starts reading
+    each line from a different place.
+    @param x canvas column shown at the left of the screen
+    @param y canvas row shown at the top of the screen
+  */
+  /**********************************************************************/
+  void setScroll(int x, int y) { hstx.set_scroll(x, y); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Change palette entries or the scroll position part way down the
+    screen, from the next frame. Make the effects with
+    pimoroni::DVHSTX::palette_effect(), scroll_effect() and row_effect().
+    @param effects the changes, in any order
+    @param count the number of changes, up to
+    pimoroni::DVHSTX::MAX_RASTER_EFFECTS
+    @return  false if the list is too long or the display isn't running
+  */
+  /**********************************************************************/
+  bool setRasterEffects(const DVHSTXRasterEffect *effects, int count) {
+    return hstx.set_raster_effects(effects, count);
+  }
+
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
+  /*! @copydoc DVHSTX16::setRenderCore1 */
+  void setRenderCore1(bool enable, int lines_ahead = 4) {
+    hstx.set_render_core1(enable, lines_ahead);
+  }
+  /*! @copydoc DVHSTX16::setScale */
+  void setScale(uint8_t h, uint8_t v) { hstx.set_scale(h, v); }
+  /*! @copydoc DVHSTX16::setTiming */
+  void setTiming(const struct dvi_timing *timing) { hstx.set_timing(timing); }
+  /*! @copydoc DVHSTX16::setBorderColor */
+  void setBorderColor(uint32_t rgb) { hstx.set_border_colour(rgb); }
+  /*! @copydoc DVHSTX16::getSubstitutedLines */
+  uint32_t getSubstitutedLines() const { return hstx.get_substituted_lines(); }
+  /**********************************************************************/
+  /*!
+    @brief    Enable the sprite layer. Call before begin(). Sprites are
+    palette-indexed images composited over the frame buffer as each line is
+    sent, so they move without redrawing the canvas.
+    @param per_line_limit how many sprites may be drawn on one line; others
+    are left off and counted by getSpriteOverflows()
+    @param collisions true to check sprites for overlapping pixels
+  */
+  /**********************************************************************/
+  void enableSprites(int per_line_limit = 8, bool collisions = false) {
+    hstx.set_sprite_layer(true, per_line_limit, collisions);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Set a sprite's image. Lower numbered sprites are drawn on top.
+    The image is not copied and must stay valid while the sprite is shown.
+    @param n sprite number, 0 to 31
+    @param image width x height palette indexes, one byte per pixel
+    @param width image width in pixels
+    @param height image height in pixels
+    @param key the palette index drawn as transparent
+  */
+  /**********************************************************************/
+  void setSprite(int n, const uint8_t *image, int width, int height,
+                 uint8_t key = 0) {
+    hstx.set_sprite(n, image, width, height, key);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Move a sprite. Takes effect from the next frame.
+    @param n sprite number
+    @param x left edge, may be off screen
+    @param y top edge, may be off screen
+  */
+  /**********************************************************************/
+  void moveSprite(int n, int x, int y) { hstx.move_sprite(n, x, y); }
+  /**********************************************************************/
+  /*!
+    @brief    Show or hide a sprite. Sprites start hidden.
+    @param n sprite number
+    @param visible true to show the sprite
+  */
+  /**********************************************************************/
+  void showSprite(int n, bool visible) { hstx.show_sprite(n, visible); }
+  /**********************************************************************/
+  /*!
+    @brief    Get the sprites that overlapped a sprite in the last frame.
+    Always zero unless collisions were enabled, or if n is not a sprite.
+    @param n sprite number
+    @return  bit m is set if sprites n and m had overlapping pixels
+  */
+  /**********************************************************************/
+  uint32_t getSpriteCollisions(int n) const {
+    return hstx.get_sprite_collisions(n);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Count the sprites left off lines by the per-line limit
+    @return  Sprite lines dropped since begin()
+  */
+  /**********************************************************************/
+  uint32_t getSpriteOverflows() const { return hstx.get_sprite_overflows(); }
+  /**********************************************************************/
+  /*!
+    @brief    Enable the overlay, an image blended over the canvas and
+    sprites as each line is sent, e.g. for alerts and HUDs that come and go
+    without redrawing the canvas. Call before begin().
+  */
+  /**********************************************************************/
+  void enableOverlay() { hstx.set_overlay_layer(true); }
+  /**********************************************************************/
+  /*!
+    @brief    Set the overlay image. Takes effect from the next frame.
+    @param pixels 4 bits per pixel, leftmost pixel in the high nibble, rows
+    of (width + 1) / 2 bytes
+    @param width image width in pixels
+    @param height image height in pixels
+  */
+  /**********************************************************************/
+  void setOverlay(const uint8_t *pixels, int width, int height) {
+    hstx.set_overlay(pixels, width, height);
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Move the overlay. Takes effect from the next frame.
+    @param x left edge, may be off screen
+    @param y top edge, may be off screen
+  */
+  /**********************************************************************/
+  void moveOverlay(int x, int y) { hstx.move_overlay(x, y); }
+  /**********************************************************************/
+  /*!
+    @brief    Show or hide the overlay. It starts hidden.
+    @param visible true to show the overlay
+  */
+  /**********************************************************************/
+  void showOverlay(bool visible) { hstx.show_overlay(visible); }
+  /**********************************************************************/
+  /*!
+    @brief    Set one of the 16 overlay colours. They start transparent.
+    @param idx overlay pixel value, 0 to 15
+    @param rgb the colour as 0xRRGGBB
+    @param alpha 0 for transparent up to 255 for opaque
+  */
+  /**********************************************************************/
+  void setOverlayColor(uint8_t idx, uint32_t rgb, uint8_t alpha = 255) {
+    hstx.set_overlay_colour(idx, rgb, alpha);
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Set the colours of a text ramp: four palette entries from
+    ramp * 4, the background, two shades for the edges of the glyphs and
+    the foreground
+    @param ramp ramp number, 0 to 63
+    @param background background colour as 0xRRGGBB
+    @param foreground foreground colour as 0xRRGGBB
+  */
+  /**********************************************************************/
+  void setTextRamp(uint8_t ramp, uint32_t background, uint32_t foreground);
+  /**********************************************************************/
+  /*!
+    @brief    Write text into the text band. It is shown straight away,
+    without drawing anything into the canvas. Text off the end of the row
+    is left out.
+    @param column first character column
+    @param row character row
+    @param text the characters to write
+    @param ramp colours of the text, see setTextRamp()
+  */
+  /**********************************************************************/
+  void writeText(int column, int row, const char *text, uint8_t ramp = 0);
+  /**********************************************************************/
+  /*!
+    @brief    Get the character cells of the text band, each a character
+    byte then a ramp byte
+    @return  textColumns() cells per row, or nullptr without a text band
+  */
+  /**********************************************************************/
+  uint8_t *getTextBuffer() const { return hstx.get_text_band(0); }
+  /**********************************************************************/
+  /*!
+    @brief    Get the width of the text band
+    @return  Character columns across the screen
+  */
+  /**********************************************************************/
+  int textColumns() const {
+    return getTextBuffer() ? hstx.get_text_band_columns() : 0;
+  }
+  /**********************************************************************/
+  /*!
+    @brief    Get the height of the text band
+    @return  Character rows, 0 without a text band
+  */
+  /**********************************************************************/
+  int textRows() const { return hstx.get_text_band_rows(0); }
+
+private:
+  DVHSTXPinout pinout;
+  DVHSTXResolution res;
+  mutable pimoroni::DVHSTX hstx;
+  bool double_buffered;
+  int16_t text_rows;
+  pimoroni::DVHSTX::Mode palette_mode = pimoroni::DVHSTX::MODE_PALETTE;
+};
+
+/**************************************************************************/
+/*!
+   @brief  8-bit direct colour canvas with no palette. The HSTX expander
+   takes the colour bits straight from each byte, so scanout needs no CPU
+   time per pixel. Use DVHSTX332 (0bRRRGGGBB) or DVHSTX222 (0b00RRGGBB);
+   color() packs a colour for either.
+*/
+/**************************************************************************/
+template <pimoroni::DVHSTX::Mode MODE> class DVHSTXDirect8 : public GFXcanvas8 {
+public:
+  /**************************************************************************/
+  /*!
+     @brief    Instatiate a DVHSTX 8-bit direct colour canvas context for
+     graphics
+     @param    res   Display resolution
+     @param    double_buffered Whether to allocate two buffers
+  */
+  /**************************************************************************/
+  DVHSTXDirect8(DVHSTXPinout pinout, DVHSTXResolution res,
+                bool double_buffered = false)
+      : GFXcanvas8(dvhstx_width(res), dvhstx_height(res), false),
+        pinout(pinout), res{res}, double_buffered{double_buffered} {}
+  ~DVHSTXDirect8() { end(); }
+
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
+    bool result = hstx.init(dvhstx_width(res), dvhstx_height(res), MODE,
+                            double_buffered, pinout);
+    if (!result)
+      return false;
+    buffer = hstx.get_back_buffer<uint8_t>();
+    fillScreen(0);
+    return true;
+  }
+  void end() { hstx.reset(); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Convert 24-bit RGB value to a framebuffer value
+    @param r The input red value, 0 to 255
+    @param g The input green value, 0 to 255
+    @param b The input blue value, 0 to 255
+    @return  The corresponding 8-bit pixel value
+  */
+  /**********************************************************************/
+  static uint8_t color(uint8_t red, uint8_t green, uint8_t blue) {
+    if (MODE == pimoroni::DVHSTX::MODE_RGB332)
+      return (red & 0xe0) | ((green & 0xe0) >> 3) | (blue >> 6);
+    return ((red & 0xc0) >> 2) | ((green & 0xc0) >> 4) | (blue >> 6);
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    If double-buffered, wait for retrace and swap buffers. Otherwise,
+    do nothing (returns immediately)
+    @param copy_framebuffer if true, copy the new screen to the new back buffer.
+    Otherwise, the content is undefined.
+  */
+  /**********************************************************************/
+  void swap(bool copy_framebuffer = false) {
+    if (!double_buffered) {
+      return;
+    }
+    hstx.flip_blocking();
+    buffer = hstx.get_back_buffer<uint8_t>();
+    if (copy_framebuffer) {
+      memcpy(buffer, hstx.get_front_buffer<uint8_t>(),
+             sizeof(uint8_t) * WIDTH * HEIGHT);
+    }
+  }
+
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
+
+private:
+  DVHSTXPinout pinout;
+  DVHSTXResolution res;
+  mutable pimoroni::DVHSTX hstx;
+  bool double_buffered;
+};
+
+/// 8-bit direct colour canvas, 0bRRRGGGBB
+typedef DVHSTXDirect8<pimoroni::DVHSTX::MODE_RGB332> DVHSTX332;
+/// 8-bit direct colour canvas, 0b00RRGGBB
+typedef DVHSTXDirect8<pimoroni::DVHSTX::MODE_RGB222> DVHSTX222;
+
+/**************************************************************************/
+/*!
+   @brief  Packed palette canvas with 1, 2 or 4 bits per pixel, giving 2, 4
+   or 16 colours. Use it as DVHSTX1, DVHSTX2 or DVHSTX4. Pixels are packed
+   leftmost first from the most significant bits of each byte, and each row
+   starts on a byte boundary.
+*/
+/**************************************************************************/
+template <int BITS> class DVHSTXPacked : public Adafruit_GFX {
+public:
+  /**************************************************************************/
+  /*!
+     @brief    Instatiate a DVHSTX packed palette canvas context for graphics
+     @param    res   Display resolution
+     @param    double_buffered Whether to allocate two buffers
+  */
+  /**************************************************************************/
+  DVHSTXPacked(DVHSTXPinout pinout, DVHSTXResolution res,
+               bool double_buffered = false)
+      : Adafruit_GFX(dvhstx_width(res), dvhstx_height(res)), pinout(pinout),
+        res{res}, double_buffered{double_buffered},
+        stride((dvhstx_width(res) * BITS + 7) / 8) {}
+  ~DVHSTXPacked() { end(); }
+
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
+    bool result = hstx.init(dvhstx_width(res), dvhstx_height(res), MODE,
+                            double_buffered, pinout);
+    if (!result)
+      return false;
+    if (BITS == 4) {
+      // The 16 colour CGA palette
+      for (int i = 0; i < 16; i++) {
+        uint8_t level = (i & 8) ? 0xff : 0xaa;
+        uint8_t bright = (i & 8) ? 0x55 : 0;
+        uint8_t r = ((i & 4) ? level : bright);
+        uint8_t g = ((i & 2) ? level : bright);
+        uint8_t b = ((i & 1) ? level : bright);
+        if (i == 6)
+          g = 0x55; // brown
+        setColor(i, r, g, b);
+      }
+    } else {
+      // Evenly spaced greys from black to white
+      for (int i = 0; i <= MASK; i++) {
+        uint8_t level = i * 255 / MASK;
+        setColor(i, level, level, level);
+      }
+    }
+    buffer = hstx.get_back_buffer<uint8_t>();
+    fillScreen(0);
+    return true;
+  }
+  void end() { hstx.reset(); }
+
+  void setColor(uint8_t idx, uint8_t red, uint8_t green, uint8_t blue) {
+    hstx.get_palette()[idx] = (red << 16) | (green << 8) | blue;
+  }
+  void setColor(uint8_t idx, uint32_t rgb) { hstx.get_palette()[idx] = rgb; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (!buffer || !rotate(x, y))
+      return;
+    uint8_t *ptr = &buffer[y * stride + x * BITS / 8];
+    const int shift = 8 - BITS * (x % (8 / BITS) + 1);
+    *ptr = (*ptr & ~(MASK << shift)) | ((color & MASK) << shift);
+  }
+
+  void fillScreen(uint16_t color) override {
+    if (buffer)
+      memset(buffer, (color & MASK) * (0xff / MASK), stride * HEIGHT);
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get the palette index of a pixel
+    @param x x coordinate, taking the rotation into account
+    @param y y coordinate, taking the rotation into account
+    @return  The palette index, or 0 if the pixel is off the canvas
+  */
+  /**********************************************************************/
+  uint8_t getPixel(int16_t x, int16_t y) const {
+    if (!buffer || !rotate(x, y))
+      return 0;
+    const int shift = 8 - BITS * (x % (8 / BITS) + 1);
+    return (buffer[y * stride + x * BITS / 8] >> shift) & MASK;
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get the frame buffer being drawn to
+    @return  The packed pixels, stride bytes per row
+  */
+  /**********************************************************************/
+  uint8_t *getBuffer() const { return buffer; }
+
+  /**********************************************************************/
+  /*!
+    @brief    If double-buffered, wait for retrace and swap buffers. Otherwise,
+    do nothing (returns immediately)
+    @param copy_framebuffer if true, copy the new screen to the new back buffer.
+    Otherwise, the content is undefined.
+  */
+  /**********************************************************************/
+  void swap(bool copy_framebuffer = false) {
+    if (!double_buffered) {
+      return;
+    }
+    hstx.flip_blocking();
+    buffer = hstx.get_back_buffer<uint8_t>();
+    if (copy_framebuffer) {
+      memcpy(buffer, hstx.get_front_buffer<uint8_t>(), stride * HEIGHT);
+    }
+  }
+
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
+  /*! @copydoc DVHSTX16::setRenderCore1 */
+  void setRenderCore1(bool enable, int lines_ahead = 4) {
+    hstx.set_render_core1(enable, lines_ahead);
+  }
+  /*! @copydoc DVHSTX16::getSubstitutedLines */
+  uint32_t getSubstitutedLines() const { return hstx.get_substituted_lines(); }
+
+private:
+  static constexpr int MASK = (1 << BITS) - 1;
+  static constexpr pimoroni::DVHSTX::Mode MODE =
+      (BITS == 1)   ? pimoroni::DVHSTX::MODE_PALETTE1
+      : (BITS == 2) ? pimoroni::DVHSTX::MODE_PALETTE2
+                    : pimoroni::DVHSTX::MODE_PALETTE4;
+
+  // Map rotated coordinates to the frame buffer, false if off the canvas
+  bool rotate(int16_t &x, int16_t &y) const {
+    if ((x < 0) || (y < 0) || (x >= _width) || (y >= _height))
+      return false;
+    int16_t t;
+    switch (rotation) {
+    case 1:
+      t = x;
+      x = WIDTH - 1 - y;
+      y = t;
+      break;
+    case 2:
+      x = WIDTH - 1 - x;
+      y = HEIGHT - 1 - y;
+      break;
+    case 3:
+      t = x;
+      x = y;
+      y = HEIGHT - 1 - t;
+      break;
+    }
+    return true;
+  }
+
+  DVHSTXPinout pinout;
+  DVHSTXResolution res;
+  mutable pimoroni::DVHSTX hstx;
+  bool double_buffered;
+  uint8_t *buffer = nullptr;
+  int stride;
+};
+
+/// 2 colour canvas, 1 bit per pixel
+typedef DVHSTXPacked<1> DVHSTX1;
+/// 4 colour canvas, 2 bits per pixel
+typedef DVHSTXPacked<2> DVHSTX2;
+/// 16 colour canvas, 4 bits per pixel
+typedef DVHSTXPacked<4> DVHSTX4;
+
+/**************************************************************************/
+/*!
+   @brief  Tile map display. The screen is a grid of 8x8 or 16x16 pixel
+   tiles, each picked from shared tile data by an entry in a small map, so
+   any resolution up to 1280x720 takes only a few kB of RAM. Tiles are 4
+   bits per pixel, and each map entry selects one of 16 banks of 16
+   palette entries. Use DVHSTXTiles8 or DVHSTXTiles16.
+*/
+/**************************************************************************/
+template <int TILE_SIZE> class DVHSTXTileMap {
+public:
+  /// Bytes of tile data per tile
+  static constexpr int TILE_BYTES = TILE_SIZE * TILE_SIZE / 2;
+
+  /**************************************************************************/
+  /*!
+     @brief    Instatiate a DVHSTX tile map context
+     @param    res   Display resolution
+     @param    double_buffered Whether to allocate two maps
+     @param    map_columns Map columns, if more than cover the screen. See
+     setScroll().
+     @param    map_rows Map rows, if more than cover the screen
+  */
+  /**************************************************************************/
+  DVHSTXTileMap(DVHSTXPinout pinout, DVHSTXResolution res,
+                bool double_buffered = false, int map_columns = 0,
+                int map_rows = 0)
+      : pinout(pinout), res{res}, double_buffered{double_buffered},
+        map_columns(map_columns), map_rows(map_rows) {}
+  ~DVHSTXTileMap() { end(); }
+
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
+    hstx.set_virtual_size(map_columns * TILE_SIZE, map_rows * TILE_SIZE);
+    bool result = hstx.init(dvhstx_width(res), dvhstx_height(res), MODE,
+                            double_buffered, pinout);
+    if (!result)
+      return false;
+    map = hstx.get_back_buffer<uint16_t>();
+    return true;
+  }
+  void end() {
+    map = nullptr;
+    hstx.reset();
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Set the tile data, which may be in flash. It must cover every
+    tile used in the map.
+    @param tiles TILE_BYTES per tile, 4 bits per pixel with the leftmost
+    pixel in the most significant bits, a row at a time
+  */
+  /**********************************************************************/
+  void setTiles(const uint8_t *tiles) { hstx.set_tiles(tiles); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Make a map entry
+    @param tile The tile index, 0 to 1023
+    @param bank The palette bank, 0 to 15: pixel n of the tile has colour
+    bank * 16 + n
+    @param hflip Mirror the tile left to right
+    @param vflip Mirror the tile top to bottom
+    @return  The map entry
+  */
+  /**********************************************************************/
+  static uint16_t entry(uint16_t tile, uint8_t bank = 0, bool hflip = false,
+                        bool vflip = false) {
+    return (tile & pimoroni::SCANLINE_TILE_INDEX_MASK) |
+           (hflip ? pimoroni::SCANLINE_TILE_HFLIP : 0) |
+           (vflip ? pimoroni::SCANLINE_TILE_VFLIP : 0) |
+           ((bank & 0xf) << pimoroni::SCANLINE_TILE_BANK_SHIFT);
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Place a tile in the map
+    @param col The map column
+    @param row The map row
+    @param tile The tile index, 0 to 1023
+    @param bank The palette bank, 0 to 15
+    @param hflip Mirror the tile left to right
+    @param vflip Mirror the tile top to bottom
+  */
+  /**********************************************************************/
+  void setTile(int col, int row, uint16_t tile, uint8_t bank = 0,
+               bool hflip = false, bool vflip = false) {
+    if (map && col >= 0 && row >= 0 && col < columns() && row < rows())
+      map[row * columns() + col] = entry(tile, bank, hflip, vflip);
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get a map entry
+    @param col The map column
+    @param row The map row
+    @return  The entry, see entry(), or 0 if outside the map
+  */
+  /**********************************************************************/
+  uint16_t getTile(int col, int row) const {
+    if (!map || col < 0 || row < 0 || col >= columns() || row >= rows())
+      return 0;
+    return map[row * columns() + col];
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Fill the whole map with one tile
+    @param tile The tile index, 0 to 1023
+    @param bank The palette bank, 0 to 15
+  */
+  /**********************************************************************/
+  void fillTiles(uint16_t tile, uint8_t bank = 0) {
+    if (map)
+      std::fill(map, map + columns() * rows(), entry(tile, bank));
+  }
+
+  void setColor(uint8_t idx, uint8_t red, uint8_t green, uint8_t blue) {
+    hstx.get_palette()[idx] = (red << 16) | (green << 8) | blue;
+  }
+  void setColor(uint8_t idx, uint32_t rgb) { hstx.get_palette()[idx] = rgb; }
+
+  /// Map columns, at least enough to cover the screen
+  int columns() const { return hstx.get_map_columns(); }
+  /// Map rows, at least enough to cover the screen
+  int rows() const { return hstx.get_map_rows(); }
+  /// Screen width in pixels
+  int width() const { return dvhstx_width(res); }
+  /// Screen height in pixels
+  int height() const { return dvhstx_height(res); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Get the map being drawn to
+    @return  columns() entries per row
+  */
+  /**********************************************************************/
+  uint16_t *getMap() const { return map; }
+
+  /**********************************************************************/
+  /*!
+    @brief    If double-buffered, wait for retrace and swap maps. Otherwise,
+    do nothing (returns immediately)
+    @param copy_map if true, copy the new screen to the new back map.
+    Otherwise, the content is undefined.
+  */
+  /**********************************************************************/
+  void swap(bool copy_map = false) {
+    if (!double_buffered) {
+      return;
+    }
+    hstx.flip_blocking();
+    map = hstx.get_back_buffer<uint16_t>();
+    if (copy_map) {
+      memcpy(map, hstx.get_front_buffer<uint16_t>(),
+             sizeof(uint16_t) * columns() * rows());
+    }
+  }
+
+  /**********************************************************************/
+  /*!
+    @brief    Scroll the screen round the map a pixel at a time, wrapping at
+    its edges, from the next frame
+    @param x map pixel shown at the left of the screen
+    @param y map pixel shown at the top of the screen
+  */
+  /**********************************************************************/
+  void setScroll(int x, int y) { hstx.set_scroll(x, y); }
+
+  /**********************************************************************/
+  /*!
+    @brief    Change palette entries or the scroll position part way down the
+    screen, from the next frame. Make the effects with
+    pimoroni::DVHSTX::palette_effect(), scroll_effect() and row_effect().
+    @param effects the changes, in any order
+    @param count the number of changes, up to
+    pimoroni::DVHSTX::MAX_RASTER_EFFECTS
+    @return  false if the list is too long or the display isn't running
+  */
+  /**********************************************************************/
+  bool setRasterEffects(const DVHSTXRasterEffect *effects, int count) {
+    return hstx.set_raster_effects(effects, count);
+  }
+
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
+  /*! @copydoc DVHSTX16::setRenderCore1 */
+  void setRenderCore1(bool enable, int lines_ahead = 4) {
+    hstx.set_render_core1(enable, lines_ahead);
+  }
+  /*! @copydoc DVHSTX16::getSubstitutedLines */
+  uint32_t getSubstitutedLines() const { return hstx.get_substituted_lines(); }
+
+private:
+  static constexpr pimoroni::DVHSTX::Mode MODE =
+      (TILE_SIZE == 8) ? pimoroni::DVHSTX::MODE_TILES8
+                       : pimoroni::DVHSTX::MODE_TILES16;
+
+  DVHSTXPinout pinout;
+  DVHSTXResolution res;
+  mutable pimoroni::DVHSTX hstx;
+  bool double_buffered;
+  int map_columns, map_rows;
+  uint16_t *map = nullptr;
+};
+
+/// Map of 8x8 pixel tiles
+typedef DVHSTXTileMap<8> DVHSTXTiles8;
+/// Map of 16x16 pixel tiles
+typedef DVHSTXTileMap<16> DVHSTXTiles16;
+
+using TextColor = pimoroni::DVHSTX::TextColour;
+
+class DVHSTXText3 : public GFXcanvas16 {
+public:
+  struct Cell {
+    uint16_t value;
+    Cell(uint8_t c, uint8_t attr = TextColor::TEXT_WHITE)
+        : value(c | (attr << 8)) {}
+  };
+  /**************************************************************************/
+  /*!
+     @brief    Instatiate a DVHSTX 8-bit canvas context for graphics
+     @param    res   Display resolution
+     @param    double_buffered Whether to allocate two buffers
+  */
+  /**************************************************************************/
+  DVHSTXText3(DVHSTXPinout pinout)
+      : GFXcanvas16(91, 30, false),
+        pinout(pinout), res{res}, attr{TextColor::TEXT_WHITE} {}
+  ~DVHSTXText3() { end(); }
+
+  /**************************************************************************/
+  /*!
+     @brief    Start the display
+     @param    profile How to set up the clocks: CLOCK_EXACT_PIXEL, the
+     default, keeps the CPU at 264MHz, CLOCK_MAX_CPU runs it at the HSTX
+     clock when that is faster and CLOCK_LOW_POWER at 132MHz
+     @param    tolerance_ppm How far the pixel clock may be from the
+     resolution's timing, in parts per million
+     @return   false if the resolution or its clock isn't supported
+  */
+  /**************************************************************************/
+  bool
+  begin(DVHSTXClockProfile profile = DVHSTXClockProfile::CLOCK_EXACT_PIXEL,
+        uint32_t tolerance_ppm = 0) {
+    hstx.set_clock_profile(profile, tolerance_ppm);
+    bool result =
+        hstx.init(91, 30, pimoroni::DVHSTX::MODE_TEXT_RGB111, false, pinout);
+    if (!result)
+      return false;
+    buffer = hstx.get_back_buffer<uint16_t>();
+    return true;
+  }
+  void end() { hstx.reset(); }
+
+  void clear();
+
+  void set_color(TextColor a) { attr = a; }
+
+  void hide_cursor() {
+    cursor_visible = false;
+    hstx.cursor_off();
+  }
+
+  void show_cursor() {
+    cursor_visible = true;
+    sync_cursor_with_hstx();
+  }
+
+  void set_cursor(int x, int y) {
+    if (x < 0)
+      x = 0;
+    if (x > _width)
+      x = _width;
+    if (y < 0)
+      y = 0;
+    if (y >= _height)
+      y = _height - 1;
+    cursor_x = x;
+    cursor_y = y;
+    sync_cursor_with_hstx();
+  }
+
+  size_t write(uint8_t c);
+
+  /*! @copydoc DVHSTX16::get_stats */
+  pimoroni::DVHSTXStats get_stats() const { return hstx.get_stats(); }
+  /*! @copydoc DVHSTX16::reset_stats */
+  void reset_stats() { hstx.reset_stats(); }
+  /*! @copydoc DVHSTX16::setRenderCore1 */
+  void setRenderCore1(bool enable, int lines_ahead = 4) {
+    hstx.set_render_core1(enable, lines_ahead);
+  }
+  /*! @copydoc DVHSTX16::getSubstitutedLines */
+  uint32_t getSubstitutedLines() const { return hstx.get_substituted_lines(); }
 
 private:
   DVHSTXPinout pinout;
@@ -1,11 +1,15 @@
 #include <string.h>
+#include <algorithm>
+
+#ifdef DVHSTX_HOST_BUILD
+#include "host/pico_host.hpp"
+#else
 #include <pico/stdlib.h>
 
 extern "C" {
 #include <pico/lock_core.h>
 }
 
-#include <algorithm>
 #include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
@@ -19,9 +23,15 @@ extern "C" {
 #include "hardware/structs/qmi.h"
 #include "hardware/pll.h"
 #include "hardware/clocks.h"
+#include "pico/multicore.h"
+#if DVHSTX_STATS && defined(__arm__)
+#include "hardware/structs/m33.h"
+#endif
+#endif
 
 #include "dvi.hpp"
 #include "dvhstx.hpp"
+#include "dvhstx_scanline.hpp"
 
 using namespace pimoroni;
 
@@ -31,11 +41,6 @@ __attribute__((section(".uninitialized_data"))) static uint8_t frame_buffer_a[FR
 __attribute__((section(".uninitialized_data"))) static uint8_t frame_buffer_b[FRAME_BUFFER_SIZE];
 #endif
 
-#include "font.h"
-
-// If changing the font, note this code will not handle glyphs wider than 13 pixels
-#define FONT (&intel_one_mono)
-
 #ifdef MICROPY_BUILD_TYPE
 extern "C" {
 void dvhstx_debug(const char *fmt, ...);
@@ -49,32 +54,9 @@ void dvhstx_debug(const char *fmt, ...);
 #define dvhstx_debug printf
 #endif
 
-static inline __attribute__((always_inline)) uint32_t render_char_line(int c, int y) {
-    if (c < 0x20 || c > 0x7e) return 0;
-    const lv_font_fmt_txt_glyph_dsc_t* g = &FONT->dsc->glyph_dsc[c - 0x20 + 1];
-    const uint8_t *b = FONT->dsc->glyph_bitmap + g->bitmap_index;
-    const int ey = y - FONT_HEIGHT + FONT->base_line + g->ofs_y + g->box_h;
-    if (ey < 0 || ey >= g->box_h || g->box_w == 0) {
-        return 0;
-    }
-    else {
-        int bi = (g->box_w * ey);
-
-        uint32_t bits = (b[bi >> 2] << 24) | (b[(bi >> 2) + 1] << 16) | (b[(bi >> 2) + 2] << 8) | b[(bi >> 2) + 3];
-        bits >>= 6 - ((bi & 3) << 1);
-        bits &= 0x3ffffff & (0x3ffffff << ((13 - g->box_w) << 1));
-        bits >>= g->ofs_x << 1;
-
-        return bits;
-    }
-}
-
 // ----------------------------------------------------------------------------
 // HSTX command lists
 
-// Lists are padded with NOPs to be >= HSTX FIFO size, to avoid DMA rapidly
-// pingponging and tripping up the IRQs.
-
 static const uint32_t vblank_line_vsync_off_src[] = {
     HSTX_CMD_RAW_REPEAT,
     SYNC_V1_H1,
@@ -95,6 +77,7 @@ static const uint32_t vblank_line_vsync_on_src[] = {
 };
 static uint32_t vblank_line_vsync_on[count_of(vblank_line_vsync_on_src)];
 
+// The two NOPs make way for a left border, see init()
 static const uint32_t vactive_line_header_src[] = {
     HSTX_CMD_RAW_REPEAT,
     SYNC_V1_H1,
@@ -102,10 +85,20 @@ static const uint32_t vactive_line_header_src[] = {
     SYNC_V1_H0,
     HSTX_CMD_RAW_REPEAT,
     SYNC_V1_H1,
-    HSTX_CMD_TMDS      
+    HSTX_CMD_NOP,
+    HSTX_CMD_NOP,
+    HSTX_CMD_TMDS
 };
 static uint32_t vactive_line_header[count_of(vactive_line_header_src)];
 
+// Sent after the pixels of each line when there is a right border, from
+// the end of the line buffer or, in direct scanout, from here.  The second
+// word is the border colour, see update_border().
+static uint32_t vactive_line_trailer[2];
+
+// A whole line of border, for the lines above and below the picture
+static uint32_t vactive_border_line[8];
+
 static const uint32_t vactive_text_line_header_src[] = {
     HSTX_CMD_RAW_REPEAT,
     SYNC_V1_H1,
@@ -124,323 +117,1007 @@ static const uint32_t vactive_text_line_header_src[] = {
 };
 static uint32_t vactive_text_line_header[count_of(vactive_text_line_header_src)];
 
-#define NUM_FRAME_LINES 2
-#define NUM_CHANS 3
+// The display is driven by two DMA channels.  The data channel writes to
+// the HSTX FIFO and chains to the control channel, which loads the next
+// block of the scanout list into the data channel's AL1 registers,
+// triggering it.
+#define NUM_CHANS 2
+#define SCANOUT_DATA_CHAN 0
+#define SCANOUT_CTRL_CHAN 1
+
+// Register sized, so the list can be written straight to AL1
+struct DVHSTX::ScanoutBlock {
+    uintptr_t ctrl;
+    uintptr_t read_addr;
+    uintptr_t write_addr;
+    uintptr_t transfer_count;
+};
 
 static DVHSTX* display = nullptr;
 
+// ----------------------------------------------------------------------------
+// Statistics
+
+#if DVHSTX_STATS
+static __force_inline uint32_t stats_cycle_count() {
+#if defined(DVHSTX_HOST_BUILD)
+    return dvhstx_host_cycle_count();
+#elif defined(__arm__)
+    return m33_hw->dwt_cyccnt;
+#else
+    uint32_t cycles;
+    asm volatile ("csrr %0, mcycle" : "=r" (cycles));
+    return cycles;
+#endif
+}
+
+static void stats_start_cycle_counter() {
+#if defined(DVHSTX_HOST_BUILD)
+#elif defined(__arm__)
+    m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+    m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+#else
+    asm volatile ("csrci mcountinhibit, 0x1");
+#endif
+}
+#else
+static inline uint32_t stats_cycle_count() { return 0; }
+#endif
+
+#if DVHSTX_STATS
+// Out of line, so that counting doesn't swell the IRQ handlers in SCRATCH_X
+void __not_in_flash_func(DVHSTX::record_irq)(DVHSTXStats::LineClass line_class, uint32_t start_cycles) {
+    const uint32_t cycles = stats_cycle_count() - start_cycles;
+    DVHSTXStats::IrqCost& cost = stats.irq[line_class];
+    ++cost.count;
+    cost.total_cycles += cycles;
+    if (cycles < cost.min_cycles) cost.min_cycles = cycles;
+    if (cycles > cost.max_cycles) cost.max_cycles = cycles;
+    const int bucket = (cycles >> 6) ? 32 - __builtin_clz(cycles >> 6) : 0;
+    ++cost.histogram[std::min(bucket, DVHSTXStats::HISTOGRAM_BUCKETS - 1)];
+}
+#else
+__force_inline void DVHSTX::record_irq(DVHSTXStats::LineClass, uint32_t) {}
+#endif
+
+DVHSTXStats DVHSTX::get_stats() const {
+#if DVHSTX_STATS
+    return stats;
+#else
+    return DVHSTXStats{};
+#endif
+}
+
+void DVHSTX::reset_stats() {
+#if DVHSTX_STATS
+    memset(&stats, 0, sizeof(stats));
+    for (auto& cost : stats.irq) cost.min_cycles = UINT32_MAX;
+#endif
+}
+
 // ----------------------------------------------------------------------------
 // DMA logic
 
-void __scratch_x("display") dma_irq_handler() {
-    display->gfx_dma_handler();
-}
-
-void __scratch_x("display") DVHSTX::gfx_dma_handler() {
-    // ch_num indicates the channel that just finished, which is the one
-    // we're about to reload.
-    dma_channel_hw_t *ch = &dma_hw->ch[ch_num];
-    dma_hw->intr = 1u << ch_num;
-    if (++ch_num == NUM_CHANS) ch_num = 0;
-
-    if (v_scanline >= timing_mode->v_front_porch && v_scanline < (timing_mode->v_front_porch + timing_mode->v_sync_width)) {
-        ch->read_addr = (uintptr_t)vblank_line_vsync_on;
-        ch->transfer_count = count_of(vblank_line_vsync_on);
-    } else if (v_scanline < v_inactive_total) {
-        ch->read_addr = (uintptr_t)vblank_line_vsync_off;
-        ch->transfer_count = count_of(vblank_line_vsync_off);
-    } else {
-        const int y = (v_scanline - v_inactive_total) >> v_repeat_shift;
-        const int new_line_num = (v_repeat_shift == 0) ? ch_num : (y & (NUM_FRAME_LINES - 1));
-        const uint line_buf_total_len = ((timing_mode->h_active_pixels * line_bytes_per_pixel) >> 2) + count_of(vactive_line_header);
-
-        ch->read_addr = (uintptr_t)&line_buffers[new_line_num * line_buf_total_len];
-        ch->transfer_count = line_buf_total_len;
-
-        // Fill line buffer
-        if (line_num != new_line_num)
-        {
-            line_num = new_line_num;
-            uint32_t* dst_ptr = &line_buffers[line_num * line_buf_total_len + count_of(vactive_line_header)];
-
-            if (line_bytes_per_pixel == 2) {
-                uint16_t* src_ptr = (uint16_t*)&frame_buffer_display[y * 2 * (timing_mode->h_active_pixels >> h_repeat_shift)];
-                if (h_repeat_shift == 2) {
-                    for (int i = 0; i < timing_mode->h_active_pixels >> 1; i += 2) {
-                        uint32_t val = (uint32_t)(*src_ptr++) * 0x10001;
-                        *dst_ptr++ = val;
-                        *dst_ptr++ = val;
-                    }
-                }
-                else {
-                    for (int i = 0; i < timing_mode->h_active_pixels >> 1; ++i) {
-                        uint32_t val = (uint32_t)(*src_ptr++) * 0x10001;
-                        *dst_ptr++ = val;
-                    }
-                }
-            }
-            else if (line_bytes_per_pixel == 1) {
-                uint8_t* src_ptr = &frame_buffer_display[y * (timing_mode->h_active_pixels >> h_repeat_shift)];
-                if (h_repeat_shift == 2) {
-                    for (int i = 0; i < timing_mode->h_active_pixels >> 2; ++i) {
-                        uint32_t val = (uint32_t)(*src_ptr++) * 0x01010101;
-                        *dst_ptr++ = val;
-                    }                
-                }
-                else {
-                    for (int i = 0; i < timing_mode->h_active_pixels >> 2; ++i) {
-                        uint32_t val = ((uint32_t)(*src_ptr++) * 0x0101);
-                        val |= ((uint32_t)(*src_ptr++) * 0x01010000);
-                        *dst_ptr++ = val;
-                    }
-                }
-            }
-            else if (line_bytes_per_pixel == 4) {
-                uint8_t* src_ptr = &frame_buffer_display[y * (timing_mode->h_active_pixels >> h_repeat_shift)];
-                if (h_repeat_shift == 2) {
-                    for (int i = 0; i < timing_mode->h_active_pixels; i += 4) {
-                        uint32_t val = display_palette[*src_ptr++];
-                        *dst_ptr++ = val;
-                        *dst_ptr++ = val;
-                        *dst_ptr++ = val;
-                        *dst_ptr++ = val;
-                    }
-                }
-                else {
-                    for (int i = 0; i < timing_mode->h_active_pixels; i += 2) {
-                        uint32_t val = display_palette[*src_ptr++];
-                        *dst_ptr++ = val;
-                        *dst_ptr++ = val;
-                    }
-                }
+// Index of the block the control channel is loading or will load next.
+// The data channel has loaded every block before it.
+__force_inline uint DVHSTX::scanout_next_block() const {
+    return (dma_hw->ch[SCANOUT_CTRL_CHAN].read_addr - scanout_list_base) / sizeof(ScanoutBlock);
+}
+
+// Index of a block the data channel has finished, along with every block
+// before it.  next must be read before the data channel's busy flag: if it
+// is busy it may still be sending block next - 1.
+__force_inline uint DVHSTX::scanout_finished_block(uint next) const {
+    int finished = (int)next - (dma_channel_is_busy(SCANOUT_DATA_CHAN) ? 2 : 1);
+    if (finished < 0) finished += scanout_list_len;
+    return finished;
+}
+
+// Blocks from block from forward to block to, round the end of the list
+__force_inline uint DVHSTX::blocks_ahead(uint from, uint to) const {
+    return (to >= from) ? to - from : to + scanout_list_len - from;
+}
+
+// In the line buffer modes the scanout list only raises an IRQ once the
+// data channel has sent the last repeat of a source line.  That line
+// buffer is then free to be filled with the line line_buffer_count lines
+// further on.  Returns the line to fill.
+__force_inline int DVHSTX::advance_line() {
+#if DVHSTX_STATS
+    // The control channel loads the block after the one that raised the
+    // IRQ straight away.  If it has got any further then the data channel
+    // finished another line before this IRQ ran.
+    if (blocks_ahead(line_first_block(line_num + 1) - 1, scanout_next_block()) > (1u << line_block_shift) + 1) ++stats.late_reloads;
+#endif
+
+    int y = line_num + line_buffer_count;
+    if (y >= source_lines) {
+        y -= source_lines;
+        if (y == 0) {
+            // The rest of this frame is already in line buffers, so the
+            // next frame can come from the other buffer.
+            if (flip_next) {
+                flip_next = false;
+                flip_now();
             }
+            begin_line_frame();
+            __sev();
         }
     }
 
-    if (++v_scanline == v_total_active_lines) {
+    if (++line_num == source_lines) {
+        line_num = 0;
         v_scanline = 0;
-        line_num = -1;
-        if (flip_next) {
-            flip_next = false;
-            display->flip_now();
-        }
+        ++frame_counter;
+#if DVHSTX_STATS
+        ++stats.frames;
+#endif
+        __sev();
+    }
+    else {
+        v_scanline = v_inactive_total + border_top + source_first_line[line_num];
+    }
+
+    return y;
+}
+
+// The first block of source line y, counting the vertical blanking block
+__force_inline uint DVHSTX::line_first_block(int y) const {
+    return 1 + (source_first_line[y] << line_block_shift);
+}
+
+// Buffer n of the ring
+__force_inline uint32_t* DVHSTX::line_buffer(int n) {
+    return &line_buffers[(n % line_buffer_count) * line_buffer_words];
+}
+
+// Point the scanout blocks of every repeat of source line y at buf.  The
+// buffers are filled in turn round the ring, which needn't divide the
+// number of source lines, so a line's buffer changes from frame to frame.
+// Only called before the control channel has loaded the line's first block.
+__force_inline void DVHSTX::bind_line_buffer(int y, const uint32_t* buf) {
+    ScanoutBlock* block = &scanout_list[line_first_block(y) + line_block_shift];
+    for (int i = source_first_line[y]; i < source_first_line[y + 1]; ++i) {
+        block->read_addr = (uintptr_t)buf;
+        block += 1 << line_block_shift;
+    }
+}
+
+// Take the scroll position for the frame about to be sent, undoing any
+// raster effects, returns whether it has changed.
+__force_inline bool DVHSTX::latch_scroll() {
+    const uint32_t pos = scroll_pos;
+    frame_scroll_x = pos & 0xffff;
+    frame_scroll_y = pos >> 16;
+    if (pos == frame_scroll_pos) return false;
+    frame_scroll_pos = pos;
+    return true;
+}
+
+// The virtual frame buffer row shown on source line y
+__force_inline int DVHSTX::scrolled_row(int y) const {
+    int row = y + frame_scroll_y;
+    if (row >= virtual_height) row -= virtual_height;
+    return row;
+}
+
+// The band source line y is in.  There are only a few, and lines can be
+// skipped when rendering falls behind, so this is worked out afresh each
+// line.
+__force_inline const DVHSTX::BandLayout* DVHSTX::band_at(int y) const {
+    const BandLayout* band = bands;
+    while (y >= band->end_line && band < &bands[band_count - 1]) ++band;
+    return band;
+}
+
+// A line is read from the scroll position to the right hand edge of the
+// virtual frame buffer, and then if that isn't enough from its left hand
+// edge.  Calls span(dst_x, src_x, pixels) for each part.
+template<class S>
+__force_inline void DVHSTX::scroll_spans(S span) const {
+    const int first = std::min<int>(virtual_width - frame_scroll_x, frame_width);
+    span(0, frame_scroll_x, first);
+    if (first < frame_width) span(first, 0, frame_width - first);
+}
+
+// Switch to a newly set list of raster effects at the start of a frame,
+// returns whether there was one.  Palette effects work on a copy of the
+// palette, which also needs converting again for the 16-bit line formats.
+bool __not_in_flash_func(DVHSTX::raster_begin_frame)() {
+    const bool committed = raster_commit_pending;
+    if (committed) {
+        raster_active ^= 1;
+        raster_commit_pending = false;
         __sev();
     }
+    raster_next = 0;
+
+    if (raster_has_palette[raster_active]) {
+        memcpy(raster_palette, palette, sizeof(raster_palette));
+        display_palette = raster_palette;
+        palette_commit_pending = true;
+    }
+    else {
+        // Undo the last list's palette effects in the RGB565 palette
+        if (committed && raster_has_palette[raster_active ^ 1]) palette_commit_pending = true;
+        display_palette = palette;
+    }
+    return committed;
 }
 
-void __scratch_x("display") dma_irq_handler_text() {
-    display->text_dma_handler();
+// Apply the raster effects that start on or before source line y, returns
+// whether the palette changed.
+__force_inline bool DVHSTX::apply_raster_effects(int y) {
+    const int count = raster_counts[raster_active];
+    const RasterEffect* list = raster_lists[raster_active];
+    bool palette_changed = false;
+    for (; raster_next < count && list[raster_next].line <= y; ++raster_next) {
+        const RasterEffect& effect = list[raster_next];
+        switch (effect.action) {
+        case RASTER_PALETTE:
+            raster_palette[effect.index] = effect.value;
+            palette_rgb565[effect.index] = scanline_rgb888_to_rgb565(effect.value);
+            palette_changed = true;
+            break;
+        case RASTER_SCROLL:
+            frame_scroll_x = effect.value & 0xffff;
+            frame_scroll_y = effect.value >> 16;
+            break;
+        case RASTER_ROW:
+            // Stored as the vertical scroll that puts the row on this line
+            frame_scroll_y = effect.value;
+            break;
+        }
+    }
+    return palette_changed;
 }
 
-void __scratch_x("display") DVHSTX::text_dma_handler() {
-    // ch_num indicates the channel that just finished, which is the one
-    // we're about to reload.
-    dma_channel_hw_t *ch = &dma_hw->ch[ch_num];
-    dma_hw->intr = 1u << ch_num;
-    if (++ch_num == NUM_CHANS) ch_num = 0;
+// A committed palette is converted for the 16-bit line formats at the start
+// of a frame, as the packed LUT is.
+void __not_in_flash_func(DVHSTX::update_palette_rgb565)() {
+    if (palette_commit_pending) {
+        palette_commit_pending = false;
+        scanline_build_palette_rgb565(palette_rgb565, display_palette);
+    }
+}
+
+// Take a copy of the sprites on screen for the frame about to be rendered,
+// sorted by y so each line only needs to look at the start of the list.
+void __not_in_flash_func(DVHSTX::sprites_begin_frame)() {
+    if (sprite_collisions_enabled) {
+        for (int i = 0; i < MAX_SPRITES; ++i) {
+            sprite_collisions[i] = sprite_hits[i];
+            sprite_hits[i] = 0;
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < MAX_SPRITES; ++i) {
+        const Sprite& s = sprites[i];
+        if (!s.visible || !s.image) continue;
+        if (s.y >= display_height || s.y + s.height <= 0 || s.x >= frame_width || s.x + s.width <= 0) continue;
+
+        // Insertion sort, equal y stay in sprite order
+        int j = count++;
+        for (; j > 0 && frame_sprites[j - 1].y > s.y; --j) frame_sprites[j] = frame_sprites[j - 1];
+        frame_sprites[j] = s;
+    }
+    frame_sprite_count = count;
+}
 
-    if (v_scanline >= timing_mode->v_front_porch && v_scanline < (timing_mode->v_front_porch + timing_mode->v_sync_width)) {
-        ch->read_addr = (uintptr_t)vblank_line_vsync_on;
-        ch->transfer_count = count_of(vblank_line_vsync_on);
-    } else if (v_scanline < v_inactive_total) {
-        ch->read_addr = (uintptr_t)vblank_line_vsync_off;
-        ch->transfer_count = count_of(vblank_line_vsync_off);
-    } else {
-        const int y = (v_scanline - v_inactive_total);
-        const uint line_buf_total_len = (frame_width * line_bytes_per_pixel + 3) / 4 + count_of(vactive_text_line_header);
+// Draw the sprites on line y over the pixels already in dst, looking up
+// each sprite pixel in colours.  GCC ignores section attributes on
+// templates, so this is inlined into the functions below to run from RAM.
+template<class P>
+__force_inline void DVHSTX::composite_sprites(P* dst, const P* colours, int y) {
+    struct LineSprite {
+        const Sprite* sprite;
+        const uint8_t* src;     // Indexed by screen x
+        int x0, x1;             // Visible columns
+    };
+    LineSprite line_sprites[MAX_SPRITES];
+
+    // The first sprites to start above this line win the per line slots
+    int count = 0;
+    for (int i = 0; i < frame_sprite_count; ++i) {
+        const Sprite* s = &frame_sprites[i];
+        if (s->y > y) break;
+        if (y >= s->y + s->height) continue;
+        if (count == sprite_line_limit) {
+            ++sprite_overflows;
+            continue;
+        }
+        line_sprites[count++] = { s, s->image + (y - s->y) * s->width - s->x,
+                                  std::max<int>(s->x, 0), std::min<int>(s->x + s->width, frame_width) };
+    }
 
-        ch->read_addr = (uintptr_t)&line_buffers[ch_num * line_buf_total_len];
-        ch->transfer_count = line_buf_total_len;
+    // Draw the highest numbered first, so lower numbers end up on top
+    for (int i = 1; i < count; ++i) {
+        const LineSprite ls = line_sprites[i];
+        int j = i;
+        for (; j > 0 && line_sprites[j - 1].sprite->id < ls.sprite->id; --j) line_sprites[j] = line_sprites[j - 1];
+        line_sprites[j] = ls;
+    }
+    for (int i = 0; i < count; ++i) {
+        const LineSprite& ls = line_sprites[i];
+        const uint8_t key = ls.sprite->key;
+        for (int x = ls.x0; x < ls.x1; ++x) {
+            const uint8_t c = ls.src[x];
+            if (c != key) dst[x] = colours[c];
+        }
+    }
 
-        // Fill line buffer
-        int char_y = y % 24;
-        if (line_bytes_per_pixel == 4) {
-            uint32_t* dst_ptr = &line_buffers[ch_num * line_buf_total_len + count_of(vactive_text_line_header)];
-            uint8_t* src_ptr = &frame_buffer_display[(y / 24) * frame_width];
-            for (int i = 0; i < frame_width; ++i) {
-                *dst_ptr++ = render_char_line(*src_ptr++, char_y);
+    if (!sprite_collisions_enabled) return;
+    for (int a = 0; a < count; ++a) {
+        const LineSprite& sa = line_sprites[a];
+        for (int b = a + 1; b < count; ++b) {
+            const LineSprite& sb = line_sprites[b];
+            if (sprite_hits[sa.sprite->id] & (1u << sb.sprite->id)) continue;
+            const int x1 = std::min(sa.x1, sb.x1);
+            for (int x = std::max(sa.x0, sb.x0); x < x1; ++x) {
+                if (sa.src[x] != sa.sprite->key && sb.src[x] != sb.sprite->key) {
+                    sprite_hits[sa.sprite->id] |= 1u << sb.sprite->id;
+                    sprite_hits[sb.sprite->id] |= 1u << sa.sprite->id;
+                    break;
+                }
             }
         }
+    }
+}
+
+void __not_in_flash_func(DVHSTX::composite_sprites_rgb565)(uint16_t* dst, int y) {
+    composite_sprites(dst, palette_rgb565, y);
+}
+
+void __not_in_flash_func(DVHSTX::composite_sprites_rgb888)(uint32_t* dst, int y) {
+    composite_sprites(dst, display_palette, y);
+}
+
+// Take a copy of the overlay for the frame about to be rendered, and
+// premultiply its colours.
+void __not_in_flash_func(DVHSTX::overlay_begin_frame)() {
+    frame_overlay = overlay;
+    if (!frame_overlay.pixels) frame_overlay.visible = false;
+    if (frame_overlay.visible) scanline_build_blend(overlay_blend, overlay_colours);
+}
+
+// Blend the overlay's part of line y over the pixels already in dst
+template<class P>
+__force_inline void DVHSTX::blend_overlay(P* dst, int y) {
+    const Overlay& o = frame_overlay;
+    const int row = y - o.y;
+    if (!o.visible || row < 0 || row >= o.height) return;
+    const int x0 = std::max<int>(o.x, 0);
+    const int x1 = std::min<int>(o.x + o.width, frame_width);
+    if (x0 >= x1) return;
+
+    const uint8_t* src = o.pixels + row * ((o.width + 1) >> 1);
+    if (sizeof(P) == 2) scanline_blend4_rgb565((uint16_t*)dst + x0, src, x0 - o.x, overlay_blend, x1 - x0);
+    else scanline_blend4((uint32_t*)dst + x0, src, x0 - o.x, overlay_blend, x1 - x0);
+}
+
+void __not_in_flash_func(DVHSTX::blend_overlay_rgb565)(uint16_t* dst, int y) {
+    blend_overlay(dst, y);
+}
+
+void __not_in_flash_func(DVHSTX::blend_overlay_rgb888)(uint32_t* dst, int y) {
+    blend_overlay(dst, y);
+}
+
+// Take everything the line buffer modes render a frame from.  Called as the
+// first line of a frame is due to be rendered, whether or not it is in time
+// to be, so a late line 0 can't leave the frame with the last one's state.
+void __not_in_flash_func(DVHSTX::begin_line_frame)() {
+    if (mode == MODE_TEXT_MONO || mode == MODE_TEXT_RGB111) return;
+
+    latch_scroll();
+    raster_begin_frame();
+    if (line_bytes_per_pixel == 2) update_palette_rgb565();
+    if (frame_bits_per_pixel && frame_bits_per_pixel < 8) scanline_build_packed_lut(packed_lut, display_palette, frame_bits_per_pixel);
+    if (sprite_layer) sprites_begin_frame();
+    if (overlay_layer) overlay_begin_frame();
+}
+
+// Render source line y into the line buffer buf.  Everything that depends
+// only on the mode is a template parameter, everything else was worked out
+// by init().  Each format has its own function below, as GCC ignores
+// section attributes on templates and these must run from RAM.  The
+// lambdas are force inlined for the same reason.
+template<DVHSTX::LineFormat F>
+__force_inline void DVHSTX::render_line_format(uint32_t* buf, int y) {
+    // Line buffers of RGB565 pixels, rather than RGB888 words after the
+    // line header
+    constexpr bool rgb565_line = (F == LINE_RGB565 || F == LINE_PALETTE_RGB565 || F == LINE_YCBCR420);
+    // Text is neither scrolled nor has sprites
+    constexpr bool is_text = (F == LINE_TEXT_MONO || F == LINE_TEXT_RGB111);
+    const bool palette_changed = !is_text && apply_raster_effects(y);
+
+    // Lines are rendered in order, so the packed LUT can be refreshed from
+    // the palette at the start of each frame, see begin_line_frame(), or
+    // when a raster effect changes it.
+    constexpr int bits_per_pixel = (F == LINE_PALETTE1) ? 1 : (F == LINE_PALETTE2) ? 2 : (F == LINE_PALETTE4) ? 4 : 0;
+    if (bits_per_pixel && palette_changed) scanline_build_packed_lut(packed_lut, display_palette, bits_per_pixel);
+
+    const BandLayout* band = is_text ? nullptr : band_at(y);
+    const int row = is_text ? y : scrolled_row(y - band->frame_offset);
+    const uint8_t* src_row = &frame_buffer_display[row * line_src_stride];
+
+    if (band && band->text) {
+        const int band_line = y - band->first_line;
+        const uint8_t* cells = band->text + (band_line / SCANLINE_TEXT_CHAR_HEIGHT) * text_columns * 2;
+        const int text_pixels = text_columns * SCANLINE_TEXT_CHAR_WIDTH;
+        if (rgb565_line) {
+            uint16_t* dst_ptr = (uint16_t*)buf;
+            scanline_text_palette_rgb565(dst_ptr, cells, font_cache, palette_rgb565, text_columns, band_line % SCANLINE_TEXT_CHAR_HEIGHT);
+            for (int x = text_pixels; x < frame_width; ++x) dst_ptr[x] = palette_rgb565[0];
+        }
         else {
-            uint8_t* dst_ptr = (uint8_t*)&line_buffers[ch_num * line_buf_total_len + count_of(vactive_text_line_header)];
-            uint8_t* src_ptr = &frame_buffer_display[(y / 24) * frame_width * 2];
-#ifdef __riscv
-            for (int i = 0; i < frame_width; ++i) {
-                const uint8_t c = (*src_ptr++ - 0x20);
-                uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
-                const uint8_t colour = *src_ptr++;
-
-                *dst_ptr++ = colour * ((bits >> 24) & 3);
-                *dst_ptr++ = colour * ((bits >> 22) & 3);
-                *dst_ptr++ = colour * ((bits >> 20) & 3);
-                *dst_ptr++ = colour * ((bits >> 18) & 3);
-                *dst_ptr++ = colour * ((bits >> 16) & 3);
-                *dst_ptr++ = colour * ((bits >> 14) & 3);
-                *dst_ptr++ = colour * ((bits >> 12) & 3);
-                *dst_ptr++ = colour * ((bits >> 10) & 3);
-                *dst_ptr++ = colour * ((bits >> 8) & 3);
-                *dst_ptr++ = colour * ((bits >> 6) & 3);
-                *dst_ptr++ = colour * ((bits >> 4) & 3);
-                *dst_ptr++ = colour * ((bits >> 2) & 3);
-                *dst_ptr++ = colour * (bits & 3);
-                *dst_ptr++ = 0;
-            }
-#else
-            int i = 0;
-            for (; i < frame_width-1; i += 2) {
-                uint8_t c = (*src_ptr++ - 0x20);
-                uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
-                uint8_t colour = *src_ptr++;
-                c = (*src_ptr++ - 0x20);
-                uint32_t bits2 = (c < 95) ? font_cache[c * 24 + char_y] : 0;
-                uint8_t colour2 = *src_ptr++;
-
-                // This ASM works around a compiler bug where the optimizer decides
-                // to unroll so hard it spills to the stack.
-                uint32_t tmp, tmp2;
-                asm volatile (
-                    "ubfx %[tmp], %[cbits], #24, #2\n\t"
-                    "ubfx %[tmp2], %[cbits], #22, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "ubfx %[tmp2], %[cbits], #20, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #16, #8\n\t"
-                    "ubfx %[tmp2], %[cbits], #18, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #24, #8\n\t"
-                    "muls %[tmp], %[colour], %[tmp]\n\t"
-                    "str %[tmp], [%[dst_ptr]]\n\t"
-
-                    "ubfx %[tmp], %[cbits], #16, #2\n\t"
-                    "ubfx %[tmp2], %[cbits], #14, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "ubfx %[tmp2], %[cbits], #12, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #16, #8\n\t"
-                    "ubfx %[tmp2], %[cbits], #10, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #24, #8\n\t"
-                    "muls %[tmp], %[colour], %[tmp]\n\t"
-                    "str %[tmp], [%[dst_ptr], #4]\n\t"
-
-                    "ubfx %[tmp], %[cbits], #8, #2\n\t"
-                    "ubfx %[tmp2], %[cbits], #6, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "ubfx %[tmp2], %[cbits], #4, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #16, #8\n\t"
-                    "ubfx %[tmp2], %[cbits], #2, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #24, #8\n\t"
-                    "muls %[tmp], %[colour], %[tmp]\n\t"
-                    "str %[tmp], [%[dst_ptr], #8]\n\t"
-
-                    "ubfx %[tmp], %[cbits2], #24, #2\n\t"
-                    "ubfx %[tmp2], %[cbits2], #22, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "muls %[tmp], %[colour2], %[tmp]\n\t"
-                    "and %[tmp2], %[cbits], #3\n\t"
-                    "muls %[tmp2], %[colour], %[tmp2]\n\t"
-                    "bfi %[tmp2], %[tmp], #16, #16\n\t"
-                    "str %[tmp2], [%[dst_ptr], #12]\n\t"
-
-                    "ubfx %[tmp], %[cbits2], #20, #2\n\t"
-                    "ubfx %[tmp2], %[cbits2], #18, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "ubfx %[tmp2], %[cbits2], #16, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #16, #8\n\t"
-                    "ubfx %[tmp2], %[cbits2], #14, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #24, #8\n\t"
-                    "muls %[tmp], %[colour2], %[tmp]\n\t"
-                    "str %[tmp], [%[dst_ptr], #16]\n\t"
-
-                    "ubfx %[tmp], %[cbits2], #12, #2\n\t"
-                    "ubfx %[tmp2], %[cbits2], #10, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "ubfx %[tmp2], %[cbits2], #8, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #16, #8\n\t"
-                    "ubfx %[tmp2], %[cbits2], #6, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #24, #8\n\t"
-                    "muls %[tmp], %[colour2], %[tmp]\n\t"
-                    "str %[tmp], [%[dst_ptr], #20]\n\t"
-
-                    "ubfx %[tmp], %[cbits2], #4, #2\n\t"
-                    "ubfx %[tmp2], %[cbits2], #2, #2\n\t"
-                    "bfi %[tmp], %[tmp2], #8, #8\n\t"
-                    "bfi %[tmp], %[cbits2], #16, #2\n\t"
-                    "muls %[tmp], %[colour2], %[tmp]\n\t"
-                    "str %[tmp], [%[dst_ptr], #24]\n\t"
-                    : [tmp] "=&l" (tmp),
-                      [tmp2] "=&l" (tmp2)
-                    : [cbits] "r" (bits),
-                      [colour] "l" (colour),
-                      [cbits2] "r" (bits2),
-                      [colour2] "l" (colour2),
-                      [dst_ptr] "r" (dst_ptr)
-                    : "cc", "memory" );
-                dst_ptr += 14 * 2;                
-            }
-            if (i != frame_width) {
-                const uint8_t c = (*src_ptr++ - 0x20);
-                uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
-                const uint8_t colour = *src_ptr++;
-
-                *dst_ptr++ = colour * ((bits >> 24) & 3);
-                *dst_ptr++ = colour * ((bits >> 22) & 3);
-                *dst_ptr++ = colour * ((bits >> 20) & 3);
-                *dst_ptr++ = colour * ((bits >> 18) & 3);
-                *dst_ptr++ = colour * ((bits >> 16) & 3);
-                *dst_ptr++ = colour * ((bits >> 14) & 3);
-                *dst_ptr++ = colour * ((bits >> 12) & 3);
-                *dst_ptr++ = colour * ((bits >> 10) & 3);
-                *dst_ptr++ = colour * ((bits >> 8) & 3);
-                *dst_ptr++ = colour * ((bits >> 6) & 3);
-                *dst_ptr++ = colour * ((bits >> 4) & 3);
-                *dst_ptr++ = colour * ((bits >> 2) & 3);
-                *dst_ptr++ = colour * (bits & 3);
-                *dst_ptr++ = 0;
-            }
-#endif
-            if (y / 24 == cursor_y) {
-                uint8_t* dst_ptr = (uint8_t*)&line_buffers[ch_num * line_buf_total_len + count_of(vactive_text_line_header)] + 14 * cursor_x;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-                *dst_ptr++ ^= 0xff;
-            }
+            uint32_t* dst_ptr = buf + count_of(vactive_line_header);
+            scanline_text_palette(dst_ptr, cells, font_cache, display_palette, text_columns, band_line % SCANLINE_TEXT_CHAR_HEIGHT);
+            for (int x = text_pixels; x < frame_width; ++x) dst_ptr[x] = display_palette[0];
+        }
+    }
+    else switch (F) {
+    case LINE_RGB565:
+        scroll_spans([&](int dst_x, int src_x, int pixels) __attribute__((always_inline)) {
+            scanline_rgb565(buf + (dst_x >> 1), (const uint16_t*)src_row + src_x, pixels);
+        });
+        break;
+
+    case LINE_PALETTE:
+        scroll_spans([&](int dst_x, int src_x, int pixels) __attribute__((always_inline)) {
+            scanline_palette(buf + count_of(vactive_line_header) + dst_x, src_row + src_x, display_palette, pixels);
+        });
+        break;
+
+    case LINE_PALETTE_RGB565:
+        scroll_spans([&](int dst_x, int src_x, int pixels) __attribute__((always_inline)) {
+            scanline_palette_rgb565(buf + (dst_x >> 1), src_row + src_x, palette_rgb565, pixels);
+        });
+        break;
+
+    case LINE_YCBCR420: {
+        const uint8_t* chroma = &frame_buffer_display[(row >> 1) * chroma_stride];
+        scroll_spans([&](int dst_x, int src_x, int pixels) __attribute__((always_inline)) {
+            scanline_ycbcr420(buf + (dst_x >> 1), src_row + src_x, chroma + cb_offset + (src_x >> 1),
+                              chroma + cr_offset + (src_x >> 1), ycbcr_tables, pixels);
+        });
+        break;
+    }
+
+    case LINE_TILES8:
+    case LINE_TILES16: {
+        constexpr int tile_shift = (F == LINE_TILES8) ? 3 : 4;
+        constexpr int tile_pixels = 1 << tile_shift;
+        uint32_t* dst_ptr = buf + count_of(vactive_line_header);
+        const uint8_t* tiles = tile_data;
+        const uint16_t* map = (const uint16_t*)&frame_buffer_display[(row >> tile_shift) * line_src_stride];
+        const int tile_y = row & (tile_pixels - 1);
+        auto draw_tiles = [&](uint32_t* dst, const uint16_t* entries, int pixels) __attribute__((always_inline)) {
+            if (F == LINE_TILES8) scanline_tiles8(dst, entries, tiles, display_palette, tile_y, pixels);
+            else scanline_tiles16(dst, entries, tiles, display_palette, tile_y, pixels);
+        };
+        if (!tiles) {
+            for (int i = 0; i < frame_width; ++i) dst_ptr[i] = display_palette[0];
+            break;
+        }
+
+        // Tile maps scroll a pixel at a time, so a partly hidden first tile
+        // is drawn aside and its visible pixels copied in.
+        const int map_columns = virtual_width >> tile_shift;
+        int column = frame_scroll_x >> tile_shift;
+        int pixels = frame_width;
+        const int skip = frame_scroll_x & (tile_pixels - 1);
+        if (skip) {
+            uint32_t first_tile[tile_pixels];
+            draw_tiles(first_tile, map + column, tile_pixels);
+            const int visible = std::min(tile_pixels - skip, pixels);
+            memcpy(dst_ptr, first_tile + skip, visible * sizeof(uint32_t));
+            dst_ptr += visible;
+            pixels -= visible;
+            if (++column == map_columns) column = 0;
+        }
+        const int first = std::min((map_columns - column) << tile_shift, pixels);
+        if (first > 0) draw_tiles(dst_ptr, map + column, first);
+        if (first < pixels) draw_tiles(dst_ptr + first, map, pixels - first);
+        break;
+    }
+
+    case LINE_PALETTE1:
+    case LINE_PALETTE2:
+    case LINE_PALETTE4: {
+        // Spans start on a byte boundary, see scroll_x_step
+        scroll_spans([&](int dst_x, int src_x, int pixels) __attribute__((always_inline)) {
+            uint32_t* dst_ptr = buf + count_of(vactive_line_header) + dst_x;
+            const uint8_t* src_ptr = src_row + src_x * bits_per_pixel / 8;
+            if (F == LINE_PALETTE1) scanline_palette1(dst_ptr, src_ptr, packed_lut, pixels);
+            else if (F == LINE_PALETTE2) scanline_palette2(dst_ptr, src_ptr, packed_lut, pixels);
+            else scanline_palette4(dst_ptr, src_ptr, packed_lut, pixels);
+        });
+        break;
+    }
+
+    case LINE_TEXT_MONO:
+        scanline_text_mono(buf + count_of(vactive_text_line_header),
+                           &frame_buffer_display[(y / SCANLINE_TEXT_CHAR_HEIGHT) * line_src_stride],
+                           frame_width, y % SCANLINE_TEXT_CHAR_HEIGHT);
+        break;
+
+    case LINE_TEXT_RGB111: {
+        const int row = y / SCANLINE_TEXT_CHAR_HEIGHT;
+        uint8_t* dst_ptr = (uint8_t*)(buf + count_of(vactive_text_line_header));
+        scanline_text_rgb111(dst_ptr, &frame_buffer_display[row * line_src_stride], font_cache,
+                             frame_width, y % SCANLINE_TEXT_CHAR_HEIGHT);
+        const uint32_t cursor = cursor_pos;
+        if (row == (int16_t)(cursor >> 16)) {
+            scanline_text_cursor(dst_ptr, (int16_t)(cursor & 0xffff));
         }
+        break;
     }
+    }
+
+    if (!is_text && frame_sprite_count) {
+        if (rgb565_line) composite_sprites_rgb565((uint16_t*)buf, y);
+        else composite_sprites_rgb888(buf + count_of(vactive_line_header), y);
+    }
+    if (!is_text && frame_overlay.visible) {
+        if (rgb565_line) blend_overlay_rgb565((uint16_t*)buf, y);
+        else blend_overlay_rgb888(buf + count_of(vactive_line_header), y);
+    }
+}
 
-    if (++v_scanline == v_total_active_lines) {
+void __not_in_flash_func(DVHSTX::render_line_rgb565)(uint32_t* buf, int y) {
+    render_line_format<LINE_RGB565>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_palette)(uint32_t* buf, int y) {
+    render_line_format<LINE_PALETTE>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_palette_rgb565)(uint32_t* buf, int y) {
+    render_line_format<LINE_PALETTE_RGB565>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_ycbcr420)(uint32_t* buf, int y) {
+    render_line_format<LINE_YCBCR420>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_tiles8)(uint32_t* buf, int y) {
+    render_line_format<LINE_TILES8>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_tiles16)(uint32_t* buf, int y) {
+    render_line_format<LINE_TILES16>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_palette1)(uint32_t* buf, int y) {
+    render_line_format<LINE_PALETTE1>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_palette2)(uint32_t* buf, int y) {
+    render_line_format<LINE_PALETTE2>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_palette4)(uint32_t* buf, int y) {
+    render_line_format<LINE_PALETTE4>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_text_mono)(uint32_t* buf, int y) {
+    render_line_format<LINE_TEXT_MONO>(buf, y);
+}
+
+void __not_in_flash_func(DVHSTX::render_line_text_rgb111)(uint32_t* buf, int y) {
+    render_line_format<LINE_TEXT_RGB111>(buf, y);
+}
+
+// The line buffer freed by the line that has just been sent is always the
+// next one in the ring, so the IRQ steps through the ring rather than
+// working out where line y lives.
+//
+// Normally the IRQ is for the end of line_num, but if it ran more than a
+// source line late the IRQs for the following lines were merged into it.
+// So it carries on for every line the data channel has finished, and does
+// nothing if an earlier IRQ has already caught up.  A line can only be
+// rendered in time if its first block will be loaded soon but hasn't been
+// yet.  Otherwise it is left showing the line already in its buffer rather
+// than half of each, so the display keeps sync.
+void __scratch_x("display") DVHSTX::line_dma_handler() {
+    const uint32_t start_cycles = stats_cycle_count();
+    dma_hw->intr = 1u << SCANOUT_DATA_CHAN;
+
+    // When caught up, line_num ends at most a source line ahead of the
+    // data channel, plus the wrap and vertical blanking blocks.
+    const uint caught_up = (v_repeat << line_block_shift) + 2;
+    const uint render_window = ((line_buffer_count * v_repeat) << line_block_shift) + 2;
+
+    for (;;) {
+        const uint next = scanout_next_block();
+        const uint ahead = blocks_ahead(scanout_finished_block(next), line_first_block(line_num + 1) - 1);
+        if (ahead != 0 && ahead <= caught_up) break;
+
+        uint32_t* buf = next_line_buffer;
+        next_line_buffer += line_buffer_words;
+        if (next_line_buffer == line_buffers_end) next_line_buffer = line_buffers;
+
+        const int y = advance_line();
+        const uint first = blocks_ahead(next, line_first_block(y));
+        if (first != 0 && first <= render_window) render_line(buf, y);
+        else ++substituted_lines;
+    }
+
+    record_irq(DVHSTXStats::LINE_ACTIVE_NEW, start_cycles);
+}
+
+// Only the IRQ entry points and the line handler are in SCRATCH_X, which
+// is 4KB shared with core 1's stack.  Everything they call is placed in RAM
+// with __not_in_flash_func(), as tests/host/check_placement.py checks.
+void __scratch_x("display") dma_irq_handler_line() {
+    display->line_dma_handler();
+}
+
+void __scratch_x("display") dma_irq_handler_scanout() {
+    display->scanout_dma_handler();
+}
+
+void __not_in_flash_func(DVHSTX::scanout_dma_handler)() {
+    const uint32_t start_cycles = stats_cycle_count();
+    dma_hw->intr = 1u << SCANOUT_DATA_CHAN;
+
+    // The scanout list only raises an IRQ at the end of vertical blanking
+    // and at the end of the last active line.
+    if (v_scanline < v_inactive_total) {
+        v_scanline = v_inactive_total + border_top;
+        record_irq(DVHSTXStats::LINE_VBLANK, start_cycles);
+    }
+    else {
         v_scanline = 0;
-        line_num = -1;
+        ++frame_counter;
+        const bool scrolled = latch_scroll();
+        const bool new_effects = raster_begin_frame();
         if (flip_next) {
             flip_next = false;
             display->flip_now();
         }
+        else if (scrolled || new_effects) {
+            update_scanout_rows();
+        }
+#if DVHSTX_STATS
+        ++stats.frames;
+#endif
         __sev();
+        record_irq(DVHSTXStats::LINE_FRAME_END, start_cycles);
     }
 }
 
+// ----------------------------------------------------------------------------
+// Core 1 rendering
+
+// Instead of waiting for IRQs, core 1 follows the control channel through
+// the scanout list and renders every line it can without overwriting a
+// line buffer the data channel may still read.  core1_rendered counts lines
+// rendered since init() and core1_frame counts frames displayed, so the two
+// can be compared across the end of a frame.  As in the IRQ, lines whose
+// first block has already been loaded are skipped and keep the line
+// already in their buffer.
+void __not_in_flash_func(DVHSTX::core1_render)() {
+    // The control channel is loading, or has loaded, block next - 1, so the
+    // data channel is at worst still sending block next - 2.
+    const uint next = scanout_next_block();
+    if (next < core1_last_block) {
+        // The list has wrapped: the last active line has been sent
+        ++core1_frame;
+        v_scanline = 0;
+        ++frame_counter;
+#if DVHSTX_STATS
+        ++stats.frames;
+#endif
+        __sev();
+    }
+    core1_last_block = next;
+
+    const int v_active_lines = picture_lines;
+    const int output_line = ((int)next - 2) >> line_block_shift;
+    int shown = 0;
+    if (output_line >= v_active_lines) shown = source_lines;
+    else if (output_line >= 0) {
+        shown = output_line * source_lines / v_active_lines;
+        v_scanline = v_inactive_total + border_top + output_line;
+    }
+    const uint32_t shown_count = core1_frame * source_lines + shown;
+
+    // The first line whose first block hasn't been loaded yet
+    int ready = 0;
+    if (next > 0) {
+        const int ready_output_line = std::min((int)(next - 1) >> line_block_shift, v_active_lines);
+        ready = std::min(ready_output_line * source_lines / v_active_lines + 1, source_lines);
+    }
+    const uint32_t ready_count = core1_frame * source_lines + ready;
+
+    if ((int32_t)(core1_rendered - ready_count) < 0) {
+        // Fell behind the display, carry on from the first line that can
+        // still be rendered in time
+#if DVHSTX_STATS
+        ++stats.late_reloads;
+#endif
+        substituted_lines += ready_count - core1_rendered;
+        core1_next_buffer = (core1_next_buffer + ready_count - core1_rendered) % line_buffer_count;
+
+        // Start the frame whose first line was skipped
+        const uint32_t frame_start = (core1_rendered + source_lines - 1) / source_lines * source_lines;
+        if ((int32_t)(frame_start - ready_count) < 0) core1_begin_frame();
+        core1_rendered = ready_count;
+    }
+
+    while ((int32_t)(core1_rendered - shown_count) < line_buffer_count) {
+        const uint32_t start_cycles = stats_cycle_count();
+        const int y = core1_rendered % source_lines;
+        if (y == 0) core1_begin_frame();
+        render_line(line_buffer(core1_next_buffer), y);
+        if (++core1_next_buffer == line_buffer_count) core1_next_buffer = 0;
+        ++core1_rendered;
+        record_irq(DVHSTXStats::LINE_ACTIVE_NEW, start_cycles);
+    }
+}
+
+void __not_in_flash_func(DVHSTX::core1_begin_frame)() {
+    if (flip_next) {
+        flip_now();
+        __dmb();
+        flip_next = false;
+    }
+    begin_line_frame();
+    __sev();
+}
+
+void DVHSTX::core1_main() {
+#if DVHSTX_STATS
+    stats_start_cycle_counter();
+#endif
+    while (core1_running) core1_render();
+}
+
+#ifdef DVHSTX_HOST_BUILD
+static void core1_poll() {
+    display->core1_render();
+}
+#else
+static void core1_entry() {
+    display->core1_main();
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Scanout list
+
+static uintptr_t scanout_ctrl(enum dma_channel_transfer_size size, bool incr_read, uint dreq, uint chain_to, bool irq_quiet) {
+    dma_channel_config c = dma_channel_get_default_config(SCANOUT_DATA_CHAN);
+    channel_config_set_transfer_data_size(&c, size);
+    channel_config_set_read_increment(&c, incr_read);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, dreq);
+    channel_config_set_chain_to(&c, chain_to);
+    channel_config_set_irq_quiet(&c, irq_quiet);
+    return channel_config_get_ctrl_value(&c);
+}
+
+bool DVHSTX::build_vblank_list() {
+    // The command words for every blanking line of the frame, so that
+    // vertical blanking can be sent as a single transfer.  The border
+    // lines below and above the picture go either side of it.
+    vblank_list_len = v_inactive_total * count_of(vblank_line_vsync_off) + (border_top + border_bottom) * count_of(vactive_border_line);
+    vblank_list = (uint32_t*)malloc(vblank_list_len * sizeof(uint32_t));
+    if (!vblank_list) return false;
+
+    uint32_t* dst = vblank_list;
+    for (uint i = 0; i < border_bottom; ++i) {
+        memcpy(dst, vactive_border_line, sizeof(vactive_border_line));
+        dst += count_of(vactive_border_line);
+    }
+    for (int i = 0; i < v_inactive_total; ++i) {
+        const bool vsync = i >= timing_mode->v_front_porch && i < (timing_mode->v_front_porch + timing_mode->v_sync_width);
+        memcpy(dst, vsync ? vblank_line_vsync_on : vblank_line_vsync_off, sizeof(vblank_line_vsync_off));
+        dst += count_of(vblank_line_vsync_off);
+    }
+    for (uint i = 0; i < border_top; ++i) {
+        memcpy(dst, vactive_border_line, sizeof(vactive_border_line));
+        dst += count_of(vactive_border_line);
+    }
+    return true;
+}
+
+void DVHSTX::set_border_colour(RGB888 colour) {
+    border_colour = colour;
+    if (inited) update_border();
+}
+
+void DVHSTX::update_border() {
+    // The colour as the expander takes pixels, repeated in every lane so
+    // that TMDS_REPEAT sends the same pixel whatever the shift.
+    uint32_t fill;
+    const uint r = (border_colour >> 16) & 0xff, g = (border_colour >> 8) & 0xff, b = border_colour & 0xff;
+    if (mode == MODE_RGB565 || mode == MODE_PALETTE_RGB565 || mode == MODE_YCBCR420) fill = scanline_rgb888_to_rgb565(border_colour) * 0x10001u;
+    else if (mode == MODE_RGB332) fill = ((r & 0xe0) | ((g >> 3) & 0x1c) | (b >> 6)) * 0x01010101u;
+    else if (mode == MODE_RGB222) fill = (((r >> 2) & 0x30) | ((g >> 4) & 0x0c) | (b >> 6)) * 0x01010101u;
+    else fill = border_colour;
+
+    if (border_left) vactive_line_header[7] = fill;
+    vactive_line_trailer[1] = fill;
+    vactive_border_line[7] = fill;
+
+    for (uint i = 0; i < border_bottom; ++i) {
+        vblank_list[i * count_of(vactive_border_line) + 7] = fill;
+    }
+    for (uint i = 1; i <= border_top; ++i) {
+        vblank_list[vblank_list_len - i * count_of(vactive_border_line) + 7] = fill;
+    }
+
+    // Copies of the header and trailer in the line buffers
+    for (int i = 0; line_buffers && i < line_buffer_count; ++i) {
+        uint32_t* buf = line_buffer(i);
+        if (!line_block_shift && border_left) buf[7] = fill;
+        if (border_right) {
+            uint8_t* trailer = (uint8_t*)buf + line_trailer_offset;
+            if (line_block_shift && h_repeat > 1) {
+                ((uint16_t*)trailer)[0] = vactive_line_trailer[0];
+                ((uint16_t*)trailer)[1] = fill;
+            }
+            else {
+                memcpy(trailer, vactive_line_trailer, sizeof(vactive_line_trailer));
+            }
+        }
+    }
+}
+
+bool DVHSTX::build_scanout_list() {
+    // Vertical blanking, the blocks for every active line, then a block
+    // that restarts the control channel at the top of the list.
+    const int active_lines = picture_lines;
+    scanout_row_blocks = border_right ? 4 : 3;
+    scanout_list_len = 2 + (direct_scanout ? scanout_row_blocks : (1 << line_block_shift)) * active_lines;
+    scanout_list = (ScanoutBlock*)malloc(scanout_list_len * sizeof(ScanoutBlock));
+    if (!scanout_list) return false;
+
+    const uintptr_t fifo = (uintptr_t)&hstx_fifo_hw->fifo;
+    ScanoutBlock* block = scanout_list;
+
+    // Direct scanout has an IRQ at the end of vertical blanking
+    *block++ = { scanout_ctrl(DMA_SIZE_32, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, !direct_scanout),
+                 (uintptr_t)vblank_list, fifo, vblank_list_len };
+
+    if (direct_scanout) {
+        // When repeating horizontally RGB565 rows are read 16 bits at a
+        // time, and RGB332/RGB222 rows 8 bits at a time.  Narrow DMA writes
+        // are replicated across the bus, so the FIFO gets each pixel in
+        // every lane of a word, which the expander repeats.  RGB888 pixels
+        // are already a whole word, as are four native 8 bit pixels.
+        enum dma_channel_transfer_size pixel_size = DMA_SIZE_32;
+        if (h_repeat > 1) {
+            if (mode == MODE_RGB565) pixel_size = DMA_SIZE_16;
+            else if (frame_bits_per_pixel == 8) pixel_size = DMA_SIZE_8;
+        }
+        const uintptr_t header_ctrl = scanout_ctrl(DMA_SIZE_32, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, true);
+        const uintptr_t pixel_ctrl = scanout_ctrl(pixel_size, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, true);
+        scanout_pixel_shift = pixel_size;
+
+        // Each row is read in two blocks, split where it wraps round the
+        // virtual frame buffer, see update_scanout_rows(), and followed by
+        // the right border if there is one.
+        scanout_rows = block + 1;
+        for (int i = 0; i < active_lines; ++i) {
+            *block++ = { header_ctrl, (uintptr_t)vactive_line_header, fifo, count_of(vactive_line_header) };
+            *block++ = { pixel_ctrl, 0, fifo, 0 };
+            *block++ = { pixel_ctrl, 0, fifo, 0 };
+            if (border_right) *block++ = { header_ctrl, (uintptr_t)vactive_line_trailer, fifo, count_of(vactive_line_trailer) };
+        }
+
+        // IRQ at the end of the last active line
+        block[-1].ctrl = scanout_ctrl(border_right ? DMA_SIZE_32 : pixel_size, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, false);
+    }
+    else if (line_block_shift) {
+        // Line buffers of RGB565 pixels, with the header in a block of its
+        // own so the pixels can be read 16 bits at a time when repeating
+        // horizontally, as for direct scanout.
+        // The right border trailer follows the pixels in the line buffer.
+        const enum dma_channel_transfer_size pixel_size = (h_repeat > 1) ? DMA_SIZE_16 : DMA_SIZE_32;
+        const uintptr_t header_ctrl = scanout_ctrl(DMA_SIZE_32, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, true);
+        const uintptr_t pixel_count = ((frame_width * 2) >> pixel_size) + (border_right ? count_of(vactive_line_trailer) : 0);
+        for (int i = 0, y = 0; i < active_lines; ++i) {
+            if (i == source_first_line[y + 1]) ++y;
+            const bool irq = !render_core1 && i + 1 == source_first_line[y + 1];
+            *block++ = { header_ctrl, (uintptr_t)vactive_line_header, fifo, count_of(vactive_line_header) };
+            *block++ = { scanout_ctrl(pixel_size, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, !irq),
+                         (uintptr_t)line_buffer(y), fifo, pixel_count };
+        }
+    }
+    else {
+        // Each output line is a whole line buffer, header and right border
+        // trailer included.  Only the last repeat of each source line raises an IRQ
+        // to refill it, and none do when core 1 is rendering.
+        for (int i = 0, y = 0; i < active_lines; ++i) {
+            if (i == source_first_line[y + 1]) ++y;
+            const bool irq = !render_core1 && i + 1 == source_first_line[y + 1];
+            *block++ = { scanout_ctrl(DMA_SIZE_32, true, DREQ_HSTX, SCANOUT_CTRL_CHAN, !irq),
+                         (uintptr_t)line_buffer(y), fifo, line_buffer_words };
+        }
+    }
+
+    // The data channel writes the list address to the control channel's
+    // READ_ADDR trigger, and doesn't chain as that already starts it.
+    scanout_list_base = (uintptr_t)scanout_list;
+    *block = { scanout_ctrl(DMA_SIZE_32, false, DREQ_FORCE, SCANOUT_DATA_CHAN, true),
+               (uintptr_t)&scanout_list_base, (uintptr_t)&dma_hw->ch[SCANOUT_CTRL_CHAN].al3_read_addr_trig, 1 };
+
+    if (direct_scanout) update_scanout_rows();
+    return true;
+}
+
+// Point the pixel blocks at the frame buffer rows on screen.  The first
+// block of each row runs from the scroll position towards the right hand
+// edge of the virtual frame buffer and the second carries on from its left
+// hand edge.  When the screen doesn't reach the edge the row is split a
+// step early instead, as a block can't be empty.  Raster effects are
+// worked into the rows as they are reached, and undone at the end.
+void __not_in_flash_func(DVHSTX::update_scanout_rows)() {
+    const uint start_x = frame_scroll_x;
+    const uint start_y = frame_scroll_y;
+    uint first_offset, second_offset, first_count, second_count;
+    // Inlined so that none of this runs from flash
+    auto split_row = [&]() __attribute__((always_inline)) {
+        uint first = std::min<uint>(virtual_width - frame_scroll_x, frame_width);
+        uint second_x = 0;
+        if (first == frame_width) {
+            first -= scroll_x_step;
+            second_x = frame_scroll_x + first;
+        }
+        first_offset = (frame_scroll_x * frame_bits_per_pixel) >> 3;
+        second_offset = (second_x * frame_bits_per_pixel) >> 3;
+        first_count = ((first * frame_bits_per_pixel) >> 3) >> scanout_pixel_shift;
+        second_count = (((frame_width - first) * frame_bits_per_pixel) >> 3) >> scanout_pixel_shift;
+    };
+
+    raster_next = 0;
+    uint split_x = frame_scroll_x;
+    split_row();
+    for (int i = 0, y = 0; i < picture_lines; ++i) {
+        if (i == source_first_line[y + 1]) ++y;
+        apply_raster_effects(y);
+        if (frame_scroll_x != split_x) {
+            split_x = frame_scroll_x;
+            split_row();
+        }
+        const uint8_t* row = &frame_buffer_display[scrolled_row(y) * frame_stride];
+        ScanoutBlock* blocks = &scanout_rows[scanout_row_blocks * i];
+        blocks[0].read_addr = (uintptr_t)(row + first_offset);
+        blocks[0].transfer_count = first_count;
+        blocks[1].read_addr = (uintptr_t)(row + second_offset);
+        blocks[1].transfer_count = second_count;
+    }
+
+    frame_scroll_x = start_x;
+    frame_scroll_y = start_y;
+}
+
 // ----------------------------------------------------------------------------
 // Experimental clock config
 
-#ifndef MICROPY_BUILD_TYPE
-static void __no_inline_not_in_flash_func(set_qmi_timing)() {
+// clk_sys and the peripherals run from the USB PLL, set up at startup
+static constexpr uint32_t usb_pll_freq = 528 * MHZ;
+static constexpr uint32_t default_sys_freq = usb_pll_freq / 2;
+
+#ifndef DVHSTX_HOST_BUILD
+// Flash clock divider and read delay for clk_sys: 2 up to the default
+// 264MHz, 3 above it.
+static void __no_inline_not_in_flash_func(set_qmi_timing)(uint32_t clkdiv_and_rxdelay = 0x202) {
     // Make sure flash is deselected - QMI doesn't appear to have a busy flag(!)
     while ((ioqspi_hw->io[1].status & IO_QSPI_GPIO_QSPI_SS_STATUS_OUTTOPAD_BITS) != IO_QSPI_GPIO_QSPI_SS_STATUS_OUTTOPAD_BITS)
         ;
 
-    qmi_hw->m[0].timing = 0x40000202;
+    qmi_hw->m[0].timing = 0x40000000 | clkdiv_and_rxdelay;
     //qmi_hw->m[0].timing = 0x40000101;
     // Force a read through XIP to ensure the timing is applied
     volatile uint32_t* ptr = (volatile uint32_t*)0x14000000;
     (void) *ptr;
 }
-#endif
 
 extern "C" void __no_inline_not_in_flash_func(display_setup_clock_preinit)() {
     uint32_t intr_stash = save_and_disable_interrupts();
@@ -472,13 +1149,12 @@ extern "C" void __no_inline_not_in_flash_func(display_setup_clock_preinit)() {
     // Set USB PLL to 528MHz
     pll_init(pll_usb, PLL_COMMON_REFDIV, 1584 * MHZ, 3, 1);
 
-    const uint32_t usb_pll_freq = 528 * MHZ;
-
-    // CLK SYS = PLL USB 528MHz / 2 = 264MHz
+    // CLK SYS = PLL USB 528MHz / 2 = 264MHz, init() may change this to
+    // suit its ClockProfile
     clock_configure(clk_sys,
                     CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
                     CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
-                    usb_pll_freq, usb_pll_freq / 2);
+                    usb_pll_freq, default_sys_freq);
 
     // CLK PERI = PLL USB 528MHz / 4 = 132MHz
     clock_configure(clk_peri,
@@ -521,22 +1197,62 @@ namespace {
     DV_preinit dv_preinit __attribute__ ((init_priority (101))) ;
 }
 #endif
+#endif
+
+// Switch clk_sys, raising the core voltage and slowing the flash first if
+// it is going above the default and putting them back if it is coming down
+// from there.
+static void set_sys_clock(uint32_t auxsrc, uint32_t src_freq, uint32_t freq) {
+#ifndef DVHSTX_HOST_BUILD
+    const bool was_fast = clock_get_hz(clk_sys) > default_sys_freq;
+    const bool fast = freq > default_sys_freq;
+    if (fast && !was_fast) {
+        vreg_set_voltage(VREG_VOLTAGE_1_20);
+        set_qmi_timing(0x303);
+    }
+#endif
+
+    clock_configure(clk_sys,
+                    CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    auxsrc, src_freq, freq);
+
+#ifndef DVHSTX_HOST_BUILD
+    if (was_fast && !fast) {
+        set_qmi_timing();
+        vreg_set_voltage(VREG_VOLTAGE_1_15);
+    }
+#endif
+}
 
 void DVHSTX::display_setup_clock() {
-    const uint32_t dvi_clock_khz = timing_mode->bit_clk_khz >> 1;
-    uint vco_freq, post_div1, post_div2;
-    if (!check_sys_clock_khz(dvi_clock_khz, &vco_freq, &post_div1, &post_div2))
-        panic("System clock of %u kHz cannot be exactly achieved", dvi_clock_khz);
-    const uint32_t freq = vco_freq / (post_div1 * post_div2);
+    const uint32_t freq = hstx_pll.freq_hz;
+
+    // clk_sys may still be running from the sys PLL for the last init(),
+    // so move it back to the USB PLL before changing the sys PLL
+    set_sys_clock(CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, usb_pll_freq, default_sys_freq);
 
     // Set the sys PLL to the requested freq
-    pll_init(pll_sys, PLL_COMMON_REFDIV, vco_freq, post_div1, post_div2);
+    pll_init(pll_sys, hstx_pll.refdiv, hstx_pll.vco_freq_hz, hstx_pll.post_div1, hstx_pll.post_div2);
 
     // CLK HSTX = Requested freq
     clock_configure(clk_hstx,
                     0,
                     CLOCKS_CLK_HSTX_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS,
                     freq, freq);
+
+    switch (clock_profile) {
+    case CLOCK_MAX_CPU:
+        // CLK SYS = Requested freq, if that is a step up
+        if (freq > default_sys_freq && freq <= MAX_CPU_CLOCK_KHZ * KHZ)
+            set_sys_clock(CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, freq, freq);
+        break;
+    case CLOCK_LOW_POWER:
+        // CLK SYS = PLL USB 528MHz / 4 = 132MHz
+        set_sys_clock(CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, usb_pll_freq, usb_pll_freq / 4);
+        break;
+    default:
+        break;
+    }
 }
 
 RGB888* DVHSTX::get_palette()
@@ -544,20 +1260,202 @@ RGB888* DVHSTX::get_palette()
     return palette;
 }
 
+// Wrap a coordinate into the virtual frame buffer
+static inline uint32_t wrap_coordinate(int v, int size) {
+    v %= size;
+    return (v < 0) ? v + size : v;
+}
+
+void DVHSTX::set_scroll(int x, int y) {
+    if (!virtual_width || !virtual_height) return;
+    uint32_t wrapped_x = wrap_coordinate(x, virtual_width);
+    wrapped_x -= wrapped_x % scroll_x_step;
+    scroll_pos = wrapped_x | (wrap_coordinate(y, virtual_height) << 16);
+}
+
+bool DVHSTX::set_raster_effects(const RasterEffect* effects, int count) {
+    if (!inited || count < 0 || count > MAX_RASTER_EFFECTS) return false;
+
+    // The spare list may only be refilled once the last one is in use
+    while (raster_commit_pending) __wfe();
+    const int spare = raster_active ^ 1;
+    RasterEffect* list = raster_lists[spare];
+
+    bool has_palette = false;
+    for (int i = 0; i < count; ++i) {
+        RasterEffect effect = effects[i];
+        switch (effect.action) {
+        case RASTER_PALETTE:
+            has_palette = true;
+            effect.value &= 0xffffff;
+            break;
+        case RASTER_SCROLL: {
+            uint32_t x = wrap_coordinate((int16_t)(effect.value & 0xffff), virtual_width);
+            x -= x % scroll_x_step;
+            effect.value = x | (wrap_coordinate((int16_t)(effect.value >> 16), virtual_height) << 16);
+            break;
+        }
+        case RASTER_ROW:
+            effect.value = wrap_coordinate((int)effect.value - (effect.line - band_at(effect.line)->frame_offset), virtual_height);
+            break;
+        default:
+            return false;
+        }
+
+        // Insertion sort, effects on the same line stay in order
+        int j = i;
+        for (; j > 0 && list[j - 1].line > effect.line; --j) list[j] = list[j - 1];
+        list[j] = effect;
+    }
+    raster_counts[spare] = count;
+    raster_has_palette[spare] = has_palette;
+
+    __dmb();
+    raster_commit_pending = true;
+    return true;
+}
+
+bool DVHSTX::set_bands(const Band* bands_, int count) {
+    if (count < 0 || count > MAX_BANDS) return false;
+    bool has_frame = (count == 0);
+    for (int i = 0; i < count; ++i) {
+        if (bands_[i].kind != BAND_FRAME && bands_[i].kind != BAND_TEXT) return false;
+        if (bands_[i].kind == BAND_FRAME) has_frame = true;
+    }
+    if (!has_frame) return false;
+
+    std::copy(bands_, bands_ + count, requested_bands);
+    requested_band_count = count;
+    return true;
+}
+
+void DVHSTX::set_overlay(const uint8_t* pixels, int width, int height) {
+    overlay.pixels = pixels;
+    overlay.width = width;
+    overlay.height = height;
+}
+
+void DVHSTX::set_overlay_colour(int index, RGB888 colour, uint8_t alpha) {
+    if (index < 0 || index >= SCANLINE_BLEND_COLOURS) return;
+    overlay_colours[index] = (colour & 0xffffff) | ((uint32_t)alpha << 24);
+}
+
+void DVHSTX::set_sprite(int n, const uint8_t* image, int width, int height, uint8_t key) {
+    if (n < 0 || n >= MAX_SPRITES) return;
+    Sprite& s = sprites[n];
+    s.image = image;
+    s.width = width;
+    s.height = height;
+    s.key = key;
+}
+
+void DVHSTX::move_sprite(int n, int x, int y) {
+    if (n < 0 || n >= MAX_SPRITES) return;
+    sprites[n].x = x;
+    sprites[n].y = y;
+}
+
+void DVHSTX::show_sprite(int n, bool visible) {
+    if (n < 0 || n >= MAX_SPRITES) return;
+    sprites[n].visible = visible;
+}
+
 DVHSTX::DVHSTX()
 {
     // Always use the bottom channels
     dma_claim_mask((1 << NUM_CHANS) - 1);
+
+    for (int i = 0; i < MAX_SPRITES; ++i) {
+        sprites[i] = Sprite{};
+        sprites[i].id = i;
+    }
+}
+
+// The timings picked for each frame buffer size.  A size matches when its
+// pixels and lines times one of the allowed repeats (bit n for n times) are
+// the timing's active area, and the mode is one of the entry's modes.  The
+// first match wins, so more widely supported timings come first.
+namespace {
+    constexpr uint8_t REPEAT_1 = 1u << 1;
+    constexpr uint8_t REPEAT_2 = 1u << 2;
+    constexpr uint8_t REPEAT_4 = 1u << 4;
+
+    constexpr uint32_t ALL_MODES = ~((1u << DVHSTX::MODE_TEXT_MONO) | (1u << DVHSTX::MODE_TEXT_RGB111));
+    constexpr uint32_t PACKED_MODES = (1u << DVHSTX::MODE_PALETTE1) | (1u << DVHSTX::MODE_PALETTE2) | (1u << DVHSTX::MODE_PALETTE4) |
+                                      (1u << DVHSTX::MODE_TILES8) | (1u << DVHSTX::MODE_TILES16);
+
+    struct VideoMode {
+        const struct dvi_timing* timing;
+        uint8_t h_repeats;
+        uint8_t v_repeats;
+        uint32_t modes;
+    };
+
+    constexpr VideoMode video_modes[] = {
+        { &dvi_timing_1280x720p_rb_50hz,   REPEAT_1 | REPEAT_2 | REPEAT_4, REPEAT_1 | REPEAT_2 | REPEAT_4, ALL_MODES },
+        { &dvi_timing_1920x1080p_rb2_30hz, REPEAT_4,                       REPEAT_4,                       ALL_MODES },
+        { &dvi_timing_640x480p_60hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_720x480p_60hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_720x400p_70hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_720x576p_50hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_800x600p_60hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_800x480p_60hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_800x450p_60hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_960x540p_60hz,       REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+        { &dvi_timing_1024x768_rb_60hz,    REPEAT_1 | REPEAT_2,            REPEAT_1 | REPEAT_2,            ALL_MODES },
+
+        // Native 1080p only leaves time to render the packed pixels
+        { &dvi_timing_1920x1080p_rb2_30hz, REPEAT_1,                       REPEAT_1,                       PACKED_MODES },
+    };
+
+    // Unrepeated lines are sent a word at a time, so RGB565 rows are sent
+    // two pixels and RGB332/RGB222 rows four pixels to a transfer.  When
+    // repeating every pixel is a transfer of its own.
+    uint width_unit(DVHSTX::Mode mode, uint h_repeat) {
+        if (h_repeat > 1) return 1;
+        switch (mode) {
+        case DVHSTX::MODE_RGB565:
+        case DVHSTX::MODE_PALETTE_RGB565:
+        case DVHSTX::MODE_YCBCR420:
+            return 2;
+        case DVHSTX::MODE_RGB332:
+        case DVHSTX::MODE_RGB222:
+            return 4;
+        default:
+            return 1;
+        }
+    }
+
+    const struct dvi_timing* find_video_mode(uint width, uint height, DVHSTX::Mode mode, uint8_t* h_repeat, uint8_t* v_repeat) {
+        if (!width || !height) return nullptr;
+        for (const VideoMode& m : video_modes) {
+            const uint h = m.timing->h_active_pixels / width;
+            const uint v = m.timing->v_active_lines / height;
+            if (h * width != (uint)m.timing->h_active_pixels || v * height != (uint)m.timing->v_active_lines) continue;
+            if (h > 7 || v > 7 || !(m.h_repeats & (1u << h)) || !(m.v_repeats & (1u << v))) continue;
+            if (!(m.modes & (1u << mode))) continue;
+            *h_repeat = h;
+            *v_repeat = v;
+            return m.timing;
+        }
+        return nullptr;
+    }
+}
+
+void DVHSTX::set_timing(const struct dvi_timing* timing) {
+    use_custom_timing = timing != nullptr;
+    if (timing) custom_timing = *timing;
 }
 
 bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffered, const DVHSTXPinout &pinout)
 {
     if (inited) reset();
 
-    cursor_y = -1;
-    ch_num = 0;
-    line_num = -1;
-    v_scanline = 2;
+    cursor_off();
+    frame_counter = 0;
+    substituted_lines = 0;
+    line_num = 0;
+    v_scanline = 0;
     flip_next = false;
 
     display_width = width;
@@ -566,69 +1464,52 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
     frame_height = height;
     mode = mode_;
 
+    // Without a timing from the mode table the picture is scaled to fit
+    // this one, by set_scale() if it can be.
+    const struct dvi_timing* fit_timing = use_custom_timing ? &custom_timing : &dvi_timing_1280x720p_rb_50hz;
+    const bool is_text_mode = (mode == MODE_TEXT_MONO || mode == MODE_TEXT_RGB111);
+    const bool scale_forced = requested_h_scale && requested_v_scale && !is_text_mode &&
+                              width * requested_h_scale <= fit_timing->h_active_pixels &&
+                              height * requested_v_scale <= fit_timing->v_active_lines;
+
     timing_mode = nullptr;
-    if (mode == MODE_TEXT_MONO || mode == MODE_TEXT_RGB111) {
+    if (is_text_mode) {
         width = 1280;
         height = 720;
         display_width = 91;
         frame_width = 91;
         display_height = 30;
         frame_height = 30;
-        h_repeat_shift = 0;
-        v_repeat_shift = 0;
-        timing_mode = &dvi_timing_1280x720p_rb_50hz;
-    }
-    else if (width == 320 && height == 180) {
-        h_repeat_shift = 2;
-        v_repeat_shift = 2;
+        h_repeat = 1;
+        v_repeat = 1;
         timing_mode = &dvi_timing_1280x720p_rb_50hz;
     }
-    else if (width == 640 && height == 360) {
-        h_repeat_shift = 1;
-        v_repeat_shift = 1;
-        timing_mode = &dvi_timing_1280x720p_rb_50hz;
-    }
-    else if (width == 480 && height == 270) {
-        h_repeat_shift = 2;
-        v_repeat_shift = 2;
-        timing_mode = &dvi_timing_1920x1080p_rb2_30hz;
+    else if (scale_forced) {
+        h_repeat = requested_h_scale;
+        v_repeat = requested_v_scale;
+        timing_mode = fit_timing;
     }
-    else
-    {
-        uint16_t full_width = display_width;
-        uint16_t full_height = display_height;
-        h_repeat_shift = 0;
-        v_repeat_shift = 0;
-
-        if (display_width < 640) {
-            h_repeat_shift = 1;
-            full_width *= 2;
-        }
-
-        if (display_height < 400) {
-            v_repeat_shift = 1;
-            full_height *= 2;
+    else {
+        if (!use_custom_timing) timing_mode = find_video_mode(width, height, mode, &h_repeat, &v_repeat);
+
+        // Any other size is scaled up to fill the timing as far as it can.
+        // Pixels are repeated a whole number of times across, with borders
+        // either side of whatever is left over, and the lines are shared
+        // out as evenly as possible, e.g. 256x224 is 5x by 3.2x on 720p.
+        if (!timing_mode && width && height && height <= fit_timing->v_active_lines &&
+            fit_timing->h_active_pixels / width >= 1 && fit_timing->h_active_pixels / width <= 32) {
+            h_repeat = fit_timing->h_active_pixels / width;
+            v_repeat = (fit_timing->v_active_lines + height - 1) / height;
+            timing_mode = fit_timing;
         }
+    }
 
-        if (full_width == 640) {
-            if (full_height == 480) timing_mode = &dvi_timing_640x480p_60hz;
-        }
-        else if (full_width == 720) {
-            if (full_height == 480) timing_mode = &dvi_timing_720x480p_60hz;
-            else if (full_height == 400) timing_mode = &dvi_timing_720x400p_70hz;
-            else if (full_height == 576) timing_mode = &dvi_timing_720x576p_50hz;
-        }
-        else if (full_width == 800) {
-            if (full_height == 600) timing_mode = &dvi_timing_800x600p_60hz;
-            else if (full_height == 480) timing_mode = &dvi_timing_800x480p_60hz;
-            else if (full_height == 450) timing_mode = &dvi_timing_800x450p_60hz;
-        }
-        else if (full_width == 960) {
-            if (full_height == 540) timing_mode = &dvi_timing_960x540p_60hz;
-        }
-        else if (full_width == 1024) {
-            if (full_height == 768) timing_mode = &dvi_timing_1024x768_rb_60hz;
-        }
+    // The screen is widened to whole transfers, showing the padding the
+    // virtual frame buffer already has on the right, see set_virtual_size().
+    if (!is_text_mode) {
+        const uint unit = width_unit(mode, h_repeat);
+        frame_width = (width + unit - 1) / unit * unit;
+        if (timing_mode && frame_width * h_repeat > timing_mode->h_active_pixels) timing_mode = nullptr;
     }
 
     if (!timing_mode) {
@@ -636,6 +1517,11 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
         return false;
     }
 
+    if (!dvi_find_pll_config(&hstx_pll, timing_mode->bit_clk_khz >> 1, clock_tolerance_ppm, clock_profile == CLOCK_LOW_POWER)) {
+        dvhstx_debug("Bit clock of %u kHz cannot be achieved within %u ppm", timing_mode->bit_clk_khz, clock_tolerance_ppm);
+        return false;
+    }
+
     display = this;
     display_palette = get_palette();
     
@@ -649,8 +1535,36 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
 
     v_inactive_total = timing_mode->v_front_porch + timing_mode->v_sync_width + timing_mode->v_back_porch;
     v_total_active_lines = v_inactive_total + timing_mode->v_active_lines;
-    v_repeat = 1 << v_repeat_shift;
-    h_repeat = 1 << h_repeat_shift;
+
+    // With a whole number scale the lines left over are border lines, split
+    // above and below the picture.
+    picture_lines = timing_mode->v_active_lines;
+    if (scale_forced) picture_lines = height * v_repeat;
+    border_top = (timing_mode->v_active_lines - picture_lines) / 2;
+    border_bottom = timing_mode->v_active_lines - picture_lines - border_top;
+
+    // Each source line is shown on the output lines from
+    // source_first_line[y] up to source_first_line[y + 1] of the picture,
+    // which are worked out here so the scanline code never has to divide.
+    // v_repeat is the most output lines any source line gets.
+    source_lines = height;
+    source_first_line = (uint16_t*)malloc((source_lines + 1) * sizeof(uint16_t));
+    if (!source_first_line) {
+        dvhstx_debug("Not enough memory for %d lines\n", source_lines);
+        return false;
+    }
+    for (int y = 0; y <= source_lines; ++y) {
+        source_first_line[y] = (y * picture_lines + source_lines - 1) / source_lines;
+    }
+    const int v_repeat_min = picture_lines / source_lines;
+
+    // The part of the active line not covered by repeated pixels is border,
+    // split either side.  The left border is a command in the line header
+    // and the right border a trailer after the pixels, see update_border().
+    // Text lines always fill the screen.
+    const uint picture_width = is_text_mode ? timing_mode->h_active_pixels : frame_width * h_repeat;
+    border_left = (timing_mode->h_active_pixels - picture_width) / 2;
+    border_right = timing_mode->h_active_pixels - picture_width - border_left;
 
     memcpy(vblank_line_vsync_off, vblank_line_vsync_off_src, sizeof(vblank_line_vsync_off_src));
     vblank_line_vsync_off[0] |= timing_mode->h_front_porch;
@@ -666,7 +1580,12 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
     vactive_line_header[0] |= timing_mode->h_front_porch;
     vactive_line_header[2] |= timing_mode->h_sync_width;
     vactive_line_header[4] |= timing_mode->h_back_porch;
-    vactive_line_header[6] |= timing_mode->h_active_pixels;
+    if (border_left) vactive_line_header[6] = HSTX_CMD_TMDS_REPEAT | border_left;
+    vactive_line_header[8] |= timing_mode->h_active_pixels - border_left - border_right;
+    vactive_line_trailer[0] = HSTX_CMD_TMDS_REPEAT | border_right;
+
+    memcpy(vactive_border_line, vactive_line_header, 6 * sizeof(uint32_t));
+    vactive_border_line[6] = HSTX_CMD_TMDS_REPEAT | timing_mode->h_active_pixels;
 
     memcpy(vactive_text_line_header, vactive_text_line_header_src, sizeof(vactive_text_line_header_src));
     vactive_text_line_header[0] |= timing_mode->h_front_porch;
@@ -676,70 +1595,262 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
 
     switch (mode) {
     case MODE_RGB565:
-        frame_bytes_per_pixel = 2;
+        // Only the sprite layer needs line buffers, of 16-bit pixels
+        frame_bits_per_pixel = 16;
         line_bytes_per_pixel = 2;
         break;
+    case MODE_PALETTE_RGB565:
+    case MODE_YCBCR420:
+        frame_bits_per_pixel = 8;
+        line_bytes_per_pixel = 2;
+        break;
+    case MODE_TILES8:
+    case MODE_TILES16:
+        // Frame buffer layout is worked out below
+        frame_bits_per_pixel = 0;
+        line_bytes_per_pixel = 4;
+        break;
     case MODE_PALETTE:
-        frame_bytes_per_pixel = 1;
+        frame_bits_per_pixel = 8;
+        line_bytes_per_pixel = 4;
+        break;
+    case MODE_PALETTE1:
+        frame_bits_per_pixel = 1;
+        line_bytes_per_pixel = 4;
+        break;
+    case MODE_PALETTE2:
+        frame_bits_per_pixel = 2;
+        line_bytes_per_pixel = 4;
+        break;
+    case MODE_PALETTE4:
+        frame_bits_per_pixel = 4;
         line_bytes_per_pixel = 4;
         break;
     case MODE_RGB888:
-        frame_bytes_per_pixel = 4;
+        frame_bits_per_pixel = 32;
         line_bytes_per_pixel = 4;
         break;
+    case MODE_RGB332:
+    case MODE_RGB222:
+        frame_bits_per_pixel = 8;
+        line_bytes_per_pixel = 1;
+        break;
     case MODE_TEXT_MONO:
-        frame_bytes_per_pixel = 1;
+        frame_bits_per_pixel = 8;
         line_bytes_per_pixel = 4;
         break;
     case MODE_TEXT_RGB111:
-        frame_bytes_per_pixel = 2;
+        frame_bits_per_pixel = 16;
         line_bytes_per_pixel = 14;
         break;
     default:
         dvhstx_debug("Unsupported mode %d", (int)mode);
+        free_buffers();
         return false;
     }
 
+    // Lay the bands out down the screen.  The frame buffer only holds the
+    // rows of the frame bands, and each text band whole character rows.
+    const bool bands_supported = !is_text_mode && mode != MODE_RGB888 && mode != MODE_RGB332 && mode != MODE_RGB222;
+    band_count = 0;
+    text_columns = frame_width / SCANLINE_TEXT_CHAR_WIDTH;
+    uint text_bytes = 0;
+    int frame_lines = 0;
+    for (int i = 0, first_line = 0; bands_supported && i < requested_band_count && first_line < display_height; ++i) {
+        const int end_line = (i == requested_band_count - 1) ? display_height :
+                             std::min<int>(first_line + requested_bands[i].lines, display_height);
+        BandLayout& band = bands[band_count++];
+        band = BandLayout{ (uint16_t)first_line, (uint16_t)end_line, (int16_t)(first_line - frame_lines), 0, nullptr };
+        if (requested_bands[i].kind == BAND_TEXT) {
+            band.text_rows = (end_line - first_line + SCANLINE_TEXT_CHAR_HEIGHT - 1) / SCANLINE_TEXT_CHAR_HEIGHT;
+            text_bytes += band.text_rows * text_columns * 2;
+        }
+        else {
+            frame_lines += end_line - first_line;
+        }
+        first_line = end_line;
+    }
+    if (band_count <= 1 || frame_lines == 0) {
+        band_count = 1;
+        bands[0] = BandLayout{ 0, display_height, 0, 0, nullptr };
+        text_bytes = 0;
+    }
+    else {
+        frame_height = frame_lines;
+    }
+    const bool split_screen = (band_count > 1);
+
+    // Direct colour frame buffer rows are already in the format the
+    // expander consumes, so they are sent straight from the frame buffer.
+    // With the sprite layer, bands or the overlay RGB565 is copied a line
+    // at a time instead.
+    direct_scanout = ((mode == MODE_RGB565 && !sprite_layer && !split_screen && !overlay_layer) || mode == MODE_RGB888 ||
+                      mode == MODE_RGB332 || mode == MODE_RGB222);
+
+    // Lines are read from the scroll position in whole steps of whatever
+    // they are read or rendered in: a DMA transfer for direct scanout, a
+    // word of the 16-bit line buffers, or a byte of packed pixels.
+    if (direct_scanout) scroll_x_step = (h_repeat > 1) ? 1 : 32 / frame_bits_per_pixel;
+    else if (line_bytes_per_pixel == 2) scroll_x_step = 2;
+    else if (frame_bits_per_pixel && frame_bits_per_pixel < 8) scroll_x_step = 8 / frame_bits_per_pixel;
+    else scroll_x_step = 1;
+
+    // The virtual frame buffer is at least the size of the screen, and a
+    // whole number of steps or tiles across
+    tile_size = 0;
+    if (mode == MODE_TILES8 || mode == MODE_TILES16) tile_size = (mode == MODE_TILES8) ? 8 : 16;
+    if (is_text_mode) {
+        virtual_width = frame_width;
+        virtual_height = frame_height;
+    }
+    else {
+        const uint width_unit = tile_size ? tile_size : scroll_x_step;
+        const uint height_unit = tile_size ? tile_size : 1;
+        virtual_width = std::max(requested_virtual_width, frame_width);
+        virtual_width = (virtual_width + width_unit - 1) / width_unit * width_unit;
+        virtual_height = std::max(requested_virtual_height, frame_height);
+        virtual_height = (virtual_height + height_unit - 1) / height_unit * height_unit;
+    }
+    scroll_pos = frame_scroll_pos = 0;
+    frame_scroll_x = frame_scroll_y = 0;
+
+    raster_counts[0] = raster_counts[1] = 0;
+    raster_has_palette[0] = raster_has_palette[1] = false;
+    raster_active = raster_next = 0;
+    raster_commit_pending = false;
+
+    frame_stride = (virtual_width * frame_bits_per_pixel + 7) >> 3;
+    uint frame_bytes = frame_stride * virtual_height;
+
+    // The tile map covers the virtual frame buffer
+    map_rows = 0;
+    if (tile_size) {
+        frame_stride = (virtual_width / tile_size) * sizeof(uint16_t);
+        map_rows = virtual_height / tile_size;
+        frame_bytes = frame_stride * map_rows;
+    }
+
+    // The chroma planes follow the luma plane, see Plane
+    chroma_stride = cb_offset = cr_offset = 0;
+    if (mode == MODE_YCBCR420) {
+        chroma_stride = (virtual_width + 1) >> 1;
+        const uint chroma_bytes = chroma_stride * ((virtual_height + 1) >> 1);
+        cb_offset = frame_bytes;
+        cr_offset = frame_bytes + chroma_bytes;
+        frame_bytes += 2 * chroma_bytes;
+    }
+
+    if (text_bytes) {
+        text_cells = (uint8_t*)calloc(text_bytes, 1);
+        if (!text_cells) {
+            dvhstx_debug("Not enough memory for %u bytes of text bands\n", text_bytes);
+            free_buffers();
+            return false;
+        }
+        uint8_t* cells = text_cells;
+        for (int i = 0; i < band_count; ++i) {
+            if (requested_bands[i].kind != BAND_TEXT) continue;
+            bands[i].text = cells;
+            cells += bands[i].text_rows * text_columns * 2;
+        }
+    }
+
 #ifdef MICROPY_BUILD_TYPE
-    if (frame_width * frame_height * frame_bytes_per_pixel > sizeof(frame_buffer_a)) {
+    if (frame_bytes > sizeof(frame_buffer_a)) {
         panic("Frame buffer too large");
     }
 
     frame_buffer_display = frame_buffer_a;
     frame_buffer_back = double_buffered ? frame_buffer_b : frame_buffer_a;
 #else
-    frame_buffer_display = (uint8_t*)malloc(frame_width * frame_height * frame_bytes_per_pixel);
-    frame_buffer_back = double_buffered ? (uint8_t*)malloc(frame_width * frame_height * frame_bytes_per_pixel) : frame_buffer_display;
+    frame_buffer_display = (uint8_t*)malloc(frame_bytes);
+    frame_buffer_back = double_buffered ? (uint8_t*)malloc(frame_bytes) : frame_buffer_display;
+    if (!frame_buffer_display || !frame_buffer_back) {
+        dvhstx_debug("Not enough memory for %u byte frame buffers\n", frame_bytes);
+        free_buffers();
+        return false;
+    }
 #endif
-    memset(frame_buffer_display, 0, frame_width * frame_height * frame_bytes_per_pixel);
-    memset(frame_buffer_back, 0, frame_width * frame_height * frame_bytes_per_pixel);
+    memset(frame_buffer_display, 0, frame_bytes);
+    memset(frame_buffer_back, 0, frame_bytes);
+    if (mode == MODE_YCBCR420) {
+        // Neutral chroma, so the frame starts out black
+        memset(frame_buffer_display + cb_offset, 128, frame_bytes - cb_offset);
+        memset(frame_buffer_back + cb_offset, 128, frame_bytes - cb_offset);
+    }
 
     memset(palette, 0, PALETTE_SIZE * sizeof(palette[0]));
+    palette_commit_pending = true;
+
+    frame_sprite_count = 0;
+    frame_overlay.visible = false;
+    sprite_overflows = 0;
+    for (int i = 0; i < MAX_SPRITES; ++i) sprite_hits[i] = sprite_collisions[i] = 0;
 
     frame_buffer_display = frame_buffer_display;
     dvhstx_debug("Frame buffers inited\n");
 
-    const bool is_text_mode = (mode == MODE_TEXT_MONO || mode == MODE_TEXT_RGB111);
-    const int frame_pixel_words = (frame_width * h_repeat * line_bytes_per_pixel + 3) >> 2;
-    const int frame_line_words = frame_pixel_words + (is_text_mode ? count_of(vactive_text_line_header) : count_of(vactive_line_header));
-    const int frame_lines = (v_repeat == 1) ? NUM_CHANS : NUM_FRAME_LINES;
-    line_buffers = (uint32_t*)malloc(frame_line_words * 4 * frame_lines);
+    // RGB565 line buffers hold only pixels, their header has a scanout
+    // block of its own.
+    line_block_shift = (mode == MODE_RGB565 || mode == MODE_PALETTE_RGB565 || mode == MODE_YCBCR420) ? 1 : 0;
 
-    for (int i = 0; i < frame_lines; ++i)
-    {
-        if (is_text_mode) memcpy(&line_buffers[i * frame_line_words], vactive_text_line_header, count_of(vactive_text_line_header) * sizeof(uint32_t));
-        else memcpy(&line_buffers[i * frame_line_words], vactive_line_header, count_of(vactive_line_header) * sizeof(uint32_t));
+    if (direct_scanout) {
+        line_buffers = nullptr;
+        line_buffers_end = nullptr;
     }
+    else {
+        // Each source line is rendered into the next buffer of a ring
+        // while the line line_buffer_count lines before it is displayed,
+        // giving the IRQ (or core 1) at least two output lines to refill a
+        // buffer, see bind_line_buffer().
+        line_buffer_count = (v_repeat_min == 1) ? 3 : 2;
+        if (render_core1) line_buffer_count = std::max(line_buffer_count, core1_lines_ahead);
+        line_buffer_count = std::min(line_buffer_count, source_lines);
+
+        // The right border trailer follows the pixels, where the scanline
+        // kernels never write.  The 16-bit line buffers send it 16 bits at
+        // a time when repeating, which HSTX takes as the same words.
+        const int header_words = line_block_shift ? 0 : (is_text_mode ? count_of(vactive_text_line_header) : count_of(vactive_line_header));
+        line_trailer_offset = header_words * 4 + frame_width * line_bytes_per_pixel;
+        int trailer_bytes = 0;
+        if (border_right) trailer_bytes = (line_block_shift && h_repeat > 1) ? 4 : sizeof(vactive_line_trailer);
+        line_buffer_words = header_words + ((frame_width * line_bytes_per_pixel + trailer_bytes + 3) >> 2);
+        line_buffers = (uint32_t*)calloc(line_buffer_words * line_buffer_count, 4);
+        if (!line_buffers) {
+            dvhstx_debug("Not enough memory for %d line buffers\n", line_buffer_count);
+            free_buffers();
+            return false;
+        }
+        line_buffers_end = line_buffers + line_buffer_words * line_buffer_count;
+        next_line_buffer = line_buffers;
+        line_src_stride = frame_stride;
 
-    if (mode == MODE_TEXT_RGB111) {
+        for (int i = 0; i < line_buffer_count && !line_block_shift; ++i)
+        {
+            if (is_text_mode) memcpy(line_buffer(i), vactive_text_line_header, count_of(vactive_text_line_header) * sizeof(uint32_t));
+            else memcpy(line_buffer(i), vactive_line_header, count_of(vactive_line_header) * sizeof(uint32_t));
+        }
+    }
+
+    if (mode == MODE_TEXT_RGB111 || text_cells) {
         // Need to pre-render the font to RAM to be fast enough.
-        font_cache = (uint32_t*)malloc(4 * FONT->line_height * 96);
-        uint32_t* font_cache_ptr = font_cache;
-        for (int c = 0x20; c < 128; ++c) {
-            for (int y = 0; y < FONT->line_height; ++y) {
-                *font_cache_ptr++ = render_char_line(c, y);
-            }
+        font_cache = (uint32_t*)malloc(SCANLINE_FONT_CACHE_WORDS * sizeof(uint32_t));
+        if (!font_cache) {
+            dvhstx_debug("Not enough memory for the font cache\n");
+            free_buffers();
+            return false;
+        }
+        scanline_build_font_cache(font_cache);
+    }
+
+    if (mode == MODE_YCBCR420) {
+        ycbcr_tables = (ScanlineYCbCrTables*)malloc(sizeof(ScanlineYCbCrTables));
+        if (!ycbcr_tables) {
+            dvhstx_debug("Not enough memory for the YCbCr tables\n");
+            free_buffers();
+            return false;
         }
+        scanline_build_ycbcr_tables(ycbcr_tables);
     }
 
     // Ensure HSTX FIFO is clear
@@ -750,6 +1861,8 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
 
     switch (mode) {
     case MODE_RGB565:
+    case MODE_PALETTE_RGB565:
+    case MODE_YCBCR420:
         // Configure HSTX's TMDS encoder for RGB565
         hstx_ctrl_hw->expand_tmds =
             4  << HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB |
@@ -759,16 +1872,23 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
             4  << HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB |
             29 << HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB;
 
-        // Pixels (TMDS) come in 2 16-bit chunks. Control symbols (RAW) are an
-        // entire 32-bit word.
+        // Pixels (TMDS) come in 2 16-bit chunks, when repeating horizontally
+        // both chunks hold the same pixel and the word is shifted out
+        // h_repeat times. Control symbols (RAW) are an entire 32-bit word.
         hstx_ctrl_hw->expand_shift =
-            2 << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB |
+            ((h_repeat > 1 ? h_repeat : 2) & 0x1f) << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB |
             16 << HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB |
             1 << HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB |
             0 << HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB;
         break;
 
+    case MODE_RGB888:
     case MODE_PALETTE:
+    case MODE_TILES8:
+    case MODE_TILES16:
+    case MODE_PALETTE1:
+    case MODE_PALETTE2:
+    case MODE_PALETTE4:
         // Configure HSTX's TMDS encoder for RGB888
         hstx_ctrl_hw->expand_tmds =
             7  << HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB |
@@ -778,15 +1898,49 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
             7  << HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB |
             0  << HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB;
 
-        // Pixels and control symbols (RAW) are an
-        // entire 32-bit word.
+        // Pixels and control symbols (RAW) are an entire 32-bit word. Each
+        // pixel word is shifted out h_repeat times with no rotation.
         hstx_ctrl_hw->expand_shift =
-            1 << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB |
+            (h_repeat & 0x1f) << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB |
             0 << HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB |
             1 << HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB |
             0 << HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB;
         break;
 
+    case MODE_RGB332:
+    case MODE_RGB222:
+        // Configure HSTX's TMDS encoder to take each colour from the low
+        // byte of the word, as the top bits of its lane.
+        if (mode == MODE_RGB332) {
+            hstx_ctrl_hw->expand_tmds =
+                2  << HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB |
+                0  << HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB   |
+                2  << HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB |
+                29 << HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB   |
+                1  << HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB |
+                26 << HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB;
+        }
+        else {
+            hstx_ctrl_hw->expand_tmds =
+                1  << HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB |
+                30 << HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB   |
+                1  << HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB |
+                28 << HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB   |
+                1  << HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB |
+                26 << HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB;
+        }
+
+        // Pixels (TMDS) come in 4 8-bit chunks.  When repeating
+        // horizontally all four hold the same pixel and the word is shifted
+        // out h_repeat times.  Control symbols (RAW) are an entire 32-bit
+        // word.
+        hstx_ctrl_hw->expand_shift =
+            ((h_repeat > 1 ? h_repeat : 4) & 0x1f) << HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB |
+            8 << HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB |
+            1 << HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB |
+            0 << HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB;
+        break;
+
     case MODE_TEXT_MONO:
         // Configure HSTX's TMDS encoder for 2bpp
         hstx_ctrl_hw->expand_tmds =
@@ -827,6 +1981,7 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
 
     default:
         dvhstx_debug("Unsupported mode %d", (int)mode);
+        free_buffers();
         return false;
     }
 
@@ -866,58 +2021,83 @@ bool DVHSTX::init(uint16_t width, uint16_t height, Mode mode_, bool double_buffe
 
     dvhstx_debug("GPIO configured\n");
 
-    // The channels are set up identically, to transfer a whole scanline and
-    // then chain to the next channel. Each time a channel finishes, we
-    // reconfigure the one that just finished, meanwhile the other channel(s)
-    // are already making progress.
-    // Using just 2 channels was insufficient to avoid issues with the IRQ.
-    dma_channel_config c;
-    c = dma_channel_get_default_config(0);
-    channel_config_set_chain_to(&c, 1);
-    channel_config_set_dreq(&c, DREQ_HSTX);
-    dma_channel_configure(
-        0,
-        &c,
-        &hstx_fifo_hw->fifo,
-        vblank_line_vsync_off,
-        count_of(vblank_line_vsync_off),
-        false
-    );
-    c = dma_channel_get_default_config(1);
-    channel_config_set_chain_to(&c, 2);
-    channel_config_set_dreq(&c, DREQ_HSTX);
+#if DVHSTX_STATS
+    stats_start_cycle_counter();
+#endif
+    reset_stats();
+
+    if (!build_vblank_list() || !build_scanout_list()) {
+        dvhstx_debug("Not enough memory for the scanout lists\n");
+        free_buffers();
+        return false;
+    }
+
+    update_border();
+
+    // The control channel writes each block to the data channel's AL1
+    // registers, the last of which triggers it.  The write ring brings
+    // the control channel back to AL1_CTRL ready for the next block.
+    dma_channel_config c = dma_channel_get_default_config(SCANOUT_CTRL_CHAN);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, __builtin_ctz(sizeof(ScanoutBlock)));
     dma_channel_configure(
-        1,
+        SCANOUT_CTRL_CHAN,
         &c,
-        &hstx_fifo_hw->fifo,
-        vblank_line_vsync_off,
-        count_of(vblank_line_vsync_off),
+        &dma_hw->ch[SCANOUT_DATA_CHAN].al1_ctrl,
+        scanout_list,
+        sizeof(ScanoutBlock) / sizeof(uintptr_t),
         false
     );
-    for (int i = 2; i < NUM_CHANS; ++i) {
-        c = dma_channel_get_default_config(i);
-        channel_config_set_chain_to(&c, (i+1) % NUM_CHANS);
-        channel_config_set_dreq(&c, DREQ_HSTX);
-        dma_channel_configure(
-            i,
-            &c,
-            &hstx_fifo_hw->fifo,
-            vblank_line_vsync_off,
-            count_of(vblank_line_vsync_off),
-            false
-        );
-    }
 
     dvhstx_debug("DMA channels claimed\n");
 
-    dma_hw->intr = (1 << NUM_CHANS) - 1;
-    dma_hw->ints2 = (1 << NUM_CHANS) - 1;
-    dma_hw->inte2 = (1 << NUM_CHANS) - 1;
-    if (is_text_mode) irq_set_exclusive_handler(DMA_IRQ_2, dma_irq_handler_text);
-    else irq_set_exclusive_handler(DMA_IRQ_2, dma_irq_handler);
-    irq_set_enabled(DMA_IRQ_2, true);
+    // Pick the DMA handler and renderer for the mode.  The line buffer
+    // modes share one IRQ handler, which calls the mode's renderer.
+    const irq_handler_t irq_handler = direct_scanout ? dma_irq_handler_scanout : dma_irq_handler_line;
+    switch (mode) {
+    case MODE_RGB565: render_line_fn = &DVHSTX::render_line_rgb565; break;
+    case MODE_PALETTE: render_line_fn = &DVHSTX::render_line_palette; break;
+    case MODE_PALETTE_RGB565: render_line_fn = &DVHSTX::render_line_palette_rgb565; break;
+    case MODE_YCBCR420: render_line_fn = &DVHSTX::render_line_ycbcr420; break;
+    case MODE_TILES8: render_line_fn = &DVHSTX::render_line_tiles8; break;
+    case MODE_TILES16: render_line_fn = &DVHSTX::render_line_tiles16; break;
+    case MODE_PALETTE1: render_line_fn = &DVHSTX::render_line_palette1; break;
+    case MODE_PALETTE2: render_line_fn = &DVHSTX::render_line_palette2; break;
+    case MODE_PALETTE4: render_line_fn = &DVHSTX::render_line_palette4; break;
+    case MODE_TEXT_MONO: render_line_fn = &DVHSTX::render_line_text_mono; break;
+    case MODE_TEXT_RGB111: render_line_fn = &DVHSTX::render_line_text_rgb111; break;
+    default: break;
+    }
 
-    dma_channel_start(0);
+    // The list starts with vertical blanking, fill the first line buffers
+    // before it ends.
+    if (!direct_scanout) {
+        begin_line_frame();
+        for (int i = 0; i < line_buffer_count; ++i) render_line(line_buffer(i), i);
+    }
+
+    core1_running = render_core1 && !direct_scanout;
+    if (core1_running) {
+        core1_rendered = line_buffer_count;
+        core1_next_buffer = 0;
+        core1_frame = 0;
+        core1_last_block = 0;
+#ifdef DVHSTX_HOST_BUILD
+        dvhstx_host_core1_hook = core1_poll;
+#else
+        multicore_launch_core1(core1_entry);
+#endif
+    }
+    else {
+        dma_hw->intr = 1u << SCANOUT_DATA_CHAN;
+        dma_hw->ints2 = 1u << SCANOUT_DATA_CHAN;
+        dma_hw->inte2 = 1u << SCANOUT_DATA_CHAN;
+        irq_set_exclusive_handler(DMA_IRQ_2, irq_handler);
+        irq_set_enabled(DMA_IRQ_2, true);
+    }
+
+    dma_channel_start(SCANOUT_CTRL_CHAN);
 
     dvhstx_debug("DVHSTX started\n");
 
@@ -931,24 +2111,49 @@ void DVHSTX::reset() {
 
     hstx_ctrl_hw->csr = 0;
 
-    irq_set_enabled(DMA_IRQ_2, false);
-    irq_remove_handler(DMA_IRQ_2, irq_get_exclusive_handler(DMA_IRQ_2));
+    if (core1_running) {
+        core1_running = false;
+#ifdef DVHSTX_HOST_BUILD
+        dvhstx_host_core1_hook = nullptr;
+#else
+        multicore_reset_core1();
+#endif
+    }
+    else {
+        irq_set_enabled(DMA_IRQ_2, false);
+        irq_remove_handler(DMA_IRQ_2, irq_get_exclusive_handler(DMA_IRQ_2));
+    }
 
     for (int i = 0; i < NUM_CHANS; ++i)
         dma_channel_abort(i);
 
-    if (font_cache) {
-        free(font_cache);
-        font_cache = nullptr;
-    }
+    free_buffers();
+}
+
+// Free everything init() allocates, including whatever it had allocated
+// so far when it fails.
+void DVHSTX::free_buffers() {
+    free(ycbcr_tables);
+    ycbcr_tables = nullptr;
+    free(font_cache);
+    font_cache = nullptr;
+    free(text_cells);
+    text_cells = nullptr;
+    band_count = 0;
     free(line_buffers);
-    line_buffers = nullptr;
+    line_buffers = line_buffers_end = nullptr;
+    free(source_first_line);
+    source_first_line = nullptr;
+    free(scanout_list);
+    scanout_list = nullptr;
+    free(vblank_list);
+    vblank_list = nullptr;
 
 #ifndef MICROPY_BUILD_TYPE
     free(frame_buffer_display);
     if (frame_buffer_display != frame_buffer_back) {
         free(frame_buffer_back);
-}
+    }
     frame_buffer_display = frame_buffer_back = nullptr;
 #endif
 }
@@ -956,18 +2161,22 @@ void DVHSTX::reset() {
 void DVHSTX::flip_blocking() {
     if (get_single_buffered())
         return;
-    wait_for_vsync();
-    flip_now();
+    // Flip from the IRQ at the end of the frame, as the first active lines
+    // may be prepared as soon as vertical blanking starts.
+    flip_async();
+    wait_for_flip();
 }
 
-void DVHSTX::flip_now() {
-    if (get_single_buffered())
+void __not_in_flash_func(DVHSTX::flip_now)() {
+    if (frame_buffer_display == frame_buffer_back)
         return;
     std::swap(frame_buffer_display, frame_buffer_back);
+    if (direct_scanout) update_scanout_rows();
 }
 
 void DVHSTX::wait_for_vsync() {
-    while (v_scanline >= timing_mode->v_front_porch) __wfe();
+    const uint32_t frame = frame_counter;
+    while (v_scanline >= timing_mode->v_front_porch && frame_counter == frame) __wfe();
 }
 
 void DVHSTX::flip_async() {
@@ -980,4 +2189,5 @@ void DVHSTX::wait_for_flip() {
     if (get_single_buffered())
         return;
     while (flip_next) __wfe();
+    __dmb();
 }
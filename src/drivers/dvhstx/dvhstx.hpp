@@ -1,12 +1,27 @@
 #pragma once
 
 #include <string.h>
+#include <algorithm>
 
+#ifdef DVHSTX_HOST_BUILD
+#include "host/pico_host.hpp"
+#else
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
+#endif
+
+#include "dvhstx_scanline.hpp"
+#include "dvi.hpp"
 
 // DVI HSTX driver for use with Pimoroni PicoGraphics
 
+// Define DVHSTX_STATS to 1 to record the per-scanline IRQ costs returned by
+// DVHSTX::get_stats().  When it is 0 (the default) the counters are compiled
+// out and get_stats() returns all zeros.
+#ifndef DVHSTX_STATS
+#define DVHSTX_STATS 0
+#endif
+
 namespace pimoroni {
 
   struct DVHSTXPinout {
@@ -15,22 +30,77 @@ namespace pimoroni {
 
   typedef uint32_t RGB888;
 
+  struct DVHSTXStats {
+    // Scanline classes, by what the IRQ that queued the line had to do
+    enum LineClass {
+      LINE_VBLANK,          // Direct scanout, end of vertical blanking
+      LINE_FRAME_END,       // Direct scanout, end of the last active line,
+                            // starting the next frame
+      LINE_ACTIVE_NEW,      // Active line, rendered a new line buffer
+      LINE_CLASS_COUNT
+    };
+
+    // Bucket n counts IRQs that took fewer than 64 << n cycles, the last
+    // bucket also counts everything longer.
+    static constexpr int HISTOGRAM_BUCKETS = 16;
+
+    struct IrqCost {
+      uint32_t count;
+      uint32_t min_cycles;
+      uint32_t max_cycles;
+      uint64_t total_cycles;
+      uint32_t histogram[HISTOGRAM_BUCKETS];
+    };
+
+    IrqCost irq[LINE_CLASS_COUNT];
+
+    // Lines whose DMA channel was reloaded after the following channel had
+    // already started, i.e. the IRQ ran at least a whole line late.
+    uint32_t late_reloads;
+
+    uint32_t frames;
+  };
+
   // Digital Video using HSTX
-  // Valid screen modes are:
-  //   Pixel doubled: 640x480 (60Hz), 720x480 (60Hz), 720x400 (70Hz), 720x576 (50Hz), 
+  // Valid screen modes are, from the mode table in dvhstx.cpp:
+  //   Native or pixel doubled: 640x480 (60Hz), 720x480 (60Hz), 720x400 (70Hz), 720x576 (50Hz),
   //                  800x600 (60Hz), 800x480 (60Hz), 800x450 (60Hz), 960x540 (60Hz), 1024x768 (60Hz)
   //   Pixel doubled or quadrupled: 1280x720 (50Hz)
+  //   Native: 1280x720 (50Hz), in practice only with the packed palette modes
+  //   Pixel quadrupled: 1920x1080 (30Hz)
+  //   Native: 1920x1080 (30Hz), only with the packed palette and tile modes
   //
   // Giving valid resolutions:
   //   320x180, 640x360 (well supported, square pixels on a 16:9 display)
+  //   1280x720 (well supported, square pixels on a 16:9 display)
   //   480x270, 400x225 (sometimes supported, square pixels on a 16:9 display)
   //   320x240, 360x240, 360x200, 360x288, 400x300, 512x384 (well supported, but pixels aren't square)
   //   400x240 (sometimes supported, pixels aren't square)
   //
+  // Any other size up to 1280x720 is scaled to 1280x720 (50Hz): pixels are
+  // repeated a whole number of times across, centred with borders, and
+  // lines are repeated a varying number of times to fill the height.  So
+  // 300x200 is 4x across with 40 pixel borders and 3.6x down, and 256x224
+  // is 5x across by 3.2x down.  set_scale() fixes both scales instead,
+  // leaving borders above and below too, see set_border_colour().  Any
+  // other timing, such as 1280x720 at 60Hz, can be given to set_timing().
+  //
   // Note that the double buffer is in RAM, so 640x360 uses almost all of the available RAM.
+  // The packed palette modes use 1, 2 or 4 bits per pixel, so 1280x720 with
+  // 2 colours takes 115kB and 640x360 with 16 colours can be double buffered.
+  // RGB888 uses a 32-bit word (0x00RRGGBB) per pixel, so only fits at the
+  // lower resolutions such as 320x180 or 320x240, single buffered.
+  // RGB332 and RGB222 use a byte per pixel with no palette, the HSTX
+  // expander picks the colour bits straight out of the frame buffer.
+  // MODE_PALETTE_RGB565 halves the line buffers of MODE_PALETTE by sending
+  // the palette colours as RGB565.  MODE_YCBCR420 takes 1.5 bytes per pixel
+  // and is converted to RGB565 a line at a time, e.g. for decoded video.
+  // The tile modes need only a map of tile indexes, so work at any
+  // resolution including native 1280x720.
   class DVHSTX {
   public:
     static constexpr int PALETTE_SIZE = 256;
+    static constexpr int MAX_SPRITES = 32;
 
 
     enum Mode {
@@ -39,6 +109,23 @@ namespace pimoroni {
       MODE_RGB888 = 3,
       MODE_TEXT_MONO = 4,
       MODE_TEXT_RGB111 = 5,
+      MODE_PALETTE1 = 6,    // 1 bit per pixel, palette entries 0-1
+      MODE_PALETTE2 = 7,    // 2 bits per pixel, palette entries 0-3
+      MODE_PALETTE4 = 8,    // 4 bits per pixel, palette entries 0-15
+      MODE_RGB332 = 9,      // 8 bits per pixel, 0bRRRGGGBB
+      MODE_RGB222 = 10,     // 8 bits per pixel, 0b00RRGGBB
+      MODE_PALETTE_RGB565 = 11, // As MODE_PALETTE, sent at RGB565 precision
+      MODE_YCBCR420 = 12,   // Planar YCbCr 4:2:0, 12 bits per pixel, see Plane
+      MODE_TILES8 = 13,     // Map of 8x8 tiles, see set_tiles()
+      MODE_TILES16 = 14,    // Map of 16x16 tiles, see set_tiles()
+    };
+
+    // MODE_YCBCR420 frame buffers hold three planes of 8-bit samples: Y for
+    // every pixel, then Cb and Cr for each 2x2 block of pixels.
+    enum Plane {
+      PLANE_Y,
+      PLANE_CB,
+      PLANE_CR,
     };
 
     enum TextColour {
@@ -52,6 +139,18 @@ namespace pimoroni {
       TEXT_WHITE   = 0b1001001,
     };    
 
+    // How init() sets up the clocks.  The HSTX always runs from the system
+    // PLL at half the bit clock, and the CPU from the USB PLL at 264MHz
+    // unless the profile says otherwise.
+    enum ClockProfile {
+      CLOCK_EXACT_PIXEL,    // The PLL setting closest to the pixel clock (the default)
+      CLOCK_MAX_CPU,        // The CPU shares the system PLL with the HSTX when
+                            // that is faster, up to MAX_CPU_CLOCK_KHZ
+      CLOCK_LOW_POWER,      // The CPU at 132MHz and the lowest VCO in tolerance
+    };
+
+    static constexpr uint32_t MAX_CPU_CLOCK_KHZ = 300000;
+
     //--------------------------------------------------
     // Variables
     //--------------------------------------------------
@@ -62,7 +161,8 @@ namespace pimoroni {
     uint16_t display_height = 180;
     uint16_t frame_width = 320;
     uint16_t frame_height = 180;
-    uint8_t frame_bytes_per_pixel = 2;
+    uint8_t frame_bits_per_pixel = 16;
+    uint frame_stride = 640;
     uint8_t h_repeat = 4;
     uint8_t v_repeat = 4;
     Mode mode = MODE_RGB565;
@@ -82,11 +182,230 @@ namespace pimoroni {
       template<class T>
       T *get_front_buffer() { return (T*)(frame_buffer_display); }
 
+      // Planes of a MODE_YCBCR420 frame buffer.  PLANE_Y is the start of
+      // the buffer, as returned by get_back_buffer().
+      uint8_t *get_back_plane(Plane plane) { return frame_buffer_back + plane_offset(plane); }
+      uint8_t *get_front_plane(Plane plane) { return frame_buffer_display + plane_offset(plane); }
+      uint get_plane_stride(Plane plane) const { return plane == PLANE_Y ? frame_stride : chroma_stride; }
+
+      // The tile modes display a map of 16-bit entries, which is the frame
+      // buffer: get_map_columns() entries per row and get_map_rows() rows,
+      // enough to cover the screen.  Each entry is a tile index, with the
+      // SCANLINE_TILE_ flip bits and a palette bank above
+      // SCANLINE_TILE_BANK_SHIFT.  Pixel n of a tile uses palette entry
+      // bank * 16 + n.
+      //
+      // Tiles are 4 bits per pixel, leftmost pixel in the most significant
+      // bits, a row at a time: 32 bytes per 8x8 tile and 128 bytes per
+      // 16x16 tile.  The data may be in flash and must cover every index
+      // used by the map.  Until it is set the screen shows palette entry 0.
+      void set_tiles(const uint8_t* tiles) { tile_data = tiles; }
+      uint get_tile_size() const { return tile_size; }
+      uint16_t get_map_columns() const { return frame_stride / sizeof(uint16_t); }
+      uint16_t get_map_rows() const { return map_rows; }
+
+      // The screen size.  Unrepeated RGB565, PALETTE_RGB565 and YCBCR420
+      // screens are widened to an even width, and RGB332/RGB222 ones to a
+      // multiple of 4, as lines are sent a word at a time.
       uint16_t get_width() const { return frame_width; }
       uint16_t get_height() const { return frame_height; }
 
+      // Virtual frame buffer: allocate width x height pixels rather than
+      // just the screen, which shows the part of it at the scroll position.
+      // A size of 0 means the screen size.  The width is rounded up to a
+      // whole number of scroll steps (see set_scroll()) or, in the tile
+      // modes, both sizes to whole tiles.  Takes effect at the next init(),
+      // and has no effect on the text modes.
+      void set_virtual_size(uint16_t width, uint16_t height) { requested_virtual_width = width; requested_virtual_height = height; }
+      uint16_t get_virtual_width() const { return virtual_width; }
+      uint16_t get_virtual_height() const { return virtual_height; }
+
+      // Show the virtual frame buffer from (x, y), wrapping round at its
+      // edges, from the start of the next frame.  Scrolling never moves any
+      // pixels, only where each line is read from.  x is rounded down to a
+      // whole step: a byte in the packed palette modes, 2 pixels in the
+      // 16-bit line buffer modes (RGB565 with sprites, PALETTE_RGB565 and
+      // YCBCR420) and a 32-bit word when a direct colour mode isn't
+      // repeating pixels.  Reset to (0, 0) by init().
+      void set_scroll(int x, int y);
+
+      // Raster effects: a list of changes made part way down the screen.
+      // Each applies from the start of a source line (counted before
+      // vertical repeat) to the end of the frame, after which everything is
+      // put back.  Palette changes give gradients and more colours than the
+      // palette holds, scroll changes split the screen into independently
+      // scrolled strips for parallax, and RASTER_ROW shows a virtual frame
+      // buffer row on a line, carrying on down from there.  None of them
+      // need any frame buffer memory.
+      //
+      // set_raster_effects() copies and sorts the list, which is used from
+      // the start of the next frame.  It waits if the last list hasn't been
+      // picked up yet, and returns false if the list is too long or the
+      // display isn't running.  Palette effects only apply to the palette
+      // and tile modes, and there are no effects in the text modes.
+      enum RasterAction : uint8_t {
+        RASTER_PALETTE,   // Set palette entry index to value, as RGB888
+        RASTER_SCROLL,    // Scroll to x | (y << 16), see scroll_effect()
+        RASTER_ROW,       // Show virtual frame buffer row value on this line
+      };
+
+      struct RasterEffect {
+        uint16_t line;
+        RasterAction action;
+        uint8_t index;
+        uint32_t value;
+      };
+
+      static constexpr int MAX_RASTER_EFFECTS = 256;
+
+      static RasterEffect palette_effect(uint16_t line, uint8_t index, RGB888 colour) {
+        return { line, RASTER_PALETTE, index, colour };
+      }
+      static RasterEffect scroll_effect(uint16_t line, int x, int y) {
+        return { line, RASTER_SCROLL, 0, (uint32_t)(uint16_t)x | ((uint32_t)(uint16_t)y << 16) };
+      }
+      static RasterEffect row_effect(uint16_t line, int row) {
+        return { line, RASTER_ROW, 0, (uint32_t)row };
+      }
+
+      bool set_raster_effects(const RasterEffect* effects, int count);
+      void clear_raster_effects() { set_raster_effects(nullptr, 0); }
+
+      // Split screen: horizontal bands, from the top, each either showing
+      // the frame buffer or a band of text.  Frame bands show successive
+      // rows of the frame buffer, which only has as many rows as they do,
+      // so get_height() is their total.  Text bands hold (character, ramp)
+      // byte pairs, see scanline_text_palette(), in get_text_band_columns()
+      // 14 pixel columns by get_text_band_rows() 24 line rows.  They are
+      // drawn from the live buffer, so changes show at once.  Sprites and
+      // raster palette effects apply to every band, but text bands are
+      // never scrolled.
+      //
+      // The last band is stretched or cut short to end at the bottom of
+      // the screen.  Takes effect at the next init(), returns false if
+      // there are too many bands or none of them is a frame band.  Works in
+      // the modes that support the sprite layer, with the same effect on
+      // RGB565.
+      enum BandKind : uint8_t {
+        BAND_FRAME,
+        BAND_TEXT,
+      };
+
+      struct Band {
+        uint16_t lines;         // Source lines, counted before vertical repeat
+        BandKind kind;
+      };
+
+      static constexpr int MAX_BANDS = 4;
+
+      bool set_bands(const Band* bands, int count);
+      void clear_bands() { set_bands(nullptr, 0); }
+
+      // The character cells of band n, or nullptr if it isn't a text band.
+      // Each row is get_text_band_columns() byte pairs.
+      uint8_t* get_text_band(int n) const { return (n >= 0 && n < band_count) ? bands[n].text : nullptr; }
+      uint16_t get_text_band_columns() const { return text_columns; }
+      uint16_t get_text_band_rows(int n) const { return get_text_band(n) ? bands[n].text_rows : 0; }
+
+      // Bytes from one frame buffer row to the next, across the virtual
+      // width.  Packed palette rows are padded to a whole byte, with the
+      // leftmost pixel in the most significant bits.
+      uint get_stride() const { return frame_stride; }
+
+      // In the packed palette modes changes to the palette are picked up
+      // at the start of the next frame.
       RGB888* get_palette();
 
+      // MODE_PALETTE_RGB565 sends a copy of the palette converted to RGB565,
+      // which is only updated at the start of the frame after this is
+      // called.  Has no effect in the other modes.
+      void commit_palette() { palette_commit_pending = true; }
+
+      // Sprite layer: up to MAX_SPRITES images composited over each line as
+      // it is rendered, so moving them never touches the frame buffer.
+      // Works in the modes rendered through line buffers, and also in
+      // RGB565, which then renders a line at a time rather than being
+      // scanned out directly.  Not available in RGB888, RGB332, RGB222 or
+      // the text modes.  At most per_line_limit sprites are drawn on any
+      // one line.  Takes effect at the next init().
+      void set_sprite_layer(bool enable, int per_line_limit = 8, bool collisions = false) {
+        sprite_layer = enable;
+        sprite_line_limit = std::min(std::max(per_line_limit, 1), MAX_SPRITES);
+        sprite_collisions_enabled = collisions;
+      }
+
+      // A sprite is width x height bytes of palette indexes, transparent
+      // where they equal key.  Lower numbered sprites are drawn on top.  The
+      // 16-bit modes use the RGB565 copy of the palette, see
+      // commit_palette().  Sprite changes are picked up at the start of the
+      // next frame, and sprites are hidden until shown.
+      void set_sprite(int n, const uint8_t* image, int width, int height, uint8_t key = 0);
+      void move_sprite(int n, int x, int y);
+      void show_sprite(int n, bool visible);
+
+      // With collisions enabled, bit m is set if sprites n and m had opaque
+      // pixels in the same place on screen in the last complete frame.
+      // Zero if n isn't a sprite.
+      uint32_t get_sprite_collisions(int n) const { return (n >= 0 && n < MAX_SPRITES) ? sprite_collisions[n] : 0; }
+
+      // Sprites left off lines because of the per line limit, since init()
+      uint32_t get_sprite_overflows() const { return sprite_overflows; }
+
+      // On screen display: an image of 4 bits per pixel blended over
+      // everything else, including the sprites, as each line is rendered.
+      // Showing, moving or hiding it never touches the frame buffer.  Rows
+      // are (width + 1) / 2 bytes, leftmost pixel in the most significant
+      // bits, and the image may be smaller than the screen.  Each of its 16
+      // colours has an alpha from 0 (transparent, the default) to 255
+      // (opaque), applied in steps of 1/32.  Works in the same modes as the
+      // sprite layer, and with the same effect on RGB565.  Changes are
+      // picked up at the start of the next frame.  The layer takes effect
+      // at the next init().
+      void set_overlay_layer(bool enable) { overlay_layer = enable; }
+      void set_overlay(const uint8_t* pixels, int width, int height);
+      void move_overlay(int x, int y) { overlay.x = x; overlay.y = y; }
+      void show_overlay(bool visible) { overlay.visible = visible; }
+      void set_overlay_colour(int index, RGB888 colour, uint8_t alpha);
+
+      // Render scanlines on core 1 instead of in the DMA IRQ, keeping
+      // lines_ahead source lines ahead of the display.  Core 1 is then
+      // dedicated to the display.  Takes effect at the next init(), and has
+      // no effect on the direct colour modes (RGB565 without sprites, bands
+      // or the overlay, RGB888, RGB332 and RGB222), which are scanned out
+      // directly.
+      void set_render_core1(bool enable, int lines_ahead = 4) { render_core1 = enable; core1_lines_ahead = lines_ahead; }
+
+      // Scale by exactly h x v on 1280x720 rather than picking a timing
+      // for the size, e.g. 320x240 at 3x3 for a 4:3 picture with borders
+      // either side.  Ignored if the picture wouldn't fit, and 0 picks
+      // automatically.  Takes effect at the next init(), and has no effect
+      // on the text modes.
+      void set_scale(uint8_t h, uint8_t v) { requested_h_scale = h; requested_v_scale = v; }
+
+      // Drive the display with this timing instead of one from the mode
+      // table, e.g. dvi_timing_1280x720p_rb_60hz or one made by
+      // dvi_cvt_rb_timing().  The frame buffer is scaled to fit it as for
+      // 1280x720 above.  The timing is copied, and nullptr goes back to the
+      // table.  Takes effect at the next init(), which fails if the system
+      // PLL can't reach half the bit clock, see set_clock_profile().  The
+      // text modes always use 1280x720.
+      void set_timing(const struct dvi_timing* timing);
+
+      // Pick how the clocks are set up, see ClockProfile.  tolerance_ppm
+      // lets the pixel clock, and so the refresh rate, be that many parts
+      // per million away from the timing, for timings the PLL can't reach
+      // exactly; most displays accept a few thousand.  Takes effect at the
+      // next init(), which fails if no PLL setting is within tolerance.
+      void set_clock_profile(ClockProfile profile, uint32_t tolerance_ppm = 0) { clock_profile = profile; clock_tolerance_ppm = tolerance_ppm; }
+
+      // The HSTX clock set up by init(), half the actual bit clock
+      uint32_t get_hstx_clock_hz() const { return hstx_pll.freq_hz; }
+
+      // The colour of the border round a picture that doesn't fill the
+      // screen, black by default.  Takes effect straight away, at the
+      // precision of the mode.
+      void set_border_colour(RGB888 colour);
+
       bool init(uint16_t width, uint16_t height, Mode mode, bool double_buffered, const DVHSTXPinout &pinout);
       void reset();
 
@@ -103,42 +422,282 @@ namespace pimoroni {
       void flip_async();
       void wait_for_flip();
 
-      // DMA handlers, should not be called externally
-      void gfx_dma_handler();
-      void text_dma_handler();
+      // Line buffer formats.  Each has its own renderer, specialised at
+      // compile time and chosen by init().
+      enum LineFormat {
+        LINE_RGB565,
+        LINE_PALETTE,
+        LINE_PALETTE_RGB565,
+        LINE_YCBCR420,
+        LINE_TILES8,
+        LINE_TILES16,
+        LINE_PALETTE1,
+        LINE_PALETTE2,
+        LINE_PALETTE4,
+        LINE_TEXT_MONO,
+        LINE_TEXT_RGB111,
+      };
 
-      void set_cursor(int x, int y) { cursor_x = x; cursor_y = y; }
-      void cursor_off(void) { cursor_y = -1; }
+      // DMA handlers, should not be called externally
+      void line_dma_handler();
+      void scanout_dma_handler();
+      void core1_main();
+      void core1_render();
+      void core1_begin_frame();
+
+      // The cursor is packed into one word so the renderer never sees a
+      // half updated position.
+      void set_cursor(int x, int y) { cursor_pos = (uint16_t)x | ((uint32_t)(uint16_t)y << 16); }
+      void cursor_off(void) { set_cursor(0, -1); }
+
+      // Scanline IRQ statistics, see DVHSTX_STATS.  The counters are updated
+      // from the IRQ so a copy taken while the display runs may be slightly
+      // inconsistent.
+      static constexpr bool stats_enabled() { return DVHSTX_STATS; }
+      DVHSTXStats get_stats() const;
+      void reset_stats();
+
+      // Lines that couldn't be rendered before the display needed them, in
+      // the line buffer modes, since init().  These lines are sent with the
+      // contents of an earlier line instead, which keeps the display in
+      // sync.  Always counted, whatever DVHSTX_STATS is set to.
+      uint32_t get_substituted_lines() const { return substituted_lines; }
 
     private:
       RGB888 palette[PALETTE_SIZE];
       bool double_buffered;
-      uint8_t* frame_buffer_display;
-      uint8_t* frame_buffer_back;
+      uint8_t* frame_buffer_display = nullptr;
+      uint8_t* frame_buffer_back = nullptr;
       uint32_t* font_cache = nullptr;
+      ScanlineYCbCrTables* ycbcr_tables = nullptr;
+
+      // Chroma planes, MODE_YCBCR420 only
+      uint chroma_stride = 0;
+      uint cb_offset = 0;
+      uint cr_offset = 0;
+      uint plane_offset(Plane plane) const { return plane == PLANE_CB ? cb_offset : plane == PLANE_CR ? cr_offset : 0; }
+
+      // Sprites.  The renderer works from a copy of the sprites taken at
+      // the start of each frame, sorted by y.
+      struct Sprite {
+        const uint8_t* image;
+        int16_t x, y;
+        uint16_t width, height;
+        uint8_t key;
+        uint8_t id;
+        bool visible;
+      };
+      Sprite sprites[MAX_SPRITES];
+      Sprite frame_sprites[MAX_SPRITES];
+      int frame_sprite_count = 0;
+      bool sprite_layer = false;
+      int sprite_line_limit = 8;
+      bool sprite_collisions_enabled = false;
+      uint32_t sprite_hits[MAX_SPRITES];
+      volatile uint32_t sprite_collisions[MAX_SPRITES];
+      volatile uint32_t sprite_overflows = 0;
+
+      // composite_sprites() is only ever inlined into the functions for
+      // 16 and 32-bit lines, which can be placed in RAM as a template can't
+      void sprites_begin_frame();
+      template<class P> void composite_sprites(P* dst, const P* colours, int y);
+      void composite_sprites_rgb565(uint16_t* dst, int y);
+      void composite_sprites_rgb888(uint32_t* dst, int y);
+      void update_palette_rgb565();
+
+      // Overlay, also copied at the start of each frame
+      struct Overlay {
+        const uint8_t* pixels;
+        uint16_t width, height;
+        int16_t x, y;
+        bool visible;
+      };
+      Overlay overlay = {};
+      Overlay frame_overlay = {};
+      bool overlay_layer = false;
+      uint32_t overlay_colours[SCANLINE_BLEND_COLOURS] = {};
+      ScanlineBlend overlay_blend[SCANLINE_BLEND_COLOURS];
+
+      // blend_overlay() is inlined into the RAM functions for each line
+      // size, as composite_sprites() is
+      void overlay_begin_frame();
+      void begin_line_frame();
+      template<class P> void blend_overlay(P* dst, int y);
+      void blend_overlay_rgb565(uint16_t* dst, int y);
+      void blend_overlay_rgb888(uint32_t* dst, int y);
+
+      // Virtual frame buffer and scrolling.  The scroll position is packed
+      // into one word, as the cursor is, and the renderer takes a copy at
+      // the start of each frame.
+      uint16_t requested_virtual_width = 0;
+      uint16_t requested_virtual_height = 0;
+      uint16_t virtual_width = 0;
+      uint16_t virtual_height = 0;
+      uint scroll_x_step = 1;
+      volatile uint32_t scroll_pos = 0;
+      uint32_t frame_scroll_pos = 0;
+      uint frame_scroll_x = 0;
+      uint frame_scroll_y = 0;
+
+      bool latch_scroll();
+      int scrolled_row(int y) const;
+      template<class S> void scroll_spans(S span) const;
+
+      // Raster effects, double buffered.  set_raster_effects() fills the
+      // spare list and the renderer switches to it at the start of a frame.
+      // Frames with palette effects are drawn from a copy of the palette.
+      RasterEffect raster_lists[2][MAX_RASTER_EFFECTS];
+      int raster_counts[2];
+      bool raster_has_palette[2];
+      int raster_active = 0;
+      int raster_next = 0;
+      volatile bool raster_commit_pending = false;
+      RGB888 raster_palette[PALETTE_SIZE];
+
+      bool raster_begin_frame();
+      bool apply_raster_effects(int y);
+
+      // Split screen, set up by init() from the requested bands.  Without
+      // any there is one frame band covering the screen.
+      struct BandLayout {
+        uint16_t first_line;
+        uint16_t end_line;
+        int16_t frame_offset;   // Source line minus frame buffer line
+        uint16_t text_rows;
+        uint8_t* text;          // Character cells, text bands only
+      };
+      Band requested_bands[MAX_BANDS];
+      int requested_band_count = 0;
+      BandLayout bands[MAX_BANDS];
+      int band_count = 0;
+      uint16_t text_columns = 0;
+      uint8_t* text_cells = nullptr;
+
+      const BandLayout* band_at(int y) const;
+
+      // Tile modes only
+      const uint8_t* volatile tile_data = nullptr;
+      uint tile_size = 0;
+      uint16_t map_rows = 0;
 
       void display_setup_clock();
 
       // DMA scanline filling
-      uint ch_num = 0;
-      int line_num = -1;
+      int line_num = 0;
 
       volatile int v_scanline = 2;
+      volatile uint32_t frame_counter = 0;
+      volatile uint32_t substituted_lines = 0;
       volatile bool flip_next;
 
       bool inited = false;
+      void free_buffers();
+
+      uint32_t* line_buffers = nullptr;
+      int line_buffer_count;
+      uint line_buffer_words;
+      int source_lines;
+
+      // Per line constants for the DMA handlers, set up by init()
+      uint32_t* next_line_buffer;
+      uint32_t* line_buffers_end = nullptr;
+      uint line_src_stride;
+
+      // Scanout blocks per output line, as a shift
+      uint line_block_shift = 0;
+
+      // The first output line of each source line, plus one entry for the
+      // end of the frame, see init()
+      uint16_t* source_first_line = nullptr;
+      uint line_first_block(int y) const;
+
+      // Border round the picture when it doesn't fill the screen, in
+      // pixels and lines.  Only the picture lines have scanout blocks.
+      uint border_left = 0;
+      uint border_right = 0;
+      uint border_top = 0;
+      uint border_bottom = 0;
+      int picture_lines;
+      uint line_trailer_offset = 0;
+      RGB888 border_colour = 0;
+      uint8_t requested_h_scale = 0;
+      uint8_t requested_v_scale = 0;
+      void update_border();
+
+      uint scanout_next_block() const;
+      uint scanout_finished_block(uint next) const;
+      uint blocks_ahead(uint from, uint to) const;
+      int advance_line();
+      uint32_t* line_buffer(int n);
+      void bind_line_buffer(int y, const uint32_t* buf);
+      // render_line_format() is inlined into a function for each format,
+      // which can be placed in RAM as a template can't
+      template<LineFormat F> void render_line_format(uint32_t* buf, int y);
+      void render_line_rgb565(uint32_t* buf, int y);
+      void render_line_palette(uint32_t* buf, int y);
+      void render_line_palette_rgb565(uint32_t* buf, int y);
+      void render_line_ycbcr420(uint32_t* buf, int y);
+      void render_line_tiles8(uint32_t* buf, int y);
+      void render_line_tiles16(uint32_t* buf, int y);
+      void render_line_palette1(uint32_t* buf, int y);
+      void render_line_palette2(uint32_t* buf, int y);
+      void render_line_palette4(uint32_t* buf, int y);
+      void render_line_text_mono(uint32_t* buf, int y);
+      void render_line_text_rgb111(uint32_t* buf, int y);
+
+      // Commands for the whole of vertical blanking
+      uint32_t* vblank_list = nullptr;
+      uint vblank_list_len;
+
+      // Direct scanout: a control DMA channel feeds a list of blocks to the
+      // data channel, which reads the frame buffer rows straight into HSTX.
+      struct ScanoutBlock;
+      bool direct_scanout = false;
+      ScanoutBlock* scanout_list = nullptr;
+      uint scanout_list_len;
+      ScanoutBlock* scanout_rows;
+      uint scanout_row_blocks;
+      uintptr_t scanout_list_base;
+      uint scanout_pixel_shift;
+
+      bool build_vblank_list();
+      bool build_scanout_list();
+      void update_scanout_rows();
 
-      uint32_t* line_buffers;
       const struct dvi_timing* timing_mode;
+      struct dvi_timing custom_timing;
+      bool use_custom_timing = false;
+      ClockProfile clock_profile = CLOCK_EXACT_PIXEL;
+      uint32_t clock_tolerance_ppm = 0;
+      struct dvi_pll_config hstx_pll = {};
       int v_inactive_total;
       int v_total_active_lines;
 
-      uint h_repeat_shift;
-      uint v_repeat_shift;
       int line_bytes_per_pixel;
 
       uint32_t* display_palette = nullptr;
-
-      int cursor_x, cursor_y;
+      uint32_t packed_lut[SCANLINE_PACKED_LUT_WORDS];
+      uint16_t palette_rgb565[PALETTE_SIZE];
+      volatile bool palette_commit_pending;
+
+      volatile uint32_t cursor_pos;
+
+      // Core 1 rendering
+      bool render_core1 = false;
+      int core1_lines_ahead = 4;
+      volatile bool core1_running = false;
+      uint32_t core1_rendered;
+      int core1_next_buffer;
+      uint32_t core1_frame;
+      uint core1_last_block;
+
+      // Renderer for the mode, one of the render_line_ functions
+      void (DVHSTX::*render_line_fn)(uint32_t* buf, int y);
+      __force_inline void render_line(uint32_t* buf, int y) { bind_line_buffer(y, buf); (this->*render_line_fn)(buf, y); }
+
+#if DVHSTX_STATS
+      DVHSTXStats stats;
+#endif
+      void record_irq(DVHSTXStats::LineClass line_class, uint32_t start_cycles);
   };
 }
@@ -0,0 +1,402 @@
+#include <string.h>
+
+#include "dvhstx_scanline.hpp"
+#include "font.h"
+
+// If changing the font, note this code will not handle glyphs wider than 13 pixels
+#define FONT (&intel_one_mono)
+
+namespace pimoroni {
+
+void __dvhstx_scanline_func(scanline_rgb565)(uint32_t* dst, const uint16_t* src, int src_pixels) {
+    memcpy(dst, src, src_pixels * sizeof(uint16_t));
+}
+
+void __dvhstx_scanline_func(scanline_palette)(uint32_t* dst, const uint8_t* src, const uint32_t* palette, int src_pixels) {
+    for (int i = 0; i < src_pixels; ++i) {
+        *dst++ = palette[*src++];
+    }
+}
+
+void __dvhstx_scanline_func(scanline_build_palette_rgb565)(uint16_t* dst, const uint32_t* palette) {
+    for (int i = 0; i < 256; ++i) {
+        dst[i] = scanline_rgb888_to_rgb565(palette[i]);
+    }
+}
+
+void __dvhstx_scanline_func(scanline_palette_rgb565)(uint32_t* dst, const uint8_t* src, const uint16_t* palette, int src_pixels) {
+    for (int i = 0; i < src_pixels - 1; i += 2) {
+        *dst++ = palette[src[0]] | ((uint32_t)palette[src[1]] << 16);
+        src += 2;
+    }
+    if (src_pixels & 1) *dst = palette[*src];
+}
+
+void scanline_build_ycbcr_tables(ScanlineYCbCrTables* tables) {
+    // Coefficients in 16.16 fixed point, rounded to the nearest integer
+    for (int i = 0; i < 256; ++i) {
+        const int c = i - 128;
+        tables->cr_r[i] = SCANLINE_YCBCR_CLAMP_OFFSET + ((91881 * c + 32768) >> 16);
+        tables->cb_g[i] = SCANLINE_YCBCR_CLAMP_OFFSET + ((-22554 * c + 32768) >> 16);
+        tables->cr_g[i] = (-46802 * c + 32768) >> 16;
+        tables->cb_b[i] = SCANLINE_YCBCR_CLAMP_OFFSET + ((116130 * c + 32768) >> 16);
+    }
+    for (int i = 0; i < SCANLINE_YCBCR_CLAMP_OFFSET * 3; ++i) {
+        const int v = i - SCANLINE_YCBCR_CLAMP_OFFSET;
+        tables->clamp[i] = (v < 0) ? 0 : (v > 255) ? 255 : v;
+    }
+}
+
+static inline __attribute__((always_inline)) uint32_t ycbcr_to_rgb565(const uint8_t* clamp, int y, int dr, int dg, int db) {
+    return ((clamp[y + dr] & 0xf8) << 8) | ((clamp[y + dg] & 0xfc) << 3) | (clamp[y + db] >> 3);
+}
+
+void __dvhstx_scanline_func(scanline_ycbcr420)(uint32_t* dst, const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+                                               const ScanlineYCbCrTables* tables, int src_pixels) {
+    const uint8_t* clamp = tables->clamp;
+    for (int i = 0; i < src_pixels - 1; i += 2) {
+        const int b = *cb++, r = *cr++;
+        const int dr = tables->cr_r[r], dg = tables->cb_g[b] + tables->cr_g[r], db = tables->cb_b[b];
+        *dst++ = ycbcr_to_rgb565(clamp, y[0], dr, dg, db) | (ycbcr_to_rgb565(clamp, y[1], dr, dg, db) << 16);
+        y += 2;
+    }
+    if (src_pixels & 1) {
+        const int b = *cb, r = *cr;
+        *dst = ycbcr_to_rgb565(clamp, *y, tables->cr_r[r], tables->cb_g[b] + tables->cr_g[r], tables->cb_b[b]);
+    }
+}
+
+void __dvhstx_scanline_func(scanline_build_packed_lut)(uint32_t* lut, const uint32_t* palette, int bits_per_pixel) {
+    const int pixels_per_nibble = 4 / bits_per_pixel;
+    const uint32_t mask = (1u << bits_per_pixel) - 1;
+    for (uint32_t n = 0; n < 16; ++n) {
+        for (int i = 0; i < pixels_per_nibble; ++i) {
+            *lut++ = palette[(n >> (4 - bits_per_pixel * (i + 1))) & mask];
+        }
+    }
+}
+
+// Each source byte holds two nibbles, the left one in the high bits, and
+// each nibble expands to the LUT entry holding its pixels.
+template<int BITS_PER_PIXEL>
+static inline __attribute__((always_inline)) void scanline_packed(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels) {
+    constexpr int PIXELS_PER_NIBBLE = 4 / BITS_PER_PIXEL;
+    for (int i = src_pixels / (2 * PIXELS_PER_NIBBLE); i > 0; --i) {
+        const uint32_t b = *src++;
+        const uint32_t* hi = &lut[(b >> 4) * PIXELS_PER_NIBBLE];
+        const uint32_t* lo = &lut[(b & 0xf) * PIXELS_PER_NIBBLE];
+        for (int j = 0; j < PIXELS_PER_NIBBLE; ++j) dst[j] = hi[j];
+        for (int j = 0; j < PIXELS_PER_NIBBLE; ++j) dst[PIXELS_PER_NIBBLE + j] = lo[j];
+        dst += 2 * PIXELS_PER_NIBBLE;
+    }
+
+    // Frame buffer rows are padded to a whole byte
+    const int tail = src_pixels % (2 * PIXELS_PER_NIBBLE);
+    if (tail) {
+        const uint32_t b = *src;
+        const uint32_t* hi = &lut[(b >> 4) * PIXELS_PER_NIBBLE];
+        const uint32_t* lo = &lut[(b & 0xf) * PIXELS_PER_NIBBLE];
+        for (int j = 0; j < tail; ++j) {
+            dst[j] = (j < PIXELS_PER_NIBBLE) ? hi[j] : lo[j - PIXELS_PER_NIBBLE];
+        }
+    }
+}
+
+void __dvhstx_scanline_func(scanline_palette1)(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels) {
+    scanline_packed<1>(dst, src, lut, src_pixels);
+}
+
+void __dvhstx_scanline_func(scanline_palette2)(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels) {
+    scanline_packed<2>(dst, src, lut, src_pixels);
+}
+
+void __dvhstx_scanline_func(scanline_palette4)(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels) {
+    scanline_packed<4>(dst, src, lut, src_pixels);
+}
+
+template<int SIZE>
+static inline __attribute__((always_inline)) void scanline_tiles(uint32_t* dst, const uint16_t* map, const uint8_t* tiles, const uint32_t* palette, int tile_y, int src_pixels) {
+    constexpr int ROW_BYTES = SIZE / 2;
+    constexpr int TILE_BYTES = ROW_BYTES * SIZE;
+    for (; src_pixels > 0; src_pixels -= SIZE) {
+        const uint32_t entry = *map++;
+        const int row = (entry & SCANLINE_TILE_VFLIP) ? SIZE - 1 - tile_y : tile_y;
+        const uint8_t* src = tiles + (entry & SCANLINE_TILE_INDEX_MASK) * TILE_BYTES + row * ROW_BYTES;
+        const uint32_t* bank = palette + ((entry >> SCANLINE_TILE_BANK_SHIFT) << 4);
+
+        if (src_pixels < SIZE) {
+            // Partial tile at the right hand edge
+            for (int x = 0; x < src_pixels; ++x) {
+                const int sx = (entry & SCANLINE_TILE_HFLIP) ? SIZE - 1 - x : x;
+                const uint32_t bits = src[sx >> 1];
+                *dst++ = bank[(sx & 1) ? (bits & 0xf) : (bits >> 4)];
+            }
+        }
+        else if (entry & SCANLINE_TILE_HFLIP) {
+            for (int i = ROW_BYTES - 1; i >= 0; --i) {
+                const uint32_t bits = src[i];
+                dst[0] = bank[bits & 0xf];
+                dst[1] = bank[bits >> 4];
+                dst += 2;
+            }
+        }
+        else {
+            for (int i = 0; i < ROW_BYTES; ++i) {
+                const uint32_t bits = src[i];
+                dst[0] = bank[bits >> 4];
+                dst[1] = bank[bits & 0xf];
+                dst += 2;
+            }
+        }
+    }
+}
+
+void __dvhstx_scanline_func(scanline_tiles8)(uint32_t* dst, const uint16_t* map, const uint8_t* tiles, const uint32_t* palette, int tile_y, int src_pixels) {
+    scanline_tiles<8>(dst, map, tiles, palette, tile_y, src_pixels);
+}
+
+void __dvhstx_scanline_func(scanline_tiles16)(uint32_t* dst, const uint16_t* map, const uint8_t* tiles, const uint32_t* palette, int tile_y, int src_pixels) {
+    scanline_tiles<16>(dst, map, tiles, palette, tile_y, src_pixels);
+}
+
+// RGB565 with each field moved clear of the next, so all three can be
+// multiplied by an alpha of up to 32 at once
+static inline uint32_t spread_rgb565(uint32_t c) {
+    return (c | (c << 16)) & 0x07e0f81f;
+}
+
+void __dvhstx_scanline_func(scanline_build_blend)(ScanlineBlend* blend, const uint32_t* colours) {
+    for (int i = 0; i < SCANLINE_BLEND_COLOURS; ++i) {
+        const uint32_t c = colours[i];
+        const uint32_t alpha = ((c >> 24) * SCANLINE_BLEND_OPAQUE + 127) / 255;
+        blend[i].rb = (c & 0xff00ff) * alpha;
+        blend[i].g = (c & 0x00ff00) * alpha;
+        blend[i].rgb565 = spread_rgb565(scanline_rgb888_to_rgb565(c)) * alpha;
+        blend[i].inv_alpha = SCANLINE_BLEND_OPAQUE - alpha;
+    }
+}
+
+template<class P, class B>
+static inline __attribute__((always_inline)) void blend4(P* dst, const uint8_t* src, int src_x, const ScanlineBlend* blend, int pixels, B blend_pixel) {
+    src += src_x >> 1;
+    int shift = (src_x & 1) ? 0 : 4;
+    for (int i = 0; i < pixels; ++i) {
+        const ScanlineBlend& b = blend[(*src >> shift) & 0xf];
+        if (b.inv_alpha != SCANLINE_BLEND_OPAQUE) dst[i] = blend_pixel(dst[i], b);
+        if (shift) shift = 0;
+        else { shift = 4; ++src; }
+    }
+}
+
+void __dvhstx_scanline_func(scanline_blend4)(uint32_t* dst, const uint8_t* src, int src_x, const ScanlineBlend* blend, int pixels) {
+    blend4(dst, src, src_x, blend, pixels, [](uint32_t d, const ScanlineBlend& b) {
+        return (((d & 0xff00ff) * b.inv_alpha + b.rb) >> 5 & 0xff00ff) |
+               (((d & 0x00ff00) * b.inv_alpha + b.g) >> 5 & 0x00ff00);
+    });
+}
+
+void __dvhstx_scanline_func(scanline_blend4_rgb565)(uint16_t* dst, const uint8_t* src, int src_x, const ScanlineBlend* blend, int pixels) {
+    blend4(dst, src, src_x, blend, pixels, [](uint16_t d, const ScanlineBlend& b) {
+        const uint32_t c = ((spread_rgb565(d) * b.inv_alpha + b.rgb565) >> 5) & 0x07e0f81f;
+        return (uint16_t)(c | (c >> 16));
+    });
+}
+
+static inline __attribute__((always_inline)) uint32_t render_char_line(int c, int y) {
+    if (c < 0x20 || c > 0x7e) return 0;
+    const lv_font_fmt_txt_glyph_dsc_t* g = &FONT->dsc->glyph_dsc[c - 0x20 + 1];
+    const uint8_t *b = FONT->dsc->glyph_bitmap + g->bitmap_index;
+    const int ey = y - FONT_HEIGHT + FONT->base_line + g->ofs_y + g->box_h;
+    if (ey < 0 || ey >= g->box_h || g->box_w == 0) {
+        return 0;
+    }
+    else {
+        int bi = (g->box_w * ey);
+
+        uint32_t bits = (b[bi >> 2] << 24) | (b[(bi >> 2) + 1] << 16) | (b[(bi >> 2) + 2] << 8) | b[(bi >> 2) + 3];
+        bits >>= 6 - ((bi & 3) << 1);
+        bits &= 0x3ffffff & (0x3ffffff << ((13 - g->box_w) << 1));
+        bits >>= g->ofs_x << 1;
+
+        return bits;
+    }
+}
+
+uint32_t scanline_render_char_line(int c, int y) {
+    return render_char_line(c, y);
+}
+
+void scanline_build_font_cache(uint32_t* font_cache) {
+    uint32_t* font_cache_ptr = font_cache;
+    for (int c = 0x20; c < 128; ++c) {
+        for (int y = 0; y < FONT->line_height; ++y) {
+            *font_cache_ptr++ = render_char_line(c, y);
+        }
+    }
+}
+
+void __dvhstx_scanline_func(scanline_text_mono)(uint32_t* dst, const uint8_t* src, int src_chars, int char_y) {
+    for (int i = 0; i < src_chars; ++i) {
+        *dst++ = render_char_line(*src++, char_y);
+    }
+}
+
+static inline __attribute__((always_inline)) uint8_t* text_rgb111_char(uint8_t* dst_ptr, uint32_t bits, uint8_t colour) {
+    *dst_ptr++ = colour * ((bits >> 24) & 3);
+    *dst_ptr++ = colour * ((bits >> 22) & 3);
+    *dst_ptr++ = colour * ((bits >> 20) & 3);
+    *dst_ptr++ = colour * ((bits >> 18) & 3);
+    *dst_ptr++ = colour * ((bits >> 16) & 3);
+    *dst_ptr++ = colour * ((bits >> 14) & 3);
+    *dst_ptr++ = colour * ((bits >> 12) & 3);
+    *dst_ptr++ = colour * ((bits >> 10) & 3);
+    *dst_ptr++ = colour * ((bits >> 8) & 3);
+    *dst_ptr++ = colour * ((bits >> 6) & 3);
+    *dst_ptr++ = colour * ((bits >> 4) & 3);
+    *dst_ptr++ = colour * ((bits >> 2) & 3);
+    *dst_ptr++ = colour * (bits & 3);
+    *dst_ptr++ = 0;
+    return dst_ptr;
+}
+
+void __dvhstx_scanline_func(scanline_text_rgb111)(uint8_t* dst, const uint8_t* src, const uint32_t* font_cache, int src_chars, int char_y) {
+    uint8_t* dst_ptr = dst;
+    const uint8_t* src_ptr = src;
+#if !defined(__arm__)
+    for (int i = 0; i < src_chars; ++i) {
+        const uint8_t c = (*src_ptr++ - 0x20);
+        uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
+        const uint8_t colour = *src_ptr++;
+
+        dst_ptr = text_rgb111_char(dst_ptr, bits, colour);
+    }
+#else
+    int i = 0;
+    for (; i < src_chars-1; i += 2) {
+        uint8_t c = (*src_ptr++ - 0x20);
+        uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
+        uint8_t colour = *src_ptr++;
+        c = (*src_ptr++ - 0x20);
+        uint32_t bits2 = (c < 95) ? font_cache[c * 24 + char_y] : 0;
+        uint8_t colour2 = *src_ptr++;
+
+        // This ASM works around a compiler bug where the optimizer decides
+        // to unroll so hard it spills to the stack.
+        uint32_t tmp, tmp2;
+        asm volatile (
+            "ubfx %[tmp], %[cbits], #24, #2\n\t"
+            "ubfx %[tmp2], %[cbits], #22, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "ubfx %[tmp2], %[cbits], #20, #2\n\t"
+            "bfi %[tmp], %[tmp2], #16, #8\n\t"
+            "ubfx %[tmp2], %[cbits], #18, #2\n\t"
+            "bfi %[tmp], %[tmp2], #24, #8\n\t"
+            "muls %[tmp], %[colour], %[tmp]\n\t"
+            "str %[tmp], [%[dst_ptr]]\n\t"
+
+            "ubfx %[tmp], %[cbits], #16, #2\n\t"
+            "ubfx %[tmp2], %[cbits], #14, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "ubfx %[tmp2], %[cbits], #12, #2\n\t"
+            "bfi %[tmp], %[tmp2], #16, #8\n\t"
+            "ubfx %[tmp2], %[cbits], #10, #2\n\t"
+            "bfi %[tmp], %[tmp2], #24, #8\n\t"
+            "muls %[tmp], %[colour], %[tmp]\n\t"
+            "str %[tmp], [%[dst_ptr], #4]\n\t"
+
+            "ubfx %[tmp], %[cbits], #8, #2\n\t"
+            "ubfx %[tmp2], %[cbits], #6, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "ubfx %[tmp2], %[cbits], #4, #2\n\t"
+            "bfi %[tmp], %[tmp2], #16, #8\n\t"
+            "ubfx %[tmp2], %[cbits], #2, #2\n\t"
+            "bfi %[tmp], %[tmp2], #24, #8\n\t"
+            "muls %[tmp], %[colour], %[tmp]\n\t"
+            "str %[tmp], [%[dst_ptr], #8]\n\t"
+
+            "ubfx %[tmp], %[cbits2], #24, #2\n\t"
+            "ubfx %[tmp2], %[cbits2], #22, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "muls %[tmp], %[colour2], %[tmp]\n\t"
+            "and %[tmp2], %[cbits], #3\n\t"
+            "muls %[tmp2], %[colour], %[tmp2]\n\t"
+            "bfi %[tmp2], %[tmp], #16, #16\n\t"
+            "str %[tmp2], [%[dst_ptr], #12]\n\t"
+
+            "ubfx %[tmp], %[cbits2], #20, #2\n\t"
+            "ubfx %[tmp2], %[cbits2], #18, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "ubfx %[tmp2], %[cbits2], #16, #2\n\t"
+            "bfi %[tmp], %[tmp2], #16, #8\n\t"
+            "ubfx %[tmp2], %[cbits2], #14, #2\n\t"
+            "bfi %[tmp], %[tmp2], #24, #8\n\t"
+            "muls %[tmp], %[colour2], %[tmp]\n\t"
+            "str %[tmp], [%[dst_ptr], #16]\n\t"
+
+            "ubfx %[tmp], %[cbits2], #12, #2\n\t"
+            "ubfx %[tmp2], %[cbits2], #10, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "ubfx %[tmp2], %[cbits2], #8, #2\n\t"
+            "bfi %[tmp], %[tmp2], #16, #8\n\t"
+            "ubfx %[tmp2], %[cbits2], #6, #2\n\t"
+            "bfi %[tmp], %[tmp2], #24, #8\n\t"
+            "muls %[tmp], %[colour2], %[tmp]\n\t"
+            "str %[tmp], [%[dst_ptr], #20]\n\t"
+
+            "ubfx %[tmp], %[cbits2], #4, #2\n\t"
+            "ubfx %[tmp2], %[cbits2], #2, #2\n\t"
+            "bfi %[tmp], %[tmp2], #8, #8\n\t"
+            "bfi %[tmp], %[cbits2], #16, #2\n\t"
+            "muls %[tmp], %[colour2], %[tmp]\n\t"
+            "str %[tmp], [%[dst_ptr], #24]\n\t"
+            : [tmp] "=&l" (tmp),
+              [tmp2] "=&l" (tmp2)
+            : [cbits] "r" (bits),
+              [colour] "l" (colour),
+              [cbits2] "r" (bits2),
+              [colour2] "l" (colour2),
+              [dst_ptr] "r" (dst_ptr)
+            : "cc", "memory" );
+        dst_ptr += 14 * 2;
+    }
+    if (i != src_chars) {
+        const uint8_t c = (*src_ptr++ - 0x20);
+        uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
+        const uint8_t colour = *src_ptr++;
+
+        text_rgb111_char(dst_ptr, bits, colour);
+    }
+#endif
+}
+
+void __dvhstx_scanline_func(scanline_text_cursor)(uint8_t* dst, int cursor_x) {
+    uint8_t* dst_ptr = dst + SCANLINE_TEXT_CHAR_WIDTH * cursor_x;
+    for (int i = 0; i < SCANLINE_TEXT_CHAR_WIDTH - 1; ++i) {
+        *dst_ptr++ ^= 0xff;
+    }
+}
+
+// The glyph's 13 columns of 2-bit coverage each pick an entry of the ramp,
+// and the 14th column is always background.
+template<class P>
+static inline __attribute__((always_inline)) void text_palette(P* dst, const uint8_t* src, const uint32_t* font_cache, const P* palette, int src_chars, int char_y) {
+    for (int i = 0; i < src_chars; ++i) {
+        const uint8_t c = (*src++ - 0x20);
+        const uint32_t bits = (c < 95) ? font_cache[c * 24 + char_y] : 0;
+        const P* ramp = &palette[(*src++ & (SCANLINE_TEXT_RAMPS - 1)) << 2];
+        for (int shift = 24; shift >= 0; shift -= 2) {
+            *dst++ = ramp[(bits >> shift) & 3];
+        }
+        *dst++ = ramp[0];
+    }
+}
+
+void __dvhstx_scanline_func(scanline_text_palette)(uint32_t* dst, const uint8_t* src, const uint32_t* font_cache, const uint32_t* palette, int src_chars, int char_y) {
+    text_palette(dst, src, font_cache, palette, src_chars, char_y);
+}
+
+void __dvhstx_scanline_func(scanline_text_palette_rgb565)(uint16_t* dst, const uint8_t* src, const uint32_t* font_cache, const uint16_t* palette, int src_chars, int char_y) {
+    text_palette(dst, src, font_cache, palette, src_chars, char_y);
+}
+
+}
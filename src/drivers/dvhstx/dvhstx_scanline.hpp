@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scanline expansion kernels for the DVHSTX driver.
+//
+// Each kernel turns one line of the frame buffer into the data words that
+// follow the line header in an HSTX line buffer.  They have no dependency on
+// the DMA or HSTX hardware, so they can also be built on a host machine by
+// defining DVHSTX_HOST_BUILD, e.g. for benchmarking or comparing against
+// golden output.
+//
+// Naming is scanline_<format>.  src_pixels is always the number of source
+// pixels (or characters for the text kernels) to expand.
+//
+// Lines are only ever expanded at source resolution: where a format has one
+// 32-bit word per source pixel the HSTX expander repeats each word
+// horizontally (ENC_N_SHIFTS with a shift that maps the pixel back onto
+// itself), and RGB565 lines are read 16 bits at a time by the scanout list
+// to repeat them, so a single kernel serves every repeat.
+
+#ifdef DVHSTX_HOST_BUILD
+#include "host/pico_host.hpp"
+#else
+#include "pico/platform.h"
+#endif
+#define __dvhstx_scanline_func(func_name) __not_in_flash_func(func_name)
+
+namespace pimoroni {
+
+  // RGB565: two pixels per 32-bit word
+  void scanline_rgb565(uint32_t* dst, const uint16_t* src, int src_pixels);
+
+  // 8 bit palette lookup into RGB888: one source pixel per 32-bit word,
+  // horizontal repeat is done entirely by the expander.
+  void scanline_palette(uint32_t* dst, const uint8_t* src, const uint32_t* palette, int src_pixels);
+
+  // 8 bit palette lookup into RGB565: two source pixels per 32-bit word,
+  // which the scanout list reads 16 bits at a time to repeat them.  The
+  // palette is converted by scanline_build_palette_rgb565().
+  static __force_inline uint16_t scanline_rgb888_to_rgb565(uint32_t c) {
+    return ((c >> 8) & 0xf800) | ((c >> 5) & 0x07e0) | ((c >> 3) & 0x001f);
+  }
+  void scanline_build_palette_rgb565(uint16_t* dst, const uint32_t* palette);
+  void scanline_palette_rgb565(uint32_t* dst, const uint8_t* src, const uint16_t* palette, int src_pixels);
+
+  // YCbCr 4:2:0 to RGB565, full range BT.601 as used by JPEG.  Each pair
+  // of source pixels shares a Cb and a Cr sample, and is written as one
+  // 32-bit word in the same layout as scanline_palette_rgb565().  The
+  // conversion is all table lookups, see scanline_build_ycbcr_tables().
+  static constexpr int SCANLINE_YCBCR_CLAMP_OFFSET = 256;
+
+  struct ScanlineYCbCrTables {
+    // Colour differences for each chroma value.  cr_r, cb_g and cb_b
+    // include SCANLINE_YCBCR_CLAMP_OFFSET, so Y plus the difference
+    // indexes clamp directly.
+    int16_t cr_r[256];
+    int16_t cb_g[256];
+    int16_t cr_g[256];
+    int16_t cb_b[256];
+    uint8_t clamp[SCANLINE_YCBCR_CLAMP_OFFSET * 3];
+  };
+
+  void scanline_build_ycbcr_tables(ScanlineYCbCrTables* tables);
+  void scanline_ycbcr420(uint32_t* dst, const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+                         const ScanlineYCbCrTables* tables, int src_pixels);
+
+  // Tile maps: each 16-bit map entry selects a tile, which may be flipped,
+  // and one of 16 banks of 16 palette entries.  Tiles are 4 bits per pixel,
+  // packed as for scanline_palette4(), one row after another.  tile_y is
+  // the line within the tiles of this map row, src_pixels the pixels to
+  // render, which needn't be a whole number of tiles.
+  static constexpr uint16_t SCANLINE_TILE_INDEX_MASK = 0x03ff;
+  static constexpr uint16_t SCANLINE_TILE_HFLIP = 0x0400;
+  static constexpr uint16_t SCANLINE_TILE_VFLIP = 0x0800;
+  static constexpr int SCANLINE_TILE_BANK_SHIFT = 12;
+
+  void scanline_tiles8(uint32_t* dst, const uint16_t* map, const uint8_t* tiles, const uint32_t* palette, int tile_y, int src_pixels);
+  void scanline_tiles16(uint32_t* dst, const uint16_t* map, const uint8_t* tiles, const uint32_t* palette, int tile_y, int src_pixels);
+
+  // Packed 1, 2 and 4 bit palette lookup into RGB888, leftmost pixel in the
+  // most significant bits of each byte.  Each nibble of the source is
+  // looked up in a LUT holding the RGB888 words for its 4, 2 or 1 pixels,
+  // which scanline_build_packed_lut() fills from the palette.
+  static constexpr int SCANLINE_PACKED_LUT_WORDS = 16 * 4;
+
+  void scanline_build_packed_lut(uint32_t* lut, const uint32_t* palette, int bits_per_pixel);
+
+  void scanline_palette1(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels);
+  void scanline_palette2(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels);
+  void scanline_palette4(uint32_t* dst, const uint8_t* src, const uint32_t* lut, int src_pixels);
+
+  // Overlay blending: 4 bits per pixel, packed as for scanline_palette4(),
+  // blended over a line that has already been rendered.  Each of the 16
+  // colours has its own alpha, in steps of 1/32, premultiplied into a
+  // ScanlineBlend entry by scanline_build_blend() so blending a pixel is a
+  // multiply and an add per pair of channels.  src_x is the first pixel of
+  // src to blend, which needn't be at the start of a byte.
+  static constexpr int SCANLINE_BLEND_COLOURS = 16;
+  static constexpr uint32_t SCANLINE_BLEND_OPAQUE = 32;
+
+  struct ScanlineBlend {
+    uint32_t rb;            // Red and blue times alpha, RGB888
+    uint32_t g;             // Green times alpha, RGB888
+    uint32_t rgb565;        // RGB565 spread across 32 bits, times alpha
+    uint32_t inv_alpha;     // SCANLINE_BLEND_OPAQUE - alpha
+  };
+
+  // colours are RGB888 with an 8-bit alpha in the top byte
+  void scanline_build_blend(ScanlineBlend* blend, const uint32_t* colours);
+  void scanline_blend4(uint32_t* dst, const uint8_t* src, int src_x, const ScanlineBlend* blend, int pixels);
+  void scanline_blend4_rgb565(uint16_t* dst, const uint8_t* src, int src_x, const ScanlineBlend* blend, int pixels);
+
+  // Text modes: one character cell is 14 pixels wide, char_y is the line
+  // within the 24 line character cell.
+  static constexpr int SCANLINE_TEXT_CHAR_WIDTH = 14;
+  static constexpr int SCANLINE_TEXT_CHAR_HEIGHT = 24;
+
+  // Words needed by scanline_build_font_cache()
+  static constexpr int SCANLINE_FONT_CACHE_WORDS = 96 * SCANLINE_TEXT_CHAR_HEIGHT;
+
+  // Render the 2bpp glyph bits for one line of a character
+  uint32_t scanline_render_char_line(int c, int y);
+
+  // Pre-render every printable glyph so the RGB111 kernel can keep up
+  void scanline_build_font_cache(uint32_t* font_cache);
+
+  // Mono text: one 32-bit word of 2bpp glyph bits per character
+  void scanline_text_mono(uint32_t* dst, const uint8_t* src, int src_chars, int char_y);
+
+  // RGB111 text: src holds (character, attribute) byte pairs, dst receives
+  // 14 bytes of RGB222 per character.
+  void scanline_text_rgb111(uint8_t* dst, const uint8_t* src, const uint32_t* font_cache, int src_chars, int char_y);
+
+  // Invert the cell at cursor_x in a line produced by scanline_text_rgb111
+  void scanline_text_cursor(uint8_t* dst, int cursor_x);
+
+  // Text drawn with the palette, for text bands in the other modes: src
+  // holds (character, ramp) byte pairs and each pixel's 2-bit glyph
+  // coverage picks palette entry ramp * 4 + coverage.  So entry ramp * 4 is
+  // the background, ramp * 4 + 3 the foreground and the two between shade
+  // the edges.  dst receives 14 pixels per character.
+  static constexpr int SCANLINE_TEXT_RAMPS = 64;
+
+  void scanline_text_palette(uint32_t* dst, const uint8_t* src, const uint32_t* font_cache, const uint32_t* palette, int src_chars, int char_y);
+  void scanline_text_palette_rgb565(uint16_t* dst, const uint8_t* src, const uint32_t* font_cache, const uint16_t* palette, int src_chars, int char_y);
+}
@@ -1,4 +1,11 @@
+#ifdef DVHSTX_HOST_BUILD
+#include "host/pico_host.hpp"
+#else
 #include <pico/stdlib.h>
+#include "hardware/clocks.h"
+#endif
+
+#include <algorithm>
 
 #include "dvi.hpp"
 
@@ -263,3 +270,107 @@ const struct dvi_timing dvi_timing_2560x1440p_yolo_24hz = {
 
 	.bit_clk_khz       = 912000
 };
+
+// CVT reduced blanking, as in VESA CVT 1.1.  Horizontal blanking is a fixed
+// 160 pixels and vertical blanking at least 460us, with a sync width that
+// identifies the aspect ratio.
+bool dvi_cvt_rb_timing(struct dvi_timing *timing, int width, int height, int refresh_hz) {
+	const int cell_granularity = 8;
+	const int min_v_blank_us = 460;
+	const int v_front_porch = 3;
+	const int min_v_back_porch = 6;
+	const int clock_step_khz = 250;
+
+	width -= width % cell_granularity;
+	if (width <= 0 || height <= 0 || refresh_hz <= 0) return false;
+
+	if ((uint64_t)min_v_blank_us * refresh_hz >= 1000000) return false;
+
+	int v_sync_width = 10;
+	if (height % 3 == 0 && height * 4 / 3 == width) v_sync_width = 4;
+	else if (height % 9 == 0 && height * 16 / 9 == width) v_sync_width = 5;
+	else if (height % 10 == 0 && height * 16 / 10 == width) v_sync_width = 6;
+	else if ((height % 4 == 0 && height * 5 / 4 == width) ||
+	         (height % 9 == 0 && height * 15 / 9 == width)) v_sync_width = 7;
+
+	// Enough whole lines of blanking to cover the minimum time, from an
+	// estimate of the line period: min_v_blank / ((frame - min_v_blank) / height)
+	const uint64_t blank_lines = (uint64_t)min_v_blank_us * height * refresh_hz / (1000000 - (uint64_t)min_v_blank_us * refresh_hz) + 1;
+	const int v_blank = std::max<int>((int)blank_lines, v_front_porch + v_sync_width + min_v_back_porch);
+
+	const int h_total = width + 160;
+	const int v_total = height + v_blank;
+	uint64_t pixel_clock_khz = (uint64_t)refresh_hz * h_total * v_total / 1000;
+	pixel_clock_khz -= pixel_clock_khz % clock_step_khz;
+	if (h_total > 0xfff || pixel_clock_khz * 10 > 0xffffffffu) return false;
+
+	timing->h_sync_polarity = true;
+	timing->h_front_porch = 48;
+	timing->h_sync_width = 32;
+	timing->h_back_porch = 80;
+	timing->h_active_pixels = width;
+
+	timing->v_sync_polarity = false;
+	timing->v_front_porch = v_front_porch;
+	timing->v_sync_width = v_sync_width;
+	timing->v_back_porch = v_blank - v_front_porch - v_sync_width;
+	timing->v_active_lines = height;
+
+	timing->bit_clk_khz = (uint)(pixel_clock_khz * 10);
+	return true;
+}
+
+// The RP2350 PLL needs a reference of at least 5MHz, a feedback divider of
+// 16 to 320 and a VCO of 750 to 1600MHz, with two post dividers of 1 to 7.
+bool dvi_find_pll_config(struct dvi_pll_config *config, uint freq_khz, uint32_t tolerance_ppm, bool low_vco) {
+	const uint64_t min_ref_hz = 5 * MHZ;
+	const uint64_t min_vco_hz = 750 * MHZ;
+	const uint64_t max_vco_hz = 1600 * MHZ;
+	const uint64_t target_hz = (uint64_t)freq_khz * KHZ;
+
+	if (!freq_khz) return false;
+	tolerance_ppm = std::min<uint32_t>(tolerance_ppm, 1000000);
+
+	bool found = false;
+	uint64_t best_error_ppb = 0;
+	for (uint refdiv = 1; (uint64_t)XOSC_KHZ * KHZ / refdiv >= min_ref_hz; ++refdiv) {
+		if ((XOSC_KHZ * KHZ) % refdiv) continue;
+		const uint64_t ref_hz = (uint64_t)XOSC_KHZ * KHZ / refdiv;
+
+		for (uint fbdiv = 16; fbdiv <= 320; ++fbdiv) {
+			const uint64_t vco_hz = ref_hz * fbdiv;
+			if (vco_hz < min_vco_hz || vco_hz > max_vco_hz) continue;
+
+			// Post dividers in the same order as check_sys_clock_khz(),
+			// which prefers the largest first divider
+			for (uint post_div1 = 7; post_div1 >= 1; --post_div1) {
+				for (uint post_div2 = post_div1; post_div2 >= 1; --post_div2) {
+					// Compare vco / div with the target as vco against target * div
+					const uint64_t div = post_div1 * post_div2;
+					const uint64_t scaled_target = target_hz * div;
+					const uint64_t diff = vco_hz > scaled_target ? vco_hz - scaled_target : scaled_target - vco_hz;
+					if (diff * 1000000 > (uint64_t)tolerance_ppm * scaled_target) continue;
+					const uint64_t error_ppb = diff * 1000000000 / scaled_target;
+
+					bool better;
+					if (!found) better = true;
+					else if (low_vco) better = vco_hz < config->vco_freq_hz ||
+						(vco_hz == config->vco_freq_hz && error_ppb < best_error_ppb);
+					else better = error_ppb < best_error_ppb ||
+						(error_ppb == best_error_ppb && refdiv == config->refdiv && vco_hz > config->vco_freq_hz);
+					if (!better) continue;
+
+					found = true;
+					best_error_ppb = error_ppb;
+					config->refdiv = refdiv;
+					config->vco_freq_hz = (uint)vco_hz;
+					config->post_div1 = post_div1;
+					config->post_div2 = post_div2;
+					config->freq_hz = (uint32_t)(vco_hz / div);
+					config->error_ppm = (uint32_t)((diff * 1000000 + scaled_target - 1) / scaled_target);
+				}
+			}
+		}
+	}
+	return found;
+}
@@ -60,3 +60,27 @@ extern const struct dvi_timing dvi_timing_1280x720p_rb_60hz;
 extern const struct dvi_timing dvi_timing_1920x1080p_rb2_30hz;
 extern const struct dvi_timing dvi_timing_1920x1080p_yolo_50hz;
 extern const struct dvi_timing dvi_timing_1920x1080p_yolo_60hz;
+
+// Fill in CVT reduced blanking timings for width x height at refresh_hz,
+// as most monitors list in their EDID.  The pixel clock is rounded down to
+// a multiple of 250kHz, as CVT specifies, which the system PLL can't always
+// reach exactly.  Returns false if there is no such timing.
+bool dvi_cvt_rb_timing(struct dvi_timing *timing, int width, int height, int refresh_hz);
+
+// A system PLL setting found by dvi_find_pll_config()
+struct dvi_pll_config {
+	uint refdiv;
+	uint vco_freq_hz;
+	uint post_div1;
+	uint post_div2;
+	uint32_t freq_hz;	// Output frequency, rounded down
+	uint32_t error_ppm;	// Distance from the requested frequency, rounded up
+};
+
+// Search the system PLL settings for an output within tolerance_ppm of
+// freq_khz.  The closest wins, with the smallest reference divider and then
+// the highest VCO frequency breaking ties, so exact frequencies get the same
+// setting as from check_sys_clock_khz().  If low_vco is set the lowest VCO
+// frequency in tolerance wins, which saves a little power.  Returns false
+// if nothing is within tolerance.
+bool dvi_find_pll_config(struct dvi_pll_config *config, uint freq_khz, uint32_t tolerance_ppm, bool low_vco);
@@ -7,7 +7,12 @@
 #ifndef _FONT_H
 #define _FONT_H
 
+#ifdef DVHSTX_HOST_BUILD
+#include <stddef.h>
+#include <stdint.h>
+#else
 #include "pico/types.h"
+#endif
 
 typedef struct {
     uint16_t bitmap_index;
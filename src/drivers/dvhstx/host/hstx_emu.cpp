@@ -0,0 +1,403 @@
+#ifdef DVHSTX_HOST_BUILD
+
+#include <algorithm>
+#include <chrono>
+
+#include "hstx_emu.hpp"
+#include "../dvi.hpp"
+
+extern void (*dvhstx_host_trigger_hook)(uint channel);
+extern void (*dvhstx_host_abort_hook)(uint channel);
+extern void (*dvhstx_host_wfe_hook)();
+extern uint32_t dvhstx_host_early_triggers;
+bool dvhstx_host_irq_dispatch(uint num);
+
+using namespace pimoroni;
+
+HSTXEmulator* HSTXEmulator::active = nullptr;
+
+static inline uint32_t rotr(uint32_t x, uint32_t n) {
+    n &= 31;
+    return n ? (x >> n) | (x << (32 - n)) : x;
+}
+
+// Field values of 0 encode a count of 32
+static inline uint32_t shift_count(uintptr_t reg, uint32_t bits, uint lsb) {
+    uint32_t n = (reg & bits) >> lsb;
+    return n ? n : 32;
+}
+
+static uint8_t tmds_decode(uint32_t sym) {
+    uint32_t q = sym & 0xff;
+    if (sym & 0x200) q = ~q & 0xff;
+    uint32_t d = q & 1;
+    for (int i = 1; i < 8; ++i) {
+        uint32_t b = ((q >> i) ^ (q >> (i - 1))) & 1;
+        if (!(sym & 0x100)) b ^= 1;
+        d |= b << i;
+    }
+    return d;
+}
+
+HSTXEmulator::HSTXEmulator() {
+    active = this;
+    dvhstx_host_trigger_hook = trigger_hook;
+    dvhstx_host_abort_hook = abort_hook;
+    dvhstx_host_wfe_hook = wfe_hook;
+
+    // Pick up any channels started before the emulator existed
+    for (uint i = 0; i < NUM_DMA_CHANNELS; ++i) {
+        if (dvhstx_host_early_triggers & (1u << i)) trigger(i);
+    }
+    dvhstx_host_early_triggers = 0;
+}
+
+HSTXEmulator::~HSTXEmulator() {
+    if (active == this) {
+        active = nullptr;
+        dvhstx_host_trigger_hook = nullptr;
+        dvhstx_host_abort_hook = nullptr;
+        dvhstx_host_wfe_hook = nullptr;
+    }
+}
+
+void HSTXEmulator::trigger_hook(uint channel) { active->trigger(channel); }
+void HSTXEmulator::abort_hook(uint channel) { active->abort(channel); }
+void HSTXEmulator::wfe_hook() {
+    if (!active->step()) panic("__wfe() with no DMA running");
+}
+
+void HSTXEmulator::set_timing_log(FILE* f) {
+    timing_log = f;
+    if (timing_log) fprintf(timing_log, "frame,line,clocks,active_pixels,vsync,irqs,irq_ns\n");
+}
+
+void HSTXEmulator::error(const char* msg) {
+    ++errors;
+    fprintf(stderr, "hstx_emu: frame %u line %u: %s\n", frame_count, line_in_frame, msg);
+}
+
+// ----------------------------------------------------------------------------
+// DMA
+
+void HSTXEmulator::trigger(uint channel) {
+    dma_channel_hw_t* ch = &dma_hw->ch[channel];
+    if (!(ch->ctrl_trig & DMA_CH0_CTRL_TRIG_EN_BITS)) return;
+    if ((pending | running) & (1u << channel)) return;
+    transfer_count[channel] = ch->transfer_count;
+    ch->ctrl_trig |= DMA_CH0_CTRL_TRIG_BUSY_BITS;
+    pending |= 1u << channel;
+}
+
+void HSTXEmulator::abort(uint channel) {
+    pending &= ~(1u << channel);
+    dma_hw->ch[channel].ctrl_trig &= ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+}
+
+bool HSTXEmulator::step() {
+    if (!pending) return false;
+
+    // Triggered channels are run in channel order; the driver only ever
+    // has one channel in flight per chain so this matches the hardware.
+    uint channel = __builtin_ctz(pending);
+    pending &= ~(1u << channel);
+    running |= 1u << channel;
+    run_channel(channel);
+    running &= ~(1u << channel);
+    if (irq_stall) {
+        if (!--irq_stall) service_irq();
+    }
+    else if (dvhstx_host_core1_hook) dvhstx_host_core1_hook();
+    return true;
+}
+
+static inline bool is_dma_register(uintptr_t addr) {
+    return addr >= (uintptr_t)dma_hw && addr < (uintptr_t)(dma_hw + 1);
+}
+
+static inline uintptr_t advance(uintptr_t addr, uint32_t step, uint32_t ring_bits) {
+    if (!ring_bits) return addr + step;
+    const uintptr_t mask = ((uintptr_t)1 << ring_bits) - 1;
+    return (addr & ~mask) | ((addr + step) & mask);
+}
+
+void HSTXEmulator::run_channel(uint channel) {
+    dma_channel_hw_t* ch = &dma_hw->ch[channel];
+    const uint32_t ctrl = ch->ctrl_trig;
+    const uint32_t size = 1u << ((ctrl & DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS) >> DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+    const uint32_t ring_bits = (ctrl & DMA_CH0_CTRL_TRIG_RING_SIZE_BITS) >> DMA_CH0_CTRL_TRIG_RING_SIZE_LSB;
+    const bool ring_write = ctrl & DMA_CH0_CTRL_TRIG_RING_SEL_BITS;
+
+    uintptr_t read = ch->read_addr;
+    uintptr_t write = ch->write_addr;
+    for (uint32_t n = transfer_count[channel]; n; --n) {
+        const bool to_regs = is_dma_register(write);
+        // Register tables are pointer sized on the host, see pico_host.hpp
+        const uint32_t elem = (size == 4 && to_regs) ? sizeof(uintptr_t) : size;
+
+        uintptr_t value;
+        switch (elem) {
+        case 1: value = *(const uint8_t*)read * 0x01010101u; break;
+        case 2: value = *(const uint16_t*)read * 0x10001u; break;
+        case 4: value = *(const uint32_t*)read; break;
+        default: value = *(const uintptr_t*)read; break;
+        }
+
+        if (write == (uintptr_t)&hstx_fifo_hw->fifo) push_fifo((uint32_t)value);
+        else if (to_regs) write_dma_register(write, value);
+        else memcpy((void*)write, &value, elem);
+
+        if (ctrl & DMA_CH0_CTRL_TRIG_INCR_READ_BITS) read = advance(read, elem, ring_write ? 0 : ring_bits);
+        if (ctrl & DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS) write = advance(write, elem, ring_write ? ring_bits : 0);
+        ch->read_addr = read;
+        ch->write_addr = write;
+    }
+    transfer_count[channel] = 0;
+    ch->ctrl_trig &= ~DMA_CH0_CTRL_TRIG_BUSY_BITS;
+
+    const uint chain_to = (ctrl & DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) >> DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB;
+    if (chain_to != channel) trigger(chain_to);
+    if (!(ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS)) raise_irq(channel);
+}
+
+void HSTXEmulator::write_dma_register(uintptr_t addr, uintptr_t value) {
+    const uintptr_t index = (addr - (uintptr_t)dma_hw->ch) / sizeof(io_rw_32);
+    if (index >= count_of(dma_hw->ch) * 16) {
+        *(io_rw_32*)addr = value;
+        return;
+    }
+
+    dma_channel_hw_t* ch = &dma_hw->ch[index / 16];
+    const uint channel = index / 16;
+    bool trig = false;
+    switch (index % 16) {
+    case 15: trig = true; [[fallthrough]];
+    case 0: case 5: case 10: ch->read_addr = value; break;
+    case 11: trig = true; [[fallthrough]];
+    case 1: case 6: case 13: ch->write_addr = value; break;
+    case 7: trig = true; [[fallthrough]];
+    case 2: case 9: case 14: ch->transfer_count = value; break;
+    case 3: trig = true; [[fallthrough]];
+    case 4: case 8: case 12: ch->ctrl_trig = value; break;
+    }
+
+    if (trig) {
+        if (value == 0) {
+            // Null trigger: doesn't start the channel, but does raise the
+            // IRQ of a quiet channel
+            if (ch->ctrl_trig & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) raise_irq(channel);
+        }
+        else trigger(channel);
+    }
+}
+
+void HSTXEmulator::raise_irq(uint channel) {
+    irq_pending |= 1u << channel;
+    if (!irq_stall) service_irq();
+}
+
+void HSTXEmulator::service_irq() {
+    const uint32_t enabled = irq_pending & dma_hw->inte2;
+    if (!enabled) return;
+
+    // intr is write 1 to clear on the hardware, so present it as zero to
+    // the handler and treat whatever it writes as the bits to clear.
+    dma_hw->ints2 = irq_pending & dma_hw->inte2;
+    dma_hw->intr = 0;
+    auto start = std::chrono::steady_clock::now();
+    const bool ran = dvhstx_host_irq_dispatch(DMA_IRQ_2);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    irq_pending &= ~(uint32_t)dma_hw->intr;
+    dma_hw->intr = irq_pending;
+    dma_hw->ints2 = irq_pending & dma_hw->inte2;
+
+    if (!ran) return;
+    ++line_irqs;
+    line_irq_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (irq_pending & enabled) {
+        error("DMA IRQ not acknowledged by handler");
+        irq_pending &= ~enabled;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// HSTX command expander
+
+void HSTXEmulator::push_fifo(uint32_t word) {
+    const uintptr_t shift = hstx_ctrl_hw->expand_shift;
+    switch (state) {
+    case CMD:
+        cmd_count = word & 0xfff;
+        switch (word & 0xf000) {
+        case HSTX_CMD_RAW: state = RAW; break;
+        case HSTX_CMD_RAW_REPEAT: state = RAW_REPEAT; break;
+        case HSTX_CMD_TMDS: state = TMDS; tmds_shifts_left = 0; break;
+        case HSTX_CMD_TMDS_REPEAT: state = TMDS_REPEAT; break;
+        case HSTX_CMD_NOP: break;
+        default: error("unknown HSTX command"); break;
+        }
+        if (cmd_count == 0) state = CMD;
+        break;
+
+    case RAW:
+        emit_raw(word);
+        if (--cmd_count == 0) state = CMD;
+        break;
+
+    case RAW_REPEAT:
+        while (cmd_count--) emit_raw(word);
+        state = CMD;
+        break;
+
+    case TMDS: {
+        const uint32_t n_shifts = shift_count(shift, HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_BITS, HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB);
+        const uint32_t enc_shift = (shift & HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_BITS) >> HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB;
+        for (uint32_t i = 0; i < n_shifts && cmd_count; ++i, --cmd_count) {
+            emit_tmds(word, i * enc_shift);
+        }
+        // Any pixels left in the word at the end of the command are dropped
+        if (cmd_count == 0) state = CMD;
+        break;
+    }
+
+    case TMDS_REPEAT: {
+        const uint32_t n_shifts = shift_count(shift, HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_BITS, HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB);
+        const uint32_t enc_shift = (shift & HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_BITS) >> HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB;
+        for (uint32_t i = 0; i < cmd_count; ++i) {
+            emit_tmds(word, (i % n_shifts) * enc_shift);
+        }
+        state = CMD;
+        break;
+    }
+    }
+}
+
+void HSTXEmulator::emit_raw(uint32_t word) {
+    const uintptr_t shift = hstx_ctrl_hw->expand_shift;
+    const uint32_t n_shifts = shift_count(shift, HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_BITS, HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB);
+    const uint32_t raw_shift = (shift & HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_BITS) >> HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB;
+
+    for (uint32_t i = 0; i < n_shifts; ++i) {
+        const uint32_t sym = rotr(word, i * raw_shift);
+        const uint32_t lane0 = sym & 0x3ff;
+        switch (lane0) {
+        case TMDS_CTRL_00: emit_symbol(true, false, false, 0); break;
+        case TMDS_CTRL_01: emit_symbol(true, true, false, 0); break;
+        case TMDS_CTRL_10: emit_symbol(true, false, true, 0); break;
+        case TMDS_CTRL_11: emit_symbol(true, true, true, 0); break;
+        default:
+            emit_symbol(false, true, true,
+                        tmds_decode((sym >> 20) & 0x3ff) << 16 |
+                        tmds_decode((sym >> 10) & 0x3ff) << 8 |
+                        tmds_decode(lane0));
+            break;
+        }
+    }
+}
+
+void HSTXEmulator::emit_tmds(uint32_t word, uint32_t rotation) {
+    const uintptr_t tmds = hstx_ctrl_hw->expand_tmds;
+    static const uint nbits_lsb[3] = { HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB, HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB, HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB };
+    static const uint rot_lsb[3] = { HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB, HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB, HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB };
+
+    uint32_t rgb = 0;
+    for (int lane = 0; lane < 3; ++lane) {
+        const uint32_t nbits = ((tmds >> nbits_lsb[lane]) & 7) + 1;
+        const uint32_t rot = (tmds >> rot_lsb[lane]) & 31;
+        const uint32_t mask = (0xff << (8 - nbits)) & 0xff;
+        rgb |= (rotr(word, rotation + rot) & mask) << (8 * lane);
+    }
+    emit_symbol(false, true, true, rgb);
+}
+
+// ----------------------------------------------------------------------------
+// Raster
+
+void HSTXEmulator::emit_symbol(bool control, bool hsync, bool vsync, uint32_t rgb) {
+    // The driver drives sync low when asserted, so H0/V0 are the active states
+    if (control) {
+        if (!hsync && last_hsync) end_line();
+        last_hsync = hsync;
+        last_vsync = vsync;
+        if (!vsync) line_vsync = true;
+    }
+    else {
+        current_line.push_back(rgb);
+    }
+    ++line_clocks;
+}
+
+void HSTXEmulator::end_line() {
+    const bool vsync_edge = line_vsync && (current_timing.empty() || !current_timing.back().vsync);
+
+    LineTiming t = { frame_count, line_in_frame, line_clocks, (uint32_t)current_line.size(), line_vsync, line_irqs, line_irq_ns };
+    if (timing_log && seen_vsync) {
+        fprintf(timing_log, "%u,%u,%u,%u,%d,%u,%llu\n", t.frame, t.line, t.clocks, t.active_pixels, (int)t.vsync, t.irqs, (unsigned long long)t.irq_ns);
+    }
+    current_timing.push_back(t);
+    if (!current_line.empty()) current_frame.push_back(std::move(current_line));
+    current_line.clear();
+    line_clocks = 0;
+    line_irqs = 0;
+    line_irq_ns = 0;
+    line_vsync = !last_vsync;
+    ++line_in_frame;
+
+    // A new frame starts with the first line that has vsync asserted.  That
+    // line has already been logged, so carry it over.
+    if (vsync_edge) {
+        t = current_timing.back();
+        current_timing.pop_back();
+        end_frame();
+        t.frame = frame_count;
+        t.line = 0;
+        current_timing.push_back(t);
+        line_in_frame = 1;
+    }
+}
+
+void HSTXEmulator::end_frame() {
+    if (seen_vsync) {
+        frame_height = current_frame.size();
+        frame_width = 0;
+        for (auto& line : current_frame) frame_width = std::max(frame_width, (int)line.size());
+        frame.assign(frame_width * frame_height, 0);
+        for (int y = 0; y < frame_height; ++y) {
+            std::copy(current_frame[y].begin(), current_frame[y].end(), frame.begin() + y * frame_width);
+        }
+        frame_timing = std::move(current_timing);
+
+        if (ppm_prefix) {
+            char name[256];
+            snprintf(name, sizeof(name), "%s%u.ppm", ppm_prefix, frame_count);
+            FILE* f = fopen(name, "wb");
+            if (f) {
+                fprintf(f, "P6\n%d %d\n255\n", frame_width, frame_height);
+                for (uint32_t p : frame) {
+                    const uint8_t rgb[3] = { (uint8_t)(p >> 16), (uint8_t)(p >> 8), (uint8_t)p };
+                    fwrite(rgb, 1, 3, f);
+                }
+                fclose(f);
+            }
+            else error("unable to write PPM");
+        }
+        ++frame_count;
+    }
+    seen_vsync = true;
+    current_frame.clear();
+    current_timing.clear();
+}
+
+bool HSTXEmulator::run_frames(int frames) {
+    const uint32_t target = frame_count + frames;
+    const uint32_t start_errors = errors;
+    while (frame_count < target) {
+        if (!step()) {
+            error("DMA stalled");
+            return false;
+        }
+    }
+    return errors == start_errors;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "pico_host.hpp"
+
+// Host emulation of the DMA channels and HSTX command expander used by
+// DVHSTX, only available with DVHSTX_HOST_BUILD.
+//
+// The emulator runs the DMA channels set up by DVHSTX::init() one transfer
+// block at a time, services DMA_IRQ_2 through the installed handler, and
+// decodes the words written to the HSTX FIFO using the expand_tmds and
+// expand_shift values programmed by the driver.  Hsync/vsync are taken from
+// the control symbols on lane 0 and the active pixels of each frame are
+// collected, so a frame can be written out as a PPM image.  A timing log
+// records the symbol clocks and IRQ cost of every line.
+//
+// Typical use:
+//
+//   pimoroni::DVHSTX display;
+//   display.init(320, 180, pimoroni::DVHSTX::MODE_RGB565, false, {12, 14, 16, 18});
+//   ... draw into display.get_back_buffer<uint16_t>() ...
+//   pimoroni::HSTXEmulator emu;
+//   emu.set_ppm_prefix("frame");
+//   emu.run_frames(2);
+//
+// Emulation is sequential: IRQ handlers run as soon as the transfer that
+// raised them completes, unless held off with stall_irqs(), and a renderer on core 1 is polled after every
+// DMA block, so this checks what the driver sends rather than whether it
+// keeps up in real time.
+
+namespace pimoroni {
+
+  class HSTXEmulator {
+  public:
+    struct LineTiming {
+      uint32_t frame;
+      uint32_t line;            // Lines since the start of vsync
+      uint32_t clocks;          // Symbol clocks from this hsync to the next
+      uint32_t active_pixels;   // Data (non-control) symbols in the line
+      bool vsync;               // Vsync was asserted during the line
+      uint32_t irqs;            // DMA IRQs serviced during the line
+      uint64_t irq_ns;          // Host time spent in those IRQs
+    };
+
+    HSTXEmulator();
+    ~HSTXEmulator();
+
+    // Write each completed frame to <prefix><frame number>.ppm
+    void set_ppm_prefix(const char* prefix) { ppm_prefix = prefix; }
+
+    // Write one line per scanline to f, see LineTiming
+    void set_timing_log(FILE* f);
+
+    // Emulate until the given number of complete frames have been seen.
+    // Returns false if the DMA stalls or a command stream error is found.
+    bool run_frames(int frames);
+
+    // Run the DMA for one transfer block, false if nothing is running
+    bool step();
+
+    // Hold DMA_IRQ_2 and the core 1 renderer off for the next n transfer
+    // blocks, as if the CPU were busy elsewhere.  IRQs raised meanwhile are
+    // merged into one, as on the hardware, and serviced once the stall is
+    // over.
+    void stall_irqs(uint32_t n) { irq_stall = n; }
+
+    // The most recently completed frame, as 0xRRGGBB pixels
+    int get_frame_width() const { return frame_width; }
+    int get_frame_height() const { return frame_height; }
+    const std::vector<uint32_t>& get_frame() const { return frame; }
+    uint32_t get_frame_count() const { return frame_count; }
+
+    // Per line timing of the most recently completed frame
+    const std::vector<LineTiming>& get_frame_timing() const { return frame_timing; }
+
+    // Count of decode errors seen so far
+    uint32_t get_error_count() const { return errors; }
+
+  private:
+    // DMA
+    uint32_t pending = 0;       // Channels triggered but not yet run
+    uint32_t running = 0;       // Channels mid-transfer
+    uint32_t irq_pending = 0;
+    uint32_t irq_stall = 0;
+    uint32_t transfer_count[NUM_DMA_CHANNELS];
+
+    void trigger(uint channel);
+    void abort(uint channel);
+    void run_channel(uint channel);
+    void write_dma_register(uintptr_t addr, uintptr_t value);
+    void raise_irq(uint channel);
+    void service_irq();
+
+    // HSTX expander
+    enum CmdState { CMD, RAW, RAW_REPEAT, TMDS, TMDS_REPEAT };
+    CmdState state = CMD;
+    uint32_t cmd_count = 0;
+    uint32_t tmds_word = 0;
+    uint32_t tmds_shifts_left = 0;
+    uint32_t tmds_rotation = 0;
+
+    void push_fifo(uint32_t word);
+    void emit_raw(uint32_t word);
+    void emit_tmds(uint32_t word, uint32_t rotation);
+    void emit_symbol(bool control, bool hsync, bool vsync, uint32_t rgb);
+
+    // Raster
+    bool last_hsync = true;
+    bool last_vsync = true;
+    bool line_vsync = false;
+    bool seen_vsync = false;
+    uint32_t line_clocks = 0;
+    uint32_t line_in_frame = 0;
+    uint32_t frame_count = 0;
+    uint32_t line_irqs = 0;
+    uint64_t line_irq_ns = 0;
+    uint32_t errors = 0;
+    std::vector<uint32_t> current_line;
+    std::vector<std::vector<uint32_t>> current_frame;
+    std::vector<LineTiming> current_timing;
+
+    std::vector<uint32_t> frame;
+    std::vector<LineTiming> frame_timing;
+    int frame_width = 0;
+    int frame_height = 0;
+
+    const char* ppm_prefix = nullptr;
+    FILE* timing_log = nullptr;
+
+    void end_line();
+    void end_frame();
+    void error(const char* msg);
+
+    static HSTXEmulator* active;
+    static void trigger_hook(uint channel);
+    static void abort_hook(uint channel);
+    static void wfe_hook();
+  };
+}
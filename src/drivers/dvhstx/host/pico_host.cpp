@@ -0,0 +1,104 @@
+#ifdef DVHSTX_HOST_BUILD
+
+#include <stdarg.h>
+#include <chrono>
+
+#include "pico_host.hpp"
+
+alignas(4096) dma_hw_t dvhstx_host_dma_hw;
+hstx_ctrl_hw_t dvhstx_host_hstx_ctrl_hw;
+hstx_fifo_hw_t dvhstx_host_hstx_fifo_hw;
+pll_hw_t dvhstx_host_pll_sys, dvhstx_host_pll_usb;
+uint32_t dvhstx_host_clock_hz[CLK_COUNT];
+
+// Hooks installed by the emulator
+void (*dvhstx_host_trigger_hook)(uint channel) = nullptr;
+void (*dvhstx_host_abort_hook)(uint channel) = nullptr;
+void (*dvhstx_host_wfe_hook)() = nullptr;
+void (*dvhstx_host_core1_hook)() = nullptr;
+
+// Channels started before an emulator was created
+uint32_t dvhstx_host_early_triggers = 0;
+
+static irq_handler_t irq_handlers[32];
+static bool irq_enabled[32];
+
+void panic(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    abort();
+}
+
+uint32_t dvhstx_host_cycle_count() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void __sev() {
+}
+
+void __wfe() {
+    // Nothing else can change the driver's state on the host, so waiting
+    // for an event means letting the emulated hardware make progress.
+    if (dvhstx_host_wfe_hook) dvhstx_host_wfe_hook();
+    else panic("__wfe() called with no emulator running");
+}
+
+void dvhstx_host_dma_trigger(uint channel) {
+    if (dvhstx_host_trigger_hook) dvhstx_host_trigger_hook(channel);
+    else dvhstx_host_early_triggers |= 1u << channel;
+}
+
+void dma_channel_abort(uint channel) {
+    if (dvhstx_host_abort_hook) dvhstx_host_abort_hook(channel);
+    else dvhstx_host_early_triggers &= ~(1u << channel);
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    if (irq_handlers[num]) panic("IRQ %u already has a handler", num);
+    irq_handlers[num] = handler;
+}
+
+irq_handler_t irq_get_exclusive_handler(uint num) {
+    return irq_handlers[num];
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    if (irq_handlers[num] == handler) irq_handlers[num] = nullptr;
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    irq_enabled[num] = enabled;
+}
+
+// Run the handler for an IRQ if it is enabled, returns false if not
+bool dvhstx_host_irq_dispatch(uint num) {
+    if (!irq_enabled[num] || !irq_handlers[num]) return false;
+    irq_handlers[num]();
+    return true;
+}
+
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_out, uint *postdiv1_out, uint *postdiv2_out) {
+    const uint reference_freq_khz = XOSC_KHZ / PLL_COMMON_REFDIV;
+    for (uint fbdiv = 320; fbdiv >= 16; fbdiv--) {
+        const uint vco_khz = fbdiv * reference_freq_khz;
+        if (vco_khz < 750000 || vco_khz > 1600000) continue;
+        for (uint postdiv1 = 7; postdiv1 >= 1; postdiv1--) {
+            for (uint postdiv2 = postdiv1; postdiv2 >= 1; postdiv2--) {
+                const uint out = vco_khz / (postdiv1 * postdiv2);
+                if (out == freq_khz && !(vco_khz % (postdiv1 * postdiv2))) {
+                    *vco_out = vco_khz * KHZ;
+                    *postdiv1_out = postdiv1;
+                    *postdiv2_out = postdiv2;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,304 @@
+#pragma once
+
+// Host stand-in for the parts of the Pico SDK used by the DVHSTX driver.
+//
+// This is only used when DVHSTX_HOST_BUILD is defined.  The DMA and HSTX
+// register blocks are plain memory which hstx_emu.cpp interprets, so the
+// driver's init(), IRQ handlers and command lists run unchanged on a host.
+//
+// Registers are pointer sized so that DMA addresses written by the driver
+// survive on 64-bit hosts.  Code that builds tables of DMA register values
+// should use io_rw_32 / uintptr_t sized entries for the same reason.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+typedef volatile uintptr_t io_rw_32;
+typedef volatile uintptr_t io_ro_32;
+typedef volatile uintptr_t io_wo_32;
+
+#ifndef count_of
+#define count_of(a) (sizeof(a)/sizeof((a)[0]))
+#endif
+
+// With DVHSTX_HOST_SECTIONS these place functions in the sections the Pico
+// SDK would, so tests/host/check_placement.py can see what runs from RAM.
+#ifdef DVHSTX_HOST_SECTIONS
+#define __scratch_x(group) __attribute__((section(".scratch_x." group)))
+#define __scratch_y(group) __attribute__((section(".scratch_y." group)))
+#define __not_in_flash(group) __attribute__((section(".time_critical." group)))
+#define __not_in_flash_func(func_name) __not_in_flash(#func_name) func_name
+#else
+#define __scratch_x(group)
+#define __scratch_y(group)
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#endif
+#define __no_inline_not_in_flash_func(func_name) __attribute__((noinline)) __not_in_flash_func(func_name)
+#define __time_critical_func(func_name) __not_in_flash_func(func_name)
+#define __force_inline inline __attribute__((always_inline))
+
+#define KHZ 1000
+#define MHZ 1000000
+#define XOSC_KHZ 12000
+#define PLL_COMMON_REFDIV 1
+
+[[noreturn]] void panic(const char *fmt, ...);
+
+void __sev();
+void __wfe();
+static inline void __dmb() {}
+
+// Stands in for code running on core 1: the emulator calls it after each
+// DMA block, see HSTXEmulator.
+extern void (*dvhstx_host_core1_hook)();
+static inline void tight_loop_contents() {}
+
+// Stand-in for the CPU cycle counter, counts host nanoseconds
+uint32_t dvhstx_host_cycle_count();
+static inline void sleep_us(uint64_t) {}
+static inline void sleep_ms(uint32_t) {}
+static inline bool stdio_init_all() { return true; }
+
+// ----------------------------------------------------------------------------
+// DMA
+
+#define NUM_DMA_CHANNELS 16
+
+typedef struct {
+    io_rw_32 read_addr;
+    io_rw_32 write_addr;
+    io_rw_32 transfer_count;
+    io_rw_32 ctrl_trig;
+    io_rw_32 al1_ctrl;
+    io_rw_32 al1_read_addr;
+    io_rw_32 al1_write_addr;
+    io_rw_32 al1_transfer_count_trig;
+    io_rw_32 al2_ctrl;
+    io_rw_32 al2_transfer_count;
+    io_rw_32 al2_read_addr;
+    io_rw_32 al2_write_addr_trig;
+    io_rw_32 al3_ctrl;
+    io_rw_32 al3_write_addr;
+    io_rw_32 al3_transfer_count;
+    io_rw_32 al3_read_addr_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+    io_rw_32 intr;
+    io_rw_32 inte0, intf0, ints0;
+    io_rw_32 inte1, intf1, ints1;
+    io_rw_32 inte2, intf2, ints2;
+    io_rw_32 inte3, intf3, ints3;
+} dma_hw_t;
+
+extern dma_hw_t dvhstx_host_dma_hw;
+#define dma_hw (&dvhstx_host_dma_hw)
+
+#define DMA_CH0_CTRL_TRIG_EN_BITS            0x00000001u
+#define DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS 0x00000002u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB      2
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS     0x0000000cu
+#define DMA_CH0_CTRL_TRIG_INCR_READ_BITS     0x00000010u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS    0x00000040u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_LSB      8
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_BITS     0x00000f00u
+#define DMA_CH0_CTRL_TRIG_RING_SEL_BITS      0x00001000u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB       13
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS      0x0001e000u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB       17
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS      0x007e0000u
+#define DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS     0x00800000u
+#define DMA_CH0_CTRL_TRIG_BSWAP_BITS         0x01000000u
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS          0x04000000u
+
+#define DREQ_HSTX 52
+#define DREQ_FORCE 63
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+    dma_channel_config c;
+    c.ctrl = DMA_CH0_CTRL_TRIG_EN_BITS |
+             DMA_SIZE_32 << DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB |
+             DMA_CH0_CTRL_TRIG_INCR_READ_BITS |
+             channel << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB |
+             DREQ_FORCE << DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB;
+    return c;
+}
+
+static inline void dvhstx_host_set_field(dma_channel_config *c, uint32_t bits, uint lsb, uint32_t value) {
+    c->ctrl = (c->ctrl & ~bits) | ((value << lsb) & bits);
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+    dvhstx_host_set_field(c, DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS, DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB, chain_to);
+}
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    dvhstx_host_set_field(c, DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS, DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB, dreq);
+}
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    dvhstx_host_set_field(c, DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS, DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB, size);
+}
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_READ_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_READ_BITS);
+}
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS);
+}
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    dvhstx_host_set_field(c, DMA_CH0_CTRL_TRIG_RING_SIZE_BITS, DMA_CH0_CTRL_TRIG_RING_SIZE_LSB, size_bits);
+    c->ctrl = write ? (c->ctrl | DMA_CH0_CTRL_TRIG_RING_SEL_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_RING_SEL_BITS);
+}
+static inline void channel_config_set_irq_quiet(dma_channel_config *c, bool irq_quiet) {
+    c->ctrl = irq_quiet ? (c->ctrl | DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS);
+}
+static inline void channel_config_set_high_priority(dma_channel_config *c, bool high_priority) {
+    c->ctrl = high_priority ? (c->ctrl | DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS) : (c->ctrl & ~DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS);
+}
+static inline uint32_t channel_config_get_ctrl_value(const dma_channel_config *c) {
+    return c->ctrl;
+}
+
+// Starting a channel from the CPU; picked up by the emulator
+void dvhstx_host_dma_trigger(uint channel);
+
+static inline void dma_claim_mask(uint32_t) {}
+static inline void dma_channel_set_config(uint channel, const dma_channel_config *c, bool trigger) {
+    dma_hw->ch[channel].ctrl_trig = c->ctrl;
+    if (trigger) dvhstx_host_dma_trigger(channel);
+}
+static inline void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    dma_hw->ch[channel].read_addr = (uintptr_t)read_addr;
+    if (trigger) dvhstx_host_dma_trigger(channel);
+}
+static inline void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    dma_hw->ch[channel].write_addr = (uintptr_t)write_addr;
+    if (trigger) dvhstx_host_dma_trigger(channel);
+}
+static inline void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    dma_hw->ch[channel].transfer_count = trans_count;
+    if (trigger) dvhstx_host_dma_trigger(channel);
+}
+static inline void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                                         const volatile void *read_addr, uint transfer_count, bool trigger) {
+    dma_hw->ch[channel].read_addr = (uintptr_t)read_addr;
+    dma_hw->ch[channel].write_addr = (uintptr_t)write_addr;
+    dma_hw->ch[channel].transfer_count = transfer_count;
+    dma_channel_set_config(channel, config, trigger);
+}
+static inline void dma_channel_start(uint channel) {
+    dvhstx_host_dma_trigger(channel);
+}
+
+static inline bool dma_channel_is_busy(uint channel) {
+    return (dma_hw->ch[channel].ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) != 0;
+}
+void dma_channel_abort(uint channel);
+
+// ----------------------------------------------------------------------------
+// HSTX
+
+typedef struct {
+    io_rw_32 csr;
+    io_rw_32 bit[8];
+    io_rw_32 expand_shift;
+    io_rw_32 expand_tmds;
+} hstx_ctrl_hw_t;
+
+typedef struct {
+    io_ro_32 stat;
+    io_wo_32 fifo;
+} hstx_fifo_hw_t;
+
+extern hstx_ctrl_hw_t dvhstx_host_hstx_ctrl_hw;
+extern hstx_fifo_hw_t dvhstx_host_hstx_fifo_hw;
+#define hstx_ctrl_hw (&dvhstx_host_hstx_ctrl_hw)
+#define hstx_fifo_hw (&dvhstx_host_hstx_fifo_hw)
+
+#define HSTX_CTRL_CSR_EN_BITS                    0x00000001u
+#define HSTX_CTRL_CSR_EXPAND_EN_BITS             0x00000002u
+#define HSTX_CTRL_CSR_SHIFT_LSB                  8
+#define HSTX_CTRL_CSR_N_SHIFTS_LSB               16
+#define HSTX_CTRL_CSR_CLKDIV_LSB                 28
+
+#define HSTX_CTRL_BIT0_SEL_P_LSB                 0
+#define HSTX_CTRL_BIT0_SEL_N_LSB                 8
+#define HSTX_CTRL_BIT0_INV_BITS                  0x00010000u
+#define HSTX_CTRL_BIT0_CLK_BITS                  0x00020000u
+
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_LSB  24
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_N_SHIFTS_BITS 0x1f000000u
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_LSB     16
+#define HSTX_CTRL_EXPAND_SHIFT_ENC_SHIFT_BITS    0x001f0000u
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_LSB  8
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_N_SHIFTS_BITS 0x00001f00u
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_LSB     0
+#define HSTX_CTRL_EXPAND_SHIFT_RAW_SHIFT_BITS    0x0000001fu
+
+#define HSTX_CTRL_EXPAND_TMDS_L2_NBITS_LSB       21
+#define HSTX_CTRL_EXPAND_TMDS_L2_ROT_LSB         16
+#define HSTX_CTRL_EXPAND_TMDS_L1_NBITS_LSB       13
+#define HSTX_CTRL_EXPAND_TMDS_L1_ROT_LSB         8
+#define HSTX_CTRL_EXPAND_TMDS_L0_NBITS_LSB       5
+#define HSTX_CTRL_EXPAND_TMDS_L0_ROT_LSB         0
+
+// ----------------------------------------------------------------------------
+// IRQ, GPIO, resets and clocks
+
+typedef void (*irq_handler_t)(void);
+
+enum {
+    DMA_IRQ_0 = 10,
+    DMA_IRQ_1 = 11,
+    DMA_IRQ_2 = 12,
+    DMA_IRQ_3 = 13,
+};
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+irq_handler_t irq_get_exclusive_handler(uint num);
+void irq_remove_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#define GPIO_FUNC_HSTX 0
+#define GPIO_DRIVE_STRENGTH_4MA 1
+static inline void gpio_set_function(uint, uint) {}
+static inline void gpio_set_drive_strength(uint, uint) {}
+
+#define RESET_HSTX 0
+static inline void reset_block_num(uint) {}
+static inline void unreset_block_num_wait_blocking(uint) {}
+
+enum clock_index { clk_gpout0, clk_gpout1, clk_gpout2, clk_gpout3, clk_ref, clk_sys, clk_peri, clk_hstx, clk_usb, clk_adc, CLK_COUNT };
+typedef struct { int index; } pll_hw_t;
+extern pll_hw_t dvhstx_host_pll_sys, dvhstx_host_pll_usb;
+#define pll_sys (&dvhstx_host_pll_sys)
+#define pll_usb (&dvhstx_host_pll_usb)
+
+#define CLOCKS_CLK_HSTX_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS 0
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX 1
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS 0
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 1
+
+// Frequencies configured through clock_configure(), in Hz
+extern uint32_t dvhstx_host_clock_hz[CLK_COUNT];
+
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out);
+static inline void pll_init(pll_hw_t *, uint, uint, uint, uint) {}
+static inline bool clock_configure(clock_index clk_index, uint32_t, uint32_t, uint32_t, uint32_t freq) {
+    dvhstx_host_clock_hz[clk_index] = freq;
+    return true;
+}
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Check that the scanline IRQs and core 1 renderer never call into flash.
+
+Takes the driver's object files, built for the host with
+DVHSTX_HOST_SECTIONS so that __scratch_x() and __not_in_flash_func() put
+functions in the sections the Pico SDK would.  Starting from the entry
+points below, every function they reference must be in .scratch_x.* or
+.time_critical.*, i.e. in RAM on the RP2350.  A reference to .text, such
+as a template instantiation whose section attribute GCC dropped, fails.
+Functions defined in neither object (memcpy, the SDK) are not checked.
+
+The host compiler inlines differently to arm-none-eabi-gcc, so this can
+miss a helper that only the target build leaves out of line, but it
+catches anything placed by a declaration.  It also checks that what is
+placed in SCRATCH_X stays small, as core 1's stack shares its 4KB.
+"""
+
+import re
+import subprocess
+import sys
+
+ROOTS = [
+    "dma_irq_handler_line()",
+    "dma_irq_handler_scanout()",
+    "pimoroni::DVHSTX::core1_render()",
+]
+# Called through render_line_fn, one for each line format
+RENDERERS = re.compile(r"pimoroni::DVHSTX::render_line_\w+\(unsigned int\*, int\)$")
+RENDERER_COUNT = 11
+RAM_SECTIONS = (".scratch_x.", ".time_critical.")
+SCRATCH_X_BUDGET = 1024
+
+
+def readelf(*args):
+    return subprocess.run(["readelf", "-W", "-C", *args], check=True,
+                          capture_output=True, text=True).stdout
+
+
+def load(path):
+    """Section sizes, function symbols by section, and the targets each
+    section refers to, for one object file."""
+    sections = {}
+    index_names = {}
+    for line in readelf("-S", path).splitlines():
+        line = line.strip()
+        if not line.startswith("[") or "]" not in line:
+            continue
+        index = line[1:line.index("]")].strip()
+        fields = line[line.index("]") + 1:].split()
+        if index.isdigit() and len(fields) >= 5:
+            index_names[index] = fields[0]
+            sections[fields[0]] = int(fields[4], 16)
+
+    functions = {}
+    for line in readelf("-s", path).splitlines():
+        fields = line.split(None, 7)
+        if len(fields) == 8 and fields[3] == "FUNC" and fields[6].isdigit():
+            functions[fields[7]] = index_names[fields[6]]
+
+    references = {}
+    section = None
+    for line in readelf("-r", path).splitlines():
+        if line.startswith("Relocation section"):
+            section = line.split("'")[1][len(".rela"):]
+            references[section] = set()
+        elif section and line[:1] in "0123456789abcdef" and line.strip():
+            fields = line.split(None, 4)
+            if len(fields) == 5:
+                references[section].add(fields[4].rsplit(" ", 2)[0])
+    return sections, functions, references
+
+
+def main(paths):
+    sections, functions, references = {}, {}, {}
+    for path in paths:
+        s, f, r = load(path)
+        sections.update({(path, k): v for k, v in s.items()})
+        functions.update({k: (path, v) for k, v in f.items()})
+        references.update({(path, k): v for k, v in r.items()})
+
+    failed = False
+    seen = set()
+    queue = []
+    for root in ROOTS:
+        if root not in functions:
+            print(f"FAIL placement: {root} not found")
+            failed = True
+            continue
+        queue.append((functions[root], root))
+
+    renderers = [name for name in functions if RENDERERS.match(name)]
+    if len(renderers) != RENDERER_COUNT:
+        print(f"FAIL placement: {len(renderers)} render_line_ functions, expected {RENDERER_COUNT}")
+        failed = True
+    queue.extend((functions[name], name) for name in renderers)
+
+    while queue:
+        (path, section), name = queue.pop()
+        if (path, section) in seen:
+            continue
+        seen.add((path, section))
+        if not section.startswith(RAM_SECTIONS):
+            print(f"FAIL placement: {name} is in {section}, i.e. flash")
+            failed = True
+            continue
+        for target in sorted(references.get((path, section), ())):
+            if target in functions:
+                queue.append((functions[target], f"{target}, from {name}"))
+            elif target.startswith(".text"):
+                queue.append(((path, target), f"{target}, from {name}"))
+            elif target.startswith(RAM_SECTIONS):
+                queue.append(((path, target), f"{target}, from {name}"))
+
+    scratch_x = sum(size for (path, name), size in sections.items() if name.startswith(".scratch_x."))
+    if scratch_x > SCRATCH_X_BUDGET:
+        print(f"FAIL placement: {scratch_x} bytes in SCRATCH_X, more than {SCRATCH_X_BUDGET}")
+        failed = True
+
+    if not failed:
+        ram = sum(sections[key] for key in seen)
+        print(f"ok   placement: {len(seen)} sections, {ram} bytes in RAM, {scratch_x} in SCRATCH_X")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
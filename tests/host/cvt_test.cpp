@@ -0,0 +1,107 @@
+// Checks dvi_cvt_rb_timing() against published CVT reduced blanking
+// timings, and the timings of the mode table against their refresh rates.
+
+#include <stdio.h>
+
+#include "dvhstx.hpp"
+
+namespace {
+    struct KnownTiming {
+        int width, height, refresh_hz;
+        uint32_t pixel_clock_khz;
+        int v_total, v_sync_width, v_back_porch;
+    };
+
+    // From the VESA CVT 1.2 spreadsheet, or `cvt -r`
+    const KnownTiming known_timings[] = {
+        { 1280,  720, 60,  64000,  741, 5, 13 },
+        { 1280,  720, 50,  53000,  737, 5,  9 },
+        { 1024,  768, 60,  56000,  790, 4, 15 },
+        { 1280,  800, 60,  71000,  823, 6, 14 },
+        { 1280, 1024, 60,  91000, 1054, 7, 20 },
+        { 1440,  900, 60,  88750,  926, 6, 17 },
+        { 1600,  900, 60,  97750,  926, 5, 18 },
+        { 1680, 1050, 60, 119000, 1080, 6, 21 },
+        { 1920, 1080, 60, 138500, 1111, 5, 23 },
+        { 1920, 1200, 60, 154000, 1235, 6, 26 },
+    };
+
+    struct TableTiming {
+        const char* name;
+        const struct dvi_timing* timing;
+        int refresh_hz;
+        bool cvt_rb;
+    };
+
+    const TableTiming table_timings[] = {
+        { "640x480p60",      &dvi_timing_640x480p_60hz,          60, false },
+        { "720x480p60",      &dvi_timing_720x480p_60hz,          60, false },
+        { "720x576p50",      &dvi_timing_720x576p_50hz,          50, false },
+        { "720x400p70",      &dvi_timing_720x400p_70hz,          70, false },
+        { "800x480p60",      &dvi_timing_800x480p_60hz,          60, false },
+        { "800x450p60",      &dvi_timing_800x450p_60hz,          60, false },
+        { "800x600p60",      &dvi_timing_800x600p_60hz,          60, false },
+        { "960x540p60",      &dvi_timing_960x540p_60hz,          60, false },
+        { "960x540p50",      &dvi_timing_960x540p_50hz,          50, false },
+        { "1024x768p60 RB",  &dvi_timing_1024x768_rb_60hz,       60, true },
+        { "1280x720p50 RB",  &dvi_timing_1280x720p_rb_50hz,      50, false },   // 52.8MHz, not CVT's 53MHz
+        { "1280x720p60 RB",  &dvi_timing_1280x720p_rb_60hz,      60, true },
+        { "1920x1080p30",    &dvi_timing_1920x1080p_rb2_30hz,    30, false },
+    };
+
+    int h_total(const struct dvi_timing& t) {
+        return t.h_front_porch + t.h_sync_width + t.h_back_porch + t.h_active_pixels;
+    }
+
+    int v_total(const struct dvi_timing& t) {
+        return t.v_front_porch + t.v_sync_width + t.v_back_porch + t.v_active_lines;
+    }
+
+    bool same_timing(const struct dvi_timing& a, const struct dvi_timing& b) {
+        return a.h_sync_polarity == b.h_sync_polarity && a.h_front_porch == b.h_front_porch &&
+               a.h_sync_width == b.h_sync_width && a.h_back_porch == b.h_back_porch &&
+               a.h_active_pixels == b.h_active_pixels && a.v_sync_polarity == b.v_sync_polarity &&
+               a.v_front_porch == b.v_front_porch && a.v_sync_width == b.v_sync_width &&
+               a.v_back_porch == b.v_back_porch && a.v_active_lines == b.v_active_lines &&
+               a.bit_clk_khz == b.bit_clk_khz;
+    }
+}
+
+int main() {
+    int failed = 0;
+
+    for (const KnownTiming& k : known_timings) {
+        struct dvi_timing t;
+        const bool ok = dvi_cvt_rb_timing(&t, k.width, k.height, k.refresh_hz);
+        const bool good = ok && t.bit_clk_khz == k.pixel_clock_khz * 10 && t.h_active_pixels == k.width &&
+                          t.v_active_lines == k.height && h_total(t) == k.width + 160 && v_total(t) == k.v_total &&
+                          t.v_sync_width == k.v_sync_width && t.v_back_porch == k.v_back_porch &&
+                          t.h_sync_polarity && !t.v_sync_polarity;
+        if (good) printf("ok   CVT-RB %dx%d@%d\n", k.width, k.height, k.refresh_hz);
+        else printf("FAIL CVT-RB %dx%d@%d: %u kHz, %d lines, vsync %d, back porch %d\n", k.width, k.height, k.refresh_hz,
+                    t.bit_clk_khz / 10, v_total(t), t.v_sync_width, t.v_back_porch);
+        failed += !good;
+    }
+
+    struct dvi_timing t;
+    const bool invalid_ok = !dvi_cvt_rb_timing(&t, 0, 480, 60) && !dvi_cvt_rb_timing(&t, 640, 0, 60) &&
+                            !dvi_cvt_rb_timing(&t, 640, 480, 0) && !dvi_cvt_rb_timing(&t, 640, 480, 3000);
+    printf("%s CVT-RB rejects invalid sizes and rates\n", invalid_ok ? "ok  " : "FAIL");
+    failed += !invalid_ok;
+
+    // Every timing in the table is within 1% of its refresh rate, and those
+    // taken from CVT-RB are exactly what the formula gives
+    for (const TableTiming& m : table_timings) {
+        const double refresh = m.timing->bit_clk_khz * 100.0 / ((double)h_total(*m.timing) * v_total(*m.timing));
+        bool good = refresh > m.refresh_hz * 0.99 && refresh < m.refresh_hz * 1.01;
+        if (m.cvt_rb) {
+            good = good && dvi_cvt_rb_timing(&t, m.timing->h_active_pixels, m.timing->v_active_lines, m.refresh_hz) &&
+                   same_timing(t, *m.timing);
+        }
+        if (good) printf("ok   %s\n", m.name);
+        else printf("FAIL %s: %.2f Hz%s\n", m.name, refresh, m.cvt_rb ? ", or differs from CVT-RB" : "");
+        failed += !good;
+    }
+
+    return failed ? 1 : 0;
+}
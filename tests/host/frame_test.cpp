@@ -0,0 +1,77 @@
+// Checks that the line buffer modes start every frame, even when the IRQ
+// or core 1 is held off for long enough that the first line of the frame
+// is shown before it could be rendered.
+//
+// The scroll position is changed, then the renderer is stalled at points
+// spread through the next frame.  Whichever lines are missed, the frame
+// after must be rendered at the new position.
+
+#include <stdio.h>
+
+#include "dvhstx.hpp"
+#include "host/hstx_emu.hpp"
+
+using namespace pimoroni;
+
+namespace {
+    constexpr int WIDTH = 320;
+    constexpr int HEIGHT = 180;
+    constexpr int SCROLL_X = 7;
+    constexpr int STALL_BLOCKS = 40;
+    constexpr int STALL_STEP = 15;
+    constexpr int FRAME_BLOCKS = 1500;
+
+    // Returns the number of lines shown at the old scroll position
+    int run_stalled(bool core1, int start, bool* ok) {
+        DVHSTX display;
+        if (core1) display.set_render_core1(true);
+        if (!display.init(WIDTH, HEIGHT, DVHSTX::MODE_PALETTE, false, {12, 14, 16, 18})) {
+            *ok = false;
+            return 0;
+        }
+        for (int i = 0; i < DVHSTX::PALETTE_SIZE; ++i) display.get_palette()[i] = i * 0x010101;
+        uint8_t* fb = display.get_back_buffer<uint8_t>();
+        const int stride = display.get_stride();
+        for (int y = 0; y < HEIGHT; ++y)
+            for (int x = 0; x < WIDTH; ++x) fb[y * stride + x] = x + y;
+
+        HSTXEmulator emu;
+        emu.run_frames(1);
+        display.set_scroll(SCROLL_X, 0);
+        for (int i = 0; i < start; ++i) emu.step();
+        emu.stall_irqs(STALL_BLOCKS);
+        *ok = emu.run_frames(2) && emu.get_error_count() == 0;
+
+        // The left hand pixel of each source line's first output line
+        const std::vector<uint32_t>& frame = emu.get_frame();
+        const int frame_width = emu.get_frame_width();
+        const int v_repeat = emu.get_frame_height() / HEIGHT;
+        int old_lines = 0;
+        for (int y = 0; y < HEIGHT; ++y) {
+            if (frame[y * v_repeat * frame_width] == (uint32_t)(y & 0xff) * 0x010101) ++old_lines;
+        }
+        display.reset();
+        return old_lines;
+    }
+}
+
+int main() {
+    int failed = 0;
+    for (bool core1 : { false, true }) {
+        int worst = 0, worst_start = 0;
+        bool ok = true;
+        for (int start = 0; start < FRAME_BLOCKS && ok; start += STALL_STEP) {
+            const int old_lines = run_stalled(core1, start, &ok);
+            if (old_lines > worst) {
+                worst = old_lines;
+                worst_start = start;
+            }
+        }
+        const char* name = core1 ? "late first line, core 1" : "late first line, IRQ";
+        if (!ok) printf("FAIL %s: emulation failed\n", name);
+        else if (worst) printf("FAIL %s: %d lines at the old scroll position, stalled at block %d\n", name, worst, worst_start);
+        else printf("ok   %s\n", name);
+        failed += !ok || worst;
+    }
+    return failed ? 1 : 0;
+}
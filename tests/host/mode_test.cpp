@@ -0,0 +1,415 @@
+// Pixel exact regression test of every mode, run on the host through the
+// DMA/HSTX emulator.
+//
+// Each case draws a pattern into the frame buffer set up by DVHSTX::init(),
+// emulates two frames and compares the last one with a reference model of
+// the mode: the frame buffer pixel each output pixel should come from, at
+// the precision of the mode, or the border colour around a picture that
+// doesn't fill the screen.  The line timing is checked against the timing
+// the mode is expected to use.  The text modes are only checked for timing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "dvhstx.hpp"
+#include "host/hstx_emu.hpp"
+
+using namespace pimoroni;
+
+namespace {
+    constexpr RGB888 BORDER_COLOUR = 0x3366a9;
+    constexpr int TILE_BYTES = 1024 * 16 * 16 / 2;
+
+    uint8_t tiles[TILE_BYTES];
+
+    struct TestCase {
+        uint16_t width;
+        uint16_t height;
+        DVHSTX::Mode mode;
+        const struct dvi_timing* expected_timing;
+        const struct dvi_timing* custom_timing;
+        uint8_t scale_h, scale_v;
+        bool core1;
+        bool cleared_effects = false;   // Palette raster effects shown, then cleared
+    };
+
+    const char* mode_name(DVHSTX::Mode mode) {
+        switch (mode) {
+        case DVHSTX::MODE_RGB565: return "RGB565";
+        case DVHSTX::MODE_PALETTE: return "PALETTE";
+        case DVHSTX::MODE_RGB888: return "RGB888";
+        case DVHSTX::MODE_TEXT_MONO: return "TEXT_MONO";
+        case DVHSTX::MODE_TEXT_RGB111: return "TEXT_RGB111";
+        case DVHSTX::MODE_PALETTE1: return "PALETTE1";
+        case DVHSTX::MODE_PALETTE2: return "PALETTE2";
+        case DVHSTX::MODE_PALETTE4: return "PALETTE4";
+        case DVHSTX::MODE_RGB332: return "RGB332";
+        case DVHSTX::MODE_RGB222: return "RGB222";
+        case DVHSTX::MODE_PALETTE_RGB565: return "PALETTE_RGB565";
+        case DVHSTX::MODE_YCBCR420: return "YCBCR420";
+        case DVHSTX::MODE_TILES8: return "TILES8";
+        case DVHSTX::MODE_TILES16: return "TILES16";
+        }
+        return "?";
+    }
+
+    bool is_text(DVHSTX::Mode mode) {
+        return mode == DVHSTX::MODE_TEXT_MONO || mode == DVHSTX::MODE_TEXT_RGB111;
+    }
+
+    // RGB888 at the precision each mode sends
+    uint32_t rgb565_to_rgb888(uint16_t p) {
+        return ((p >> 11 & 31) << 19) | ((p >> 5 & 63) << 10) | ((p & 31) << 3);
+    }
+
+    uint32_t mode_precision(DVHSTX::Mode mode, uint32_t c) {
+        switch (mode) {
+        case DVHSTX::MODE_RGB565:
+        case DVHSTX::MODE_PALETTE_RGB565:
+        case DVHSTX::MODE_YCBCR420:
+            return c & 0xf8fcf8;
+        case DVHSTX::MODE_RGB332:
+            return c & 0xe0e0c0;
+        case DVHSTX::MODE_RGB222:
+            return c & 0xc0c0c0;
+        default:
+            return c;
+        }
+    }
+
+    // Full range BT.601, as scanline_ycbcr420(), at RGB565 precision
+    uint32_t ycbcr_to_rgb(int y, int cb, int cr) {
+        auto clamp = [](int v) { return v < 0 ? 0 : v > 255 ? 255 : v; };
+        const int c = cb - 128, d = cr - 128;
+        const int r = clamp(y + ((91881 * d + 32768) >> 16));
+        const int g = clamp(y + ((-22554 * c + 32768) >> 16) + ((-46802 * d + 32768) >> 16));
+        const int b = clamp(y + ((116130 * c + 32768) >> 16));
+        return mode_precision(DVHSTX::MODE_YCBCR420, (r << 16) | (g << 8) | b);
+    }
+
+    void fill_palette(DVHSTX& display) {
+        RGB888* palette = display.get_palette();
+        for (int i = 0; i < DVHSTX::PALETTE_SIZE; ++i) palette[i] = (i * 0x2a1f13 + 0x102030) & 0xffffff;
+        display.commit_palette();
+    }
+
+    // Draw a pattern that differs from pixel to pixel and line to line
+    void draw_pattern(DVHSTX& display, const TestCase& t) {
+        const int w = display.get_width(), h = t.height;
+        const int stride = display.get_stride();
+        switch (t.mode) {
+        case DVHSTX::MODE_RGB565: {
+            uint16_t* fb = display.get_back_buffer<uint16_t>();
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x) fb[y * stride / 2 + x] = ((x * 31 / w) << 11) | ((y * 63 / h) << 5) | ((x ^ y) & 31);
+            break;
+        }
+        case DVHSTX::MODE_RGB888: {
+            uint32_t* fb = display.get_back_buffer<uint32_t>();
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x) fb[y * stride / 4 + x] = ((x * 255 / w) << 16) | ((y * 255 / h) << 8) | ((x ^ y) & 255);
+            break;
+        }
+        case DVHSTX::MODE_PALETTE:
+        case DVHSTX::MODE_PALETTE_RGB565:
+        case DVHSTX::MODE_RGB332:
+        case DVHSTX::MODE_RGB222: {
+            fill_palette(display);
+            uint8_t* fb = display.get_back_buffer<uint8_t>();
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x) fb[y * stride + x] = x * 7 + y * 13;
+            break;
+        }
+        case DVHSTX::MODE_PALETTE1:
+        case DVHSTX::MODE_PALETTE2:
+        case DVHSTX::MODE_PALETTE4: {
+            fill_palette(display);
+            const int bpp = 1 << (t.mode - DVHSTX::MODE_PALETTE1);
+            uint8_t* fb = display.get_back_buffer<uint8_t>();
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    const int v = ((x / 3) ^ (y / 2)) & ((1 << bpp) - 1);
+                    fb[y * stride + x * bpp / 8] |= v << (8 - bpp * (x % (8 / bpp) + 1));
+                }
+            }
+            break;
+        }
+        case DVHSTX::MODE_YCBCR420: {
+            uint8_t* luma = display.get_back_plane(DVHSTX::PLANE_Y);
+            uint8_t* cb = display.get_back_plane(DVHSTX::PLANE_CB);
+            uint8_t* cr = display.get_back_plane(DVHSTX::PLANE_CR);
+            const int chroma_stride = display.get_plane_stride(DVHSTX::PLANE_CB);
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x) luma[y * stride + x] = x * 5 + y * 3;
+            for (int y = 0; y < (h + 1) / 2; ++y) {
+                for (int x = 0; x < chroma_stride; ++x) {
+                    cb[y * chroma_stride + x] = x * 7 + y;
+                    cr[y * chroma_stride + x] = 255 - x * 3 - y * 5;
+                }
+            }
+            break;
+        }
+        case DVHSTX::MODE_TILES8:
+        case DVHSTX::MODE_TILES16: {
+            fill_palette(display);
+            display.set_tiles(tiles);
+            uint16_t* map = display.get_back_buffer<uint16_t>();
+            for (int i = 0; i < display.get_map_columns() * display.get_map_rows(); ++i) map[i] = rand();
+            break;
+        }
+        case DVHSTX::MODE_TEXT_MONO: {
+            uint8_t* fb = display.get_back_buffer<uint8_t>();
+            for (int i = 0; i < 91 * 30; ++i) fb[i] = ' ' + i % 95;
+            break;
+        }
+        case DVHSTX::MODE_TEXT_RGB111: {
+            uint8_t* fb = display.get_back_buffer<uint8_t>();
+            for (int i = 0; i < 91 * 30; ++i) {
+                fb[2 * i] = ' ' + i % 95;
+                fb[2 * i + 1] = DVHSTX::TEXT_WHITE;
+            }
+            break;
+        }
+        }
+    }
+
+    // The colour of frame buffer pixel (x, y)
+    uint32_t source_pixel(DVHSTX& display, const TestCase& t, int x, int y) {
+        const int stride = display.get_stride();
+        const RGB888* palette = display.get_palette();
+        switch (t.mode) {
+        case DVHSTX::MODE_RGB565:
+            return rgb565_to_rgb888(display.get_front_buffer<uint16_t>()[y * stride / 2 + x]);
+        case DVHSTX::MODE_RGB888:
+            return display.get_front_buffer<uint32_t>()[y * stride / 4 + x];
+        case DVHSTX::MODE_PALETTE:
+        case DVHSTX::MODE_PALETTE_RGB565:
+            return mode_precision(t.mode, palette[display.get_front_buffer<uint8_t>()[y * stride + x]]);
+        case DVHSTX::MODE_RGB332: {
+            const int p = display.get_front_buffer<uint8_t>()[y * stride + x];
+            return ((p >> 5) << 21) | ((p >> 2 & 7) << 13) | ((p & 3) << 6);
+        }
+        case DVHSTX::MODE_RGB222: {
+            const int p = display.get_front_buffer<uint8_t>()[y * stride + x];
+            return ((p >> 4 & 3) << 22) | ((p >> 2 & 3) << 14) | ((p & 3) << 6);
+        }
+        case DVHSTX::MODE_PALETTE1:
+        case DVHSTX::MODE_PALETTE2:
+        case DVHSTX::MODE_PALETTE4: {
+            const int bpp = 1 << (t.mode - DVHSTX::MODE_PALETTE1);
+            const uint8_t b = display.get_front_buffer<uint8_t>()[y * stride + x * bpp / 8];
+            return palette[(b >> (8 - bpp * (x % (8 / bpp) + 1))) & ((1 << bpp) - 1)];
+        }
+        case DVHSTX::MODE_YCBCR420: {
+            const int chroma_stride = display.get_plane_stride(DVHSTX::PLANE_CB);
+            const int c = (y / 2) * chroma_stride + x / 2;
+            return ycbcr_to_rgb(display.get_front_plane(DVHSTX::PLANE_Y)[y * stride + x],
+                                display.get_front_plane(DVHSTX::PLANE_CB)[c],
+                                display.get_front_plane(DVHSTX::PLANE_CR)[c]);
+        }
+        case DVHSTX::MODE_TILES8:
+        case DVHSTX::MODE_TILES16: {
+            const int size = display.get_tile_size();
+            const uint16_t entry = display.get_front_buffer<uint16_t>()[(y / size) * display.get_map_columns() + x / size];
+            int tx = x % size, ty = y % size;
+            if (entry & SCANLINE_TILE_HFLIP) tx = size - 1 - tx;
+            if (entry & SCANLINE_TILE_VFLIP) ty = size - 1 - ty;
+            const uint8_t b = tiles[(entry & SCANLINE_TILE_INDEX_MASK) * size * size / 2 + ty * size / 2 + tx / 2];
+            return palette[(entry >> SCANLINE_TILE_BANK_SHIFT) * 16 + ((tx & 1) ? (b & 15) : (b >> 4))];
+        }
+        default:
+            return 0;
+        }
+    }
+
+    bool run_case(const TestCase& t) {
+        char name[96];
+        snprintf(name, sizeof(name), "%dx%d %s%s", t.width, t.height, mode_name(t.mode), t.core1 ? " core1" : "");
+        if (t.scale_h) snprintf(name + strlen(name), sizeof(name) - strlen(name), " scale %dx%d", t.scale_h, t.scale_v);
+        if (t.custom_timing) snprintf(name + strlen(name), sizeof(name) - strlen(name), " custom timing");
+        if (t.cleared_effects) snprintf(name + strlen(name), sizeof(name) - strlen(name), " cleared effects");
+
+        DVHSTX display;
+        display.set_scale(t.scale_h, t.scale_v);
+        display.set_timing(t.custom_timing);
+        display.set_border_colour(BORDER_COLOUR);
+        if (t.core1) display.set_render_core1(true);
+        if (!display.init(t.width, t.height, t.mode, false, {12, 14, 16, 18})) {
+            printf("FAIL %s: init failed\n", name);
+            return false;
+        }
+        draw_pattern(display, t);
+
+        HSTXEmulator emu;
+        if (t.cleared_effects) {
+            DVHSTX::RasterEffect effects[16];
+            for (int i = 0; i < 16; ++i) effects[i] = DVHSTX::palette_effect(i * t.height / 16, i, 0xffffff - i);
+            display.set_raster_effects(effects, 16);
+            emu.run_frames(2);
+            display.clear_raster_effects();
+        }
+        const bool ran = emu.run_frames(2);
+        int errors = 0;
+        if (!ran || emu.get_error_count()) {
+            printf("FAIL %s: emulation %s, %u decode errors\n", name, ran ? "ran" : "stalled", emu.get_error_count());
+            ++errors;
+        }
+
+        // Every line the length of the timing, with sync and active lines
+        // where they should be.  The emulator splits lines at the start of
+        // hsync, part way into the line vsync changes on, so a vsync pulse
+        // of v_sync_width lines touches one more.
+        const struct dvi_timing& timing = *t.expected_timing;
+        const uint32_t h_total = timing.h_front_porch + timing.h_sync_width + timing.h_back_porch + timing.h_active_pixels;
+        const int v_total = timing.v_front_porch + timing.v_sync_width + timing.v_back_porch + timing.v_active_lines;
+        const auto& lines = emu.get_frame_timing();
+        int vsync_lines = 0, active_lines = 0, bad_lines = 0;
+        for (const auto& line : lines) {
+            vsync_lines += line.vsync;
+            if (line.active_pixels) ++active_lines;
+            if (line.clocks != h_total || (line.active_pixels && line.active_pixels != (uint32_t)timing.h_active_pixels)) ++bad_lines;
+        }
+        if ((int)lines.size() != v_total || vsync_lines != timing.v_sync_width + 1 || active_lines != timing.v_active_lines || bad_lines) {
+            printf("FAIL %s: %zu lines (%d expected), %d vsync, %d active, %d wrong length\n",
+                   name, lines.size(), v_total, vsync_lines, active_lines, bad_lines);
+            ++errors;
+        }
+
+        // The picture, centred with borders, lines shared out as evenly as
+        // possible down it
+        const int frame_width = emu.get_frame_width(), frame_height = emu.get_frame_height();
+        long mismatches = 0;
+        int first_x = -1, first_y = -1;
+        if (!errors && !is_text(t.mode)) {
+            const int width = display.get_width();
+            const int h_repeat = t.scale_h ? t.scale_h : frame_width / width;
+            const int picture_lines = t.scale_v ? t.height * t.scale_v : frame_height;
+            const int border_left = (frame_width - width * h_repeat) / 2;
+            const int border_top = (frame_height - picture_lines) / 2;
+            const uint32_t border = mode_precision(t.mode, BORDER_COLOUR);
+            const std::vector<uint32_t>& frame = emu.get_frame();
+
+            for (int y = 0; y < frame_height; ++y) {
+                // Picture line y shows the first source line whose share of
+                // the picture reaches past it
+                const int line = y - border_top;
+                const bool picture_line = line >= 0 && line < picture_lines;
+                int sy = 0;
+                while (picture_line && ((sy + 1) * picture_lines + t.height - 1) / t.height <= line) ++sy;
+                for (int x = 0; x < frame_width; ++x) {
+                    const int column = x - border_left;
+                    const bool picture = picture_line && column >= 0 && column < width * h_repeat;
+                    const uint32_t expected = picture ? source_pixel(display, t, column / h_repeat, sy) : border;
+                    if (frame[y * frame_width + x] != expected && !mismatches++) {
+                        first_x = x;
+                        first_y = y;
+                    }
+                }
+            }
+            if (mismatches) {
+                printf("FAIL %s: %ld pixels differ, first at (%d, %d)\n", name, mismatches, first_x, first_y);
+                ++errors;
+            }
+        }
+
+        if (!errors) printf("ok   %s\n", name);
+        display.reset();
+        return !errors;
+    }
+}
+
+int main() {
+    srand(1);
+    for (uint8_t& b : tiles) b = rand();
+
+    const DVHSTX::Mode graphics_modes[] = {
+        DVHSTX::MODE_RGB565, DVHSTX::MODE_PALETTE, DVHSTX::MODE_RGB888, DVHSTX::MODE_PALETTE1,
+        DVHSTX::MODE_PALETTE2, DVHSTX::MODE_PALETTE4, DVHSTX::MODE_RGB332, DVHSTX::MODE_RGB222,
+        DVHSTX::MODE_PALETTE_RGB565, DVHSTX::MODE_YCBCR420, DVHSTX::MODE_TILES8, DVHSTX::MODE_TILES16,
+    };
+
+    std::vector<TestCase> cases;
+
+    // Every graphics mode at a table size for each repeat, and scaled to fit
+    const struct { uint16_t width, height; const struct dvi_timing* timing; } sizes[] = {
+        { 320, 180, &dvi_timing_1280x720p_rb_50hz },
+        { 640, 360, &dvi_timing_1280x720p_rb_50hz },
+        { 320, 240, &dvi_timing_640x480p_60hz },
+        { 400, 300, &dvi_timing_800x600p_60hz },
+        { 256, 224, &dvi_timing_1280x720p_rb_50hz },
+        { 426, 240, &dvi_timing_1280x720p_rb_50hz },
+    };
+    for (const auto& size : sizes) {
+        for (DVHSTX::Mode mode : graphics_modes) {
+            cases.push_back({ size.width, size.height, mode, size.timing, nullptr, 0, 0, false });
+        }
+    }
+
+    // The rest of the mode table
+    const struct { uint16_t width, height; const struct dvi_timing* timing; } table_sizes[] = {
+        { 400, 225, &dvi_timing_800x450p_60hz },
+        { 360, 240, &dvi_timing_720x480p_60hz },
+        { 360, 200, &dvi_timing_720x400p_70hz },
+        { 360, 288, &dvi_timing_720x576p_50hz },
+        { 480, 270, &dvi_timing_1920x1080p_rb2_30hz },
+        { 512, 384, &dvi_timing_1024x768_rb_60hz },
+        { 400, 240, &dvi_timing_800x480p_60hz },
+    };
+    for (const auto& size : table_sizes) {
+        cases.push_back({ size.width, size.height, DVHSTX::MODE_RGB565, size.timing, nullptr, 0, 0, false });
+        cases.push_back({ size.width, size.height, DVHSTX::MODE_PALETTE, size.timing, nullptr, 0, 0, false });
+    }
+
+    // Widths that aren't whole transfers, which are widened to them
+    cases.push_back({ 1001, 700, DVHSTX::MODE_RGB565, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 1002, 700, DVHSTX::MODE_RGB332, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    for (DVHSTX::Mode mode : graphics_modes) {
+        cases.push_back({ 641, 480, mode, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    }
+    cases.push_back({ 641, 480, DVHSTX::MODE_YCBCR420, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+
+    // Heights with few divisors, which the ring of line buffers needn't divide
+    cases.push_back({ 300, 199, DVHSTX::MODE_PALETTE, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 426, 239, DVHSTX::MODE_RGB565, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 426, 239, DVHSTX::MODE_TILES8, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+    cases.push_back({ 640, 353, DVHSTX::MODE_PALETTE4, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 640, 353, DVHSTX::MODE_YCBCR420, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+    cases.push_back({ 1280, 719, DVHSTX::MODE_PALETTE1, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 1280, 719, DVHSTX::MODE_PALETTE2, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+
+    // Native resolutions in the packed and tile modes
+    cases.push_back({ 1280, 720, DVHSTX::MODE_PALETTE1, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 1280, 720, DVHSTX::MODE_PALETTE4, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 1280, 720, DVHSTX::MODE_TILES16, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 1920, 1080, DVHSTX::MODE_PALETTE1, &dvi_timing_1920x1080p_rb2_30hz, nullptr, 0, 0, false });
+
+    // Fixed scales, leaving borders all round, and another timing
+    cases.push_back({ 320, 240, DVHSTX::MODE_RGB565, &dvi_timing_1280x720p_rb_50hz, nullptr, 3, 3, false });
+    cases.push_back({ 320, 240, DVHSTX::MODE_PALETTE4, &dvi_timing_1280x720p_rb_50hz, nullptr, 3, 3, false });
+    cases.push_back({ 300, 200, DVHSTX::MODE_YCBCR420, &dvi_timing_1280x720p_rb_50hz, nullptr, 4, 3, false });
+    cases.push_back({ 320, 180, DVHSTX::MODE_RGB565, &dvi_timing_1280x720p_rb_60hz, &dvi_timing_1280x720p_rb_60hz, 0, 0, false });
+    cases.push_back({ 300, 200, DVHSTX::MODE_PALETTE, &dvi_timing_1280x720p_rb_60hz, &dvi_timing_1280x720p_rb_60hz, 0, 0, false });
+
+    // Rendering on core 1
+    cases.push_back({ 320, 180, DVHSTX::MODE_PALETTE, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+    cases.push_back({ 256, 224, DVHSTX::MODE_YCBCR420, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+    cases.push_back({ 426, 240, DVHSTX::MODE_PALETTE_RGB565, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+    cases.push_back({ 640, 360, DVHSTX::MODE_TILES8, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true });
+
+    // The palette after raster effects that changed it are cleared
+    for (DVHSTX::Mode mode : { DVHSTX::MODE_PALETTE, DVHSTX::MODE_PALETTE_RGB565, DVHSTX::MODE_PALETTE4, DVHSTX::MODE_TILES8 }) {
+        cases.push_back({ 320, 180, mode, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false, true });
+    }
+    cases.push_back({ 320, 180, DVHSTX::MODE_PALETTE_RGB565, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, true, true });
+
+    // Text
+    cases.push_back({ 91, 30, DVHSTX::MODE_TEXT_MONO, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+    cases.push_back({ 91, 30, DVHSTX::MODE_TEXT_RGB111, &dvi_timing_1280x720p_rb_50hz, nullptr, 0, 0, false });
+
+    int failed = 0;
+    for (const TestCase& t : cases) failed += !run_case(t);
+    printf("%zu cases, %d failed\n", cases.size(), failed);
+    return failed ? 1 : 0;
+}
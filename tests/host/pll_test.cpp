@@ -0,0 +1,255 @@
+// Checks dvi_find_pll_config() against a search of every legal system PLL
+// setting, and the clocks init() sets up for every timing, mode and
+// ClockProfile.
+//
+// Each solution must be within tolerance, report its error correctly and
+// respect the PLL limits: a reference of at least 5MHz, a feedback divider
+// of 16 to 320, a VCO of 750 to 1600MHz and post dividers of 1 to 7.  The
+// closest frequency must win, or the lowest VCO with low_vco set, and exact
+// frequencies must get the same setting as check_sys_clock_khz().
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dvhstx.hpp"
+
+using namespace pimoroni;
+
+namespace {
+    constexpr uint64_t XOSC_HZ = (uint64_t)XOSC_KHZ * KHZ;
+    constexpr uint32_t DEFAULT_SYS_HZ = 264 * MHZ;
+    constexpr uint32_t LOW_POWER_SYS_HZ = 132 * MHZ;
+    constexpr uint32_t tolerances_ppm[] = { 0, 100, 1000, 5000 };
+
+    struct TableTiming {
+        const char* name;
+        const struct dvi_timing* timing;
+    };
+
+    const TableTiming table_timings[] = {
+        { "640x480p60",      &dvi_timing_640x480p_60hz },
+        { "720x480p60",      &dvi_timing_720x480p_60hz },
+        { "720x576p50",      &dvi_timing_720x576p_50hz },
+        { "720x400p70",      &dvi_timing_720x400p_70hz },
+        { "800x480p60",      &dvi_timing_800x480p_60hz },
+        { "800x450p60",      &dvi_timing_800x450p_60hz },
+        { "800x600p60",      &dvi_timing_800x600p_60hz },
+        { "960x540p60",      &dvi_timing_960x540p_60hz },
+        { "960x540p50",      &dvi_timing_960x540p_50hz },
+        { "1024x768p60 RB",  &dvi_timing_1024x768_rb_60hz },
+        { "1280x720p50 RB",  &dvi_timing_1280x720p_rb_50hz },
+        { "1280x720p60 RB",  &dvi_timing_1280x720p_rb_60hz },
+        { "1920x1080p30",    &dvi_timing_1920x1080p_rb2_30hz },
+    };
+
+    // CVT-RB timings, most of which the PLL can only get near
+    const int cvt_sizes[][3] = {
+        { 1280, 1024, 60 }, { 1366,  768, 60 }, { 1280,  800, 60 },
+        { 1440,  900, 60 }, { 1600,  900, 60 }, { 1024,  600, 60 },
+        { 1280,  720, 60 }, {  800,  600, 75 }, { 1920, 1080, 30 },
+    };
+
+    const DVHSTX::Mode modes[] = {
+        DVHSTX::MODE_RGB565, DVHSTX::MODE_PALETTE, DVHSTX::MODE_RGB888,
+        DVHSTX::MODE_TEXT_MONO, DVHSTX::MODE_TEXT_RGB111, DVHSTX::MODE_PALETTE1,
+        DVHSTX::MODE_PALETTE2, DVHSTX::MODE_PALETTE4, DVHSTX::MODE_RGB332,
+        DVHSTX::MODE_RGB222, DVHSTX::MODE_PALETTE_RGB565, DVHSTX::MODE_YCBCR420,
+        DVHSTX::MODE_TILES8, DVHSTX::MODE_TILES16,
+    };
+
+    const char* profile_name(DVHSTX::ClockProfile profile) {
+        switch (profile) {
+        case DVHSTX::CLOCK_EXACT_PIXEL: return "EXACT_PIXEL";
+        case DVHSTX::CLOCK_MAX_CPU: return "MAX_CPU";
+        case DVHSTX::CLOCK_LOW_POWER: return "LOW_POWER";
+        }
+        return "?";
+    }
+
+    // Distance of vco / div from target, scaled by div
+    uint64_t scaled_diff(uint64_t vco_hz, uint64_t div, uint64_t target_hz) {
+        const uint64_t scaled_target = target_hz * div;
+        return vco_hz > scaled_target ? vco_hz - scaled_target : scaled_target - vco_hz;
+    }
+
+    // The best error in parts per billion and lowest VCO of every legal
+    // setting within tolerance, the slow way
+    struct Reference {
+        bool found = false;
+        uint64_t best_error_ppb = 0;
+        uint64_t lowest_vco_hz = 0;
+        uint64_t lowest_vco_error_ppb = 0;
+    };
+
+    Reference search_all(uint freq_khz, uint32_t tolerance_ppm) {
+        const uint64_t target_hz = (uint64_t)freq_khz * KHZ;
+        Reference ref;
+        for (uint refdiv = 1; refdiv <= 63; ++refdiv) {
+            if (XOSC_HZ % refdiv || XOSC_HZ / refdiv < 5 * MHZ) continue;
+            for (uint fbdiv = 16; fbdiv <= 320; ++fbdiv) {
+                const uint64_t vco_hz = XOSC_HZ / refdiv * fbdiv;
+                if (vco_hz < 750ull * MHZ || vco_hz > 1600ull * MHZ) continue;
+                for (uint pd1 = 1; pd1 <= 7; ++pd1) {
+                    for (uint pd2 = 1; pd2 <= 7; ++pd2) {
+                        const uint64_t div = pd1 * pd2;
+                        const uint64_t diff = scaled_diff(vco_hz, div, target_hz);
+                        if (diff * 1000000 > (uint64_t)tolerance_ppm * target_hz * div) continue;
+                        const uint64_t error_ppb = diff * 1000000000 / (target_hz * div);
+                        if (!ref.found || error_ppb < ref.best_error_ppb) ref.best_error_ppb = error_ppb;
+                        if (!ref.found || vco_hz < ref.lowest_vco_hz ||
+                            (vco_hz == ref.lowest_vco_hz && error_ppb < ref.lowest_vco_error_ppb)) {
+                            ref.lowest_vco_hz = vco_hz;
+                            ref.lowest_vco_error_ppb = error_ppb;
+                        }
+                        ref.found = true;
+                    }
+                }
+            }
+        }
+        return ref;
+    }
+
+    // Returns an empty string if the solution for freq_khz is right, or
+    // what is wrong with it
+    const char* check_solution(uint freq_khz, uint32_t tolerance_ppm, bool low_vco) {
+        struct dvi_pll_config c;
+        const bool found = dvi_find_pll_config(&c, freq_khz, tolerance_ppm, low_vco);
+        const Reference ref = search_all(freq_khz, tolerance_ppm);
+        if (found != ref.found) return found ? "found a setting out of tolerance" : "missed a setting in tolerance";
+        if (!found) return "";
+
+        if (!c.refdiv || XOSC_HZ % c.refdiv || XOSC_HZ / c.refdiv < 5 * MHZ) return "reference below 5MHz";
+        const uint64_t ref_hz = XOSC_HZ / c.refdiv;
+        if (c.vco_freq_hz % ref_hz || c.vco_freq_hz / ref_hz < 16 || c.vco_freq_hz / ref_hz > 320) return "feedback divider out of range";
+        if (c.vco_freq_hz < 750 * MHZ || c.vco_freq_hz > 1600 * MHZ) return "VCO out of range";
+        if (c.post_div1 < 1 || c.post_div1 > 7 || c.post_div2 < 1 || c.post_div2 > c.post_div1) return "post dividers out of range";
+
+        const uint64_t div = c.post_div1 * c.post_div2;
+        const uint64_t target_hz = (uint64_t)freq_khz * KHZ;
+        if (c.freq_hz != c.vco_freq_hz / div) return "wrong output frequency";
+        const uint64_t diff = scaled_diff(c.vco_freq_hz, div, target_hz);
+        if (diff * 1000000 > (uint64_t)tolerance_ppm * target_hz * div) return "out of tolerance";
+        // error_ppm is the error rounded up
+        if ((uint64_t)c.error_ppm * target_hz * div < diff * 1000000 ||
+            (c.error_ppm && (uint64_t)(c.error_ppm - 1) * target_hz * div >= diff * 1000000)) return "wrong error_ppm";
+
+        const uint64_t error_ppb = diff * 1000000000 / (target_hz * div);
+        if (low_vco) {
+            if (c.vco_freq_hz != ref.lowest_vco_hz || error_ppb != ref.lowest_vco_error_ppb) return "not the lowest VCO";
+        }
+        else if (error_ppb != ref.best_error_ppb) return "not the closest setting";
+
+        if (!low_vco && !error_ppb) {
+            uint vco, pd1, pd2;
+            if (!check_sys_clock_khz(freq_khz, &vco, &pd1, &pd2)) return "exact but check_sys_clock_khz() failed";
+            if (c.refdiv != 1 || c.vco_freq_hz != vco || c.post_div1 != pd1 || c.post_div2 != pd2) return "differs from check_sys_clock_khz()";
+        }
+        return "";
+    }
+
+    bool check_frequency(const char* name, uint freq_khz) {
+        bool good = true;
+        for (uint32_t tolerance : tolerances_ppm) {
+            for (bool low_vco : { false, true }) {
+                const char* error = check_solution(freq_khz, tolerance, low_vco);
+                if (!*error) continue;
+                printf("FAIL PLL %s, %u kHz, %u ppm%s: %s\n", name, freq_khz, tolerance, low_vco ? ", low VCO" : "", error);
+                good = false;
+            }
+        }
+        return good;
+    }
+
+    // init() at half the timing's size, and the clocks it leaves set up
+    bool check_profile(const TableTiming& t, DVHSTX::Mode mode, DVHSTX::ClockProfile profile) {
+        const bool text = mode == DVHSTX::MODE_TEXT_MONO || mode == DVHSTX::MODE_TEXT_RGB111;
+        const struct dvi_timing* expected_timing = text ? &dvi_timing_1280x720p_rb_50hz : t.timing;
+        dvhstx_host_clock_hz[clk_sys] = DEFAULT_SYS_HZ;
+
+        DVHSTX display;
+        display.set_timing(t.timing);
+        display.set_clock_profile(profile);
+        if (!display.init(t.timing->h_active_pixels / 2, t.timing->v_active_lines / 2, mode, false, {12, 14, 16, 18})) {
+            printf("FAIL clocks %s, mode %d, %s: init failed\n", t.name, mode, profile_name(profile));
+            return false;
+        }
+        const uint32_t hstx_hz = dvhstx_host_clock_hz[clk_hstx];
+        const uint32_t sys_hz = dvhstx_host_clock_hz[clk_sys];
+        display.reset();
+
+        uint32_t expected_sys_hz = DEFAULT_SYS_HZ;
+        if (profile == DVHSTX::CLOCK_LOW_POWER) expected_sys_hz = LOW_POWER_SYS_HZ;
+        else if (profile == DVHSTX::CLOCK_MAX_CPU && hstx_hz > DEFAULT_SYS_HZ && hstx_hz <= DVHSTX::MAX_CPU_CLOCK_KHZ * KHZ)
+            expected_sys_hz = hstx_hz;
+
+        const bool good = hstx_hz == expected_timing->bit_clk_khz * (KHZ / 2) && hstx_hz == display.get_hstx_clock_hz() &&
+                          sys_hz == expected_sys_hz;
+        if (!good) printf("FAIL clocks %s, mode %d, %s: HSTX %u Hz, sys %u Hz\n", t.name, mode, profile_name(profile), hstx_hz, sys_hz);
+        return good;
+    }
+}
+
+int main() {
+    int failed = 0;
+
+    for (const TableTiming& t : table_timings) {
+        const bool good = check_frequency(t.name, t.timing->bit_clk_khz >> 1);
+        if (good) printf("ok   PLL %s\n", t.name);
+        failed += !good;
+    }
+
+    for (const auto& s : cvt_sizes) {
+        char name[32];
+        snprintf(name, sizeof(name), "CVT-RB %dx%d@%d", s[0], s[1], s[2]);
+        struct dvi_timing t;
+        const bool good = dvi_cvt_rb_timing(&t, s[0], s[1], s[2]) && check_frequency(name, t.bit_clk_khz >> 1);
+        if (good) printf("ok   PLL %s\n", name);
+        failed += !good;
+    }
+
+    // Every frequency a pixel clock might be, in steps that hit a mix of
+    // exact and inexact settings
+    bool sweep_good = true;
+    for (uint freq_khz = 20000; freq_khz <= 400000; freq_khz += 997) {
+        sweep_good = check_frequency("sweep", freq_khz) && sweep_good;
+    }
+    if (sweep_good) printf("ok   PLL 20-400MHz sweep\n");
+    failed += !sweep_good;
+
+    // No setting at all is 1 ppm from these, and out of range is refused
+    struct dvi_pll_config c;
+    const bool limits_good = !dvi_find_pll_config(&c, 0, 5000, false) && !dvi_find_pll_config(&c, 2000000, 5000, false) &&
+                             !dvi_find_pll_config(&c, 10000, 5000, false);
+    printf("%s PLL refuses unreachable frequencies\n", limits_good ? "ok  " : "FAIL");
+    failed += !limits_good;
+
+    for (DVHSTX::ClockProfile profile : { DVHSTX::CLOCK_EXACT_PIXEL, DVHSTX::CLOCK_MAX_CPU, DVHSTX::CLOCK_LOW_POWER }) {
+        bool good = true;
+        for (const TableTiming& t : table_timings) {
+            for (DVHSTX::Mode mode : modes) good = check_profile(t, mode, profile) && good;
+        }
+        if (good) printf("ok   clocks %s, every timing and mode\n", profile_name(profile));
+        failed += !good;
+    }
+
+    // A timing the PLL can only get near needs a tolerance
+    struct dvi_timing cvt;
+    dvi_cvt_rb_timing(&cvt, 1280, 1024, 60);
+    bool tolerance_good;
+    {
+        DVHSTX display;
+        display.set_timing(&cvt);
+        tolerance_good = !display.init(320, 256, DVHSTX::MODE_RGB565, false, {12, 14, 16, 18});
+        display.set_clock_profile(DVHSTX::CLOCK_EXACT_PIXEL, 5000);
+        const bool inited = display.init(320, 256, DVHSTX::MODE_RGB565, false, {12, 14, 16, 18});
+        const uint64_t target_hz = (uint64_t)(cvt.bit_clk_khz >> 1) * KHZ;
+        const uint64_t hstx_hz = display.get_hstx_clock_hz();
+        tolerance_good = tolerance_good && inited && hstx_hz == dvhstx_host_clock_hz[clk_hstx] &&
+                         (hstx_hz > target_hz ? hstx_hz - target_hz : target_hz - hstx_hz) * 1000000 <= 5000 * target_hz;
+        if (inited) display.reset();
+    }
+    printf("%s clocks CVT-RB 1280x1024@60 only within a tolerance\n", tolerance_good ? "ok  " : "FAIL");
+    failed += !tolerance_good;
+
+    return failed ? 1 : 0;
+}
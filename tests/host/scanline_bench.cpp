@@ -0,0 +1,266 @@
+// Scanline kernel benchmark, run on the host.
+//
+// Runs every scanline expansion kernel the driver uses, checks the line it
+// writes against a golden reference model of the format and prints the time
+// per line and the number of line buffer bytes written.  Fails if any line
+// differs from its golden line, or the kernel writes past it.
+//
+// The times are for the host's build of the kernels, so are only useful for
+// comparing changes to them: the Arm assembly paths and the time available
+// on the RP2350 are measured by examples/03scanlinebench on a board.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "dvhstx_scanline.hpp"
+
+using namespace pimoroni;
+
+namespace {
+    // Output lines are 1280 pixels wide, as in the 1280x720 based modes
+    constexpr int LINE_PIXELS = 1280;
+    constexpr int TEXT_CHARS = LINE_PIXELS / SCANLINE_TEXT_CHAR_WIDTH;
+    constexpr int ITERATIONS = 10000;
+    constexpr uint8_t UNWRITTEN = 0xa5;
+
+    uint8_t src[LINE_PIXELS * 2];
+    uint32_t palette[256];
+    uint32_t font_cache[SCANLINE_FONT_CACHE_WORDS];
+    // Written by the kernels, which start from base: unwritten words
+    // except for the kernels that modify a line already rendered.
+    uint32_t dst[LINE_PIXELS];
+    uint32_t base[LINE_PIXELS];
+    uint32_t golden[LINE_PIXELS];
+    bool failed = false;
+
+    // Time kernel, then run it once more from base and compare the first
+    // bytes of dst with golden, and the rest with base.
+    template<class F>
+    void bench(const char* name, int bytes, F kernel) {
+        memcpy(dst, base, sizeof(dst));
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i) kernel();
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const unsigned long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ITERATIONS;
+
+        memcpy(dst, base, sizeof(dst));
+        kernel();
+        const uint8_t* dst8 = (const uint8_t*)dst;
+        const bool good = memcmp(dst, golden, bytes) == 0 &&
+                          memcmp(dst8 + bytes, (const uint8_t*)base + bytes, sizeof(dst) - bytes) == 0;
+        if (!good) failed = true;
+        printf("%s %-20s %7lu ns/line %5d bytes/line\n", good ? "ok  " : "FAIL", name, ns, bytes);
+    }
+
+    void reset_base() {
+        memset(base, UNWRITTEN, sizeof(base));
+        memset(golden, UNWRITTEN, sizeof(golden));
+    }
+
+    void bench_rgb565(const char* name, int repeat) {
+        // Lines hold the source pixels, which the scanout list reads repeat times
+        const int src_pixels = LINE_PIXELS / repeat;
+        const uint16_t* src16 = (const uint16_t*)src;
+        uint16_t* golden16 = (uint16_t*)golden;
+        for (int i = 0; i < src_pixels; ++i) golden16[i] = src16[i];
+        bench(name, src_pixels * 2, [&] { scanline_rgb565(dst, src16, src_pixels); });
+    }
+
+    void bench_palette(const char* name, int repeat) {
+        const int src_pixels = LINE_PIXELS / repeat;
+        for (int i = 0; i < src_pixels; ++i) golden[i] = palette[src[i]];
+        bench(name, src_pixels * 4, [&] { scanline_palette(dst, src, palette, src_pixels); });
+    }
+
+    uint16_t rgb565(uint32_t c) {
+        return ((c >> 19) & 0x1f) << 11 | ((c >> 10) & 0x3f) << 5 | ((c >> 3) & 0x1f);
+    }
+
+    void bench_palette_rgb565(const char* name, int repeat) {
+        static uint16_t palette16[256];
+        scanline_build_palette_rgb565(palette16, palette);
+        const int src_pixels = LINE_PIXELS / repeat;
+        uint16_t* golden16 = (uint16_t*)golden;
+        for (int i = 0; i < src_pixels; ++i) golden16[i] = rgb565(palette[src[i]]);
+        bench(name, src_pixels * 2, [&] { scanline_palette_rgb565(dst, src, palette16, src_pixels); });
+    }
+
+    uint8_t ycbcr_clamp(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+    void bench_ycbcr420(const char* name, int repeat) {
+        static ScanlineYCbCrTables tables;
+        scanline_build_ycbcr_tables(&tables);
+        // The Y line followed by its half width Cb and Cr lines
+        const int src_pixels = LINE_PIXELS / repeat;
+        const uint8_t* cb = src + src_pixels;
+        const uint8_t* cr = cb + src_pixels / 2;
+        uint16_t* golden16 = (uint16_t*)golden;
+        for (int i = 0; i < src_pixels; ++i) {
+            // BT.601 full range, each term rounded in 16.16 fixed point
+            const int c = cb[i / 2] - 128, d = cr[i / 2] - 128;
+            const int r = src[i] + ((91881 * d + 32768) >> 16);
+            const int g = src[i] + ((-22554 * c + 32768) >> 16) + ((-46802 * d + 32768) >> 16);
+            const int b = src[i] + ((116130 * c + 32768) >> 16);
+            golden16[i] = rgb565(ycbcr_clamp(r) << 16 | ycbcr_clamp(g) << 8 | ycbcr_clamp(b));
+        }
+        bench(name, src_pixels * 2, [&] { scanline_ycbcr420(dst, src, cb, cr, &tables, src_pixels); });
+    }
+
+    void bench_packed(const char* name, int bits_per_pixel, void (*kernel)(uint32_t*, const uint8_t*, const uint32_t*, int)) {
+        static uint32_t lut[SCANLINE_PACKED_LUT_WORDS];
+        scanline_build_packed_lut(lut, palette, bits_per_pixel);
+        const int mask = (1 << bits_per_pixel) - 1;
+        for (int i = 0; i < LINE_PIXELS; ++i) {
+            const int shift = 8 - bits_per_pixel * (i % (8 / bits_per_pixel) + 1);
+            golden[i] = palette[(src[i * bits_per_pixel / 8] >> shift) & mask];
+        }
+        bench(name, LINE_PIXELS * 4, [&] { kernel(dst, src, lut, LINE_PIXELS); });
+    }
+
+    void bench_tiles(const char* name, int size,
+                     void (*kernel)(uint32_t*, const uint16_t*, const uint8_t*, const uint32_t*, int, int)) {
+        // Random flips and banks, with tiles taken from src
+        static uint16_t map[LINE_PIXELS / 8];
+        const int tile_bytes = size * size / 2, tile_y = 5;
+        const int tile_count = sizeof(src) / tile_bytes;
+        for (int i = 0; i < LINE_PIXELS / size; ++i) {
+            map[i] = (rand() % tile_count) |
+                     ((rand() & 1) ? SCANLINE_TILE_HFLIP : 0) |
+                     ((rand() & 1) ? SCANLINE_TILE_VFLIP : 0) |
+                     ((rand() % 16) << SCANLINE_TILE_BANK_SHIFT);
+        }
+        for (int i = 0; i < LINE_PIXELS; ++i) {
+            const uint16_t entry = map[i / size];
+            int tx = i % size, ty = tile_y;
+            if (entry & SCANLINE_TILE_HFLIP) tx = size - 1 - tx;
+            if (entry & SCANLINE_TILE_VFLIP) ty = size - 1 - ty;
+            const uint8_t bits = src[(entry & SCANLINE_TILE_INDEX_MASK) * tile_bytes + (ty * size + tx) / 2];
+            golden[i] = palette[(entry >> SCANLINE_TILE_BANK_SHIFT) * 16 + ((tx & 1) ? (bits & 0xf) : (bits >> 4))];
+        }
+        bench(name, LINE_PIXELS * 4, [&] { kernel(dst, map, src, palette, tile_y, LINE_PIXELS); });
+    }
+
+    // Blend over a line of random pixels, from an odd pixel of src, with
+    // transparent, opaque and partly transparent colours.
+    void bench_blend() {
+        uint32_t colours[SCANLINE_BLEND_COLOURS];
+        for (int i = 0; i < SCANLINE_BLEND_COLOURS; ++i) {
+            const uint32_t alpha = i == 0 ? 0 : i == 1 ? 255 : rand() % 256;
+            colours[i] = alpha << 24 | (rand() & 0xffffff);
+        }
+        static ScanlineBlend blend[SCANLINE_BLEND_COLOURS];
+        scanline_build_blend(blend, colours);
+
+        const int src_x = 1;
+        auto index = [&](int i) {
+            const int x = src_x + i;
+            return (x & 1) ? (src[x / 2] & 0xf) : (src[x / 2] >> 4);
+        };
+        auto alpha = [&](int i) { return ((colours[index(i)] >> 24) * 32 + 127) / 255; };
+        // Each field is (under * (32 - alpha) + over * alpha) / 32
+        auto mix = [&](uint32_t under, uint32_t over, uint32_t a, int shift, uint32_t mask) {
+            return (((under >> shift & mask) * (32 - a) + (over >> shift & mask) * a) >> 5) << shift;
+        };
+
+        for (int i = 0; i < LINE_PIXELS; ++i) base[i] = rand() & 0xffffff;
+        for (int i = 0; i < LINE_PIXELS; ++i) {
+            const uint32_t d = base[i], c = colours[index(i)], a = alpha(i);
+            golden[i] = mix(d, c, a, 16, 0xff) | mix(d, c, a, 8, 0xff) | mix(d, c, a, 0, 0xff);
+        }
+        bench("blend4", LINE_PIXELS * 4, [&] { scanline_blend4(dst, src, src_x, blend, LINE_PIXELS); });
+
+        const uint16_t* base16 = (const uint16_t*)base;
+        uint16_t* golden16 = (uint16_t*)golden;
+        for (int i = 0; i < LINE_PIXELS; ++i) {
+            const uint32_t d = base16[i], c = rgb565(colours[index(i)]), a = alpha(i);
+            golden16[i] = mix(d, c, a, 11, 0x1f) | mix(d, c, a, 5, 0x3f) | mix(d, c, a, 0, 0x1f);
+        }
+        bench("blend4_rgb565", LINE_PIXELS * 2, [&] { scanline_blend4_rgb565((uint16_t*)dst, src, src_x, blend, LINE_PIXELS); });
+        reset_base();
+    }
+
+    void bench_text() {
+        const int char_y = 12;
+        // The glyph bits of the character in each (character, attribute) pair
+        auto glyph = [&](int i) { return scanline_render_char_line(src[2 * i], char_y); };
+
+        for (int i = 0; i < TEXT_CHARS; ++i) golden[i] = scanline_render_char_line(src[i], char_y);
+        bench("text_mono", TEXT_CHARS * 4, [&] { scanline_text_mono(dst, src, TEXT_CHARS, char_y); });
+
+        uint8_t* golden8 = (uint8_t*)golden;
+        for (int i = 0; i < TEXT_CHARS; ++i) {
+            const uint32_t bits = glyph(i);
+            for (int j = 0; j < 13; ++j) {
+                golden8[i * SCANLINE_TEXT_CHAR_WIDTH + j] = src[2 * i + 1] * ((bits >> (24 - 2 * j)) & 3);
+            }
+            golden8[i * SCANLINE_TEXT_CHAR_WIDTH + 13] = 0;
+        }
+        bench("text_rgb111", TEXT_CHARS * SCANLINE_TEXT_CHAR_WIDTH,
+              [&] { scanline_text_rgb111((uint8_t*)dst, src, font_cache, TEXT_CHARS, char_y); });
+
+        // The cursor inverts all but the last column of its cell
+        const int cursor_x = 17;
+        memcpy(base, golden, sizeof(base));
+        for (int j = 0; j < SCANLINE_TEXT_CHAR_WIDTH - 1; ++j) golden8[cursor_x * SCANLINE_TEXT_CHAR_WIDTH + j] ^= 0xff;
+        bench("text_cursor", TEXT_CHARS * SCANLINE_TEXT_CHAR_WIDTH,
+              [&] { scanline_text_cursor((uint8_t*)dst, cursor_x); });
+        reset_base();
+
+        for (int i = 0; i < TEXT_CHARS; ++i) {
+            const uint32_t bits = glyph(i);
+            const uint32_t* ramp = &palette[(src[2 * i + 1] % SCANLINE_TEXT_RAMPS) * 4];
+            for (int j = 0; j < 13; ++j) {
+                golden[i * SCANLINE_TEXT_CHAR_WIDTH + j] = ramp[(bits >> (24 - 2 * j)) & 3];
+            }
+            golden[i * SCANLINE_TEXT_CHAR_WIDTH + 13] = ramp[0];
+        }
+        bench("text_palette", TEXT_CHARS * SCANLINE_TEXT_CHAR_WIDTH * 4,
+              [&] { scanline_text_palette(dst, src, font_cache, palette, TEXT_CHARS, char_y); });
+
+        static uint16_t palette16[256];
+        scanline_build_palette_rgb565(palette16, palette);
+        uint16_t* golden16 = (uint16_t*)golden;
+        for (int i = 0; i < TEXT_CHARS * SCANLINE_TEXT_CHAR_WIDTH; ++i) golden16[i] = rgb565(golden[i]);
+        bench("text_palette_rgb565", TEXT_CHARS * SCANLINE_TEXT_CHAR_WIDTH * 2,
+              [&] { scanline_text_palette_rgb565((uint16_t*)dst, src, font_cache, palette16, TEXT_CHARS, char_y); });
+    }
+}
+
+int main() {
+    srand(1);
+    for (size_t i = 0; i < sizeof(src); ++i) src[i] = rand() % 256;
+    for (int i = 0; i < 256; ++i) palette[i] = rand() & 0xffffff;
+    scanline_build_font_cache(font_cache);
+    reset_base();
+
+    bench_rgb565("rgb565_x1", 1);
+    bench_rgb565("rgb565_x2", 2);
+    bench_rgb565("rgb565_x4", 4);
+    bench_palette("palette_x1", 1);
+    bench_palette("palette_x2", 2);
+    bench_palette("palette_x4", 4);
+    bench_palette_rgb565("palette565_x1", 1);
+    bench_palette_rgb565("palette565_x2", 2);
+    bench_palette_rgb565("palette565_x4", 4);
+    bench_ycbcr420("ycbcr420_x1", 1);
+    bench_ycbcr420("ycbcr420_x2", 2);
+    bench_ycbcr420("ycbcr420_x4", 4);
+    bench_packed("palette1_x1", 1, scanline_palette1);
+    bench_packed("palette2_x1", 2, scanline_palette2);
+    bench_packed("palette4_x1", 4, scanline_palette4);
+    bench_tiles("tiles8_x1", 8, scanline_tiles8);
+    bench_tiles("tiles16_x1", 16, scanline_tiles16);
+    bench_blend();
+
+    // Text source: printable characters with 7-bit attributes, which are
+    // RGB111 colours or, masked, palette ramps
+    for (int i = 0; i < TEXT_CHARS; ++i) {
+        src[2 * i] = 0x20 + rand() % 95;
+        src[2 * i + 1] = rand() % 128;
+    }
+    bench_text();
+
+    return failed ? 1 : 0;
+}